@@ -0,0 +1,291 @@
+#ifndef _MATRIX_ARENA_H__
+#define _MATRIX_ARENA_H__
+
+#include <cstddef>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+#include <algorithm>
+#include <type_traits>
+#include "matrix_igm.hpp"
+
+// Workspace arena for temporaries. Every thread owns an Arena (a bump
+// allocator over cache line aligned chunks, thread_arena()); a Workspace
+// marks its top on construction and releases everything above the mark
+// on destruction, so scratch taken in a hot loop costs a pointer bump and
+// the chunks are reused by the next call instead of going back to the
+// heap. Threads never share an arena, OpenMP workers do not contend on
+// the allocator.
+// A Workspace hands out raw buffers and views; ArenaMat is a Mat whose
+// buffer comes from the arena and is not freed (except when it is the
+// last allocation), it must not outlive the enclosing Workspace.
+// The workspace of a kernel can be queried (geqrf_workspace, ...) and
+// reserved in advance, so that even the first call allocates nothing.
+// permute_cols lives here as it takes its bookkeeping from the arena.
+
+namespace igm {
+
+  constexpr size_t arena_chunk = size_t{ 1 } << 20;  // bytes of the first chunk
+  constexpr size_t arena_keep = size_t{ 1 } << 26;   // an emptied arena holding more frees its chunks
+
+  class Arena {
+  public:
+    // the top of the arena, see mark and release
+    struct marker {
+      size_t chunk;
+      size_t offset;
+      size_t base;
+    };
+
+    Arena() = default;
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+    ~Arena() { free_from(0); }
+
+    // bytes taken by an allocation of n elements of T
+    template<typename T>
+    static size_t bytes(const size_t n)
+    {
+      return (n * sizeof(T) + mat_align - 1) / mat_align * mat_align;
+    }
+
+    // uninitialized, mat_align aligned memory of bytes (rounded up)
+    void* allocate(size_t bytes)
+    {
+      bytes = (bytes + mat_align - 1) / mat_align * mat_align;
+      if (_chunks.empty() || _off + bytes > _chunks[_cur].size) {
+        if (_chunks.empty())
+          _cur = 0;
+        else {
+          _base += _chunks[_cur].size;
+          ++_cur;
+        }
+        _off = 0;
+        // the chunks above the top are unused; a too small one is
+        // replaced by a larger one
+        if (_cur < _chunks.size() && _chunks[_cur].size < bytes)
+          free_from(_cur);
+        if (_cur == _chunks.size()) {
+          const size_t last = _chunks.empty() ? arena_chunk / 2 : _chunks.back().size;
+          add_chunk(std::max(bytes, 2 * last));
+        }
+      }
+      void* p = _chunks[_cur].p + _off;
+      _off += bytes;
+      _high = std::max(_high, used());
+      return p;
+    }
+
+    template<typename T>
+    T* allocate(const size_t n)
+    {
+      static_assert(std::is_trivially_destructible<T>::value, "Arena holds trivial types only");
+      return static_cast<T*>(allocate(n * sizeof(T)));
+    }
+
+    // gives back the last allocation, any other one stays until release
+    void deallocate(void* p, size_t bytes)
+    {
+      bytes = (bytes + mat_align - 1) / mat_align * mat_align;
+      if (!_chunks.empty() && bytes <= _off && static_cast<unsigned char*>(p) == _chunks[_cur].p + _off - bytes)
+        _off -= bytes;
+    }
+
+    marker mark() const { return marker{ _cur, _off, _base }; }
+
+    // frees everything allocated after m was taken
+    void release(const marker m)
+    {
+      _cur = m.chunk;
+      _off = m.offset;
+      _base = m.base;
+      if (used() == 0 && capacity() > arena_keep)
+        free_from(0);
+    }
+
+    // makes sure bytes can be allocated without going to the heap
+    void reserve(const size_t bytes)
+    {
+      const size_t b = (bytes + mat_align - 1) / mat_align * mat_align;
+      if (!_chunks.empty() && _off + b <= _chunks[_cur].size)
+        return;
+      const size_t next = _chunks.empty() ? 0 : _cur + 1;
+      if (next < _chunks.size() && _chunks[next].size >= b)
+        return;
+      free_from(next);
+      add_chunk(std::max(b, arena_chunk));
+    }
+
+    // returns the chunks above the top to the heap
+    void shrink() { free_from(_chunks.empty() || (_cur == 0 && _off == 0) ? 0 : _cur + 1); }
+
+    size_t used() const { return _base + _off; }
+    size_t capacity() const
+    {
+      size_t c = 0;
+      for (const chunk& k : _chunks)
+        c += k.size;
+      return c;
+    }
+    // the largest used() so far, the workspace a run needed
+    size_t high_water() const { return _high; }
+
+  private:
+    struct chunk {
+      unsigned char* p;
+      size_t size;
+    };
+
+    void add_chunk(const size_t size)
+    {
+      _chunks.push_back(chunk{ aligned_allocator<unsigned char>().allocate(size), size });
+    }
+
+    void free_from(const size_t first)
+    {
+      for (size_t i = first; i < _chunks.size(); ++i)
+        aligned_allocator<unsigned char>().deallocate(_chunks[i].p, _chunks[i].size);
+      _chunks.resize(std::min(first, _chunks.size()));
+      if (_chunks.empty())
+        _cur = _off = _base = 0;
+    }
+
+    std::vector<chunk> _chunks;
+    size_t _cur = 0;    // chunk holding the top
+    size_t _off = 0;    // top within it
+    size_t _base = 0;   // bytes of the chunks below it
+    size_t _high = 0;
+  };
+
+
+  // the arena of the calling thread
+  inline Arena& thread_arena()
+  {
+    static thread_local Arena a;
+    return a;
+  }
+
+
+  // scope of temporaries: everything taken from the arena while it lives
+  // is released by its destructor
+  class Workspace {
+  public:
+    explicit Workspace(Arena& a = thread_arena()) : _a(a), _m(a.mark()) {}
+    ~Workspace() { _a.release(_m); }
+    Workspace(const Workspace&) = delete;
+    Workspace& operator=(const Workspace&) = delete;
+
+    // n uninitialized elements
+    template<typename T>
+    T* alloc(const size_t n) { return _a.allocate<T>(n); }
+
+    // rows x cols uninitialized matrix, lda = rows
+    template<typename T>
+    MatView<T> mat(const size_t rows, const size_t cols)
+    {
+      return MatView<T>(alloc<T>(rows * cols), rows, cols, rows);
+    }
+
+    Arena& arena() { return _a; }
+
+  private:
+    Arena& _a;
+    Arena::marker _m;
+  };
+
+
+  // allocator of the arena of the constructing thread, for ArenaMat
+  template<typename T>
+  struct arena_allocator {
+    using value_type = T;
+    template<typename U>
+    struct rebind { using other = arena_allocator<U>; };
+
+    arena_allocator() : arena(&thread_arena()) {}
+    explicit arena_allocator(Arena& a) : arena(&a) {}
+    template<typename U>
+    arena_allocator(const arena_allocator<U>& o) : arena(o.arena) {}
+
+    T* allocate(const size_t n) { return n ? arena->allocate<T>(n) : nullptr; }
+    void deallocate(T* p, const size_t n) { arena->deallocate(p, n * sizeof(T)); }
+
+    Arena* arena;
+  };
+
+  template<typename T, typename U>
+  bool operator==(const arena_allocator<T>& a, const arena_allocator<U>& b) { return a.arena == b.arena; }
+  template<typename T, typename U>
+  bool operator!=(const arena_allocator<T>& a, const arena_allocator<U>& b) { return a.arena != b.arena; }
+
+  template<typename T>
+  using ArenaMat = Mat<T, arena_allocator<T>>;
+
+
+  namespace detail {
+
+    enum : unsigned char { perm_seen = 1, perm_leader = 2 };
+
+    // one O(n) pass over p, n entries inc apart: false unless it is a
+    // permutation of 0 ... n-1, otherwise mark[i] is perm_leader for the
+    // first entry of every cycle met and perm_seen for the rest
+    inline bool perm_leaders(const size_t* p, const size_t n, const size_t inc, unsigned char* mark)
+    {
+      std::fill(mark, mark + n, static_cast<unsigned char>(0));
+      for (size_t i = 0; i < n; ++i)
+      {
+        if (mark[i])
+          continue;
+        mark[i] = perm_leader;
+        for (size_t j = p[i*inc]; j != i; j = p[j*inc])
+        {
+          if (j >= n || mark[j])
+            return false;
+          mark[j] = perm_seen;
+        }
+      }
+      return true;
+    }
+
+  } // namespace detail
+
+
+  // in place A = A(:, perm), or A(:, perm) = A with inverse; the cycles of
+  // the permutation are found once, the row blocks of the threads walk
+  // them from their leaders with column swaps; the marks come from the
+  // thread arena, nothing is allocated once warm
+  template<typename T>
+  void permute_cols(MatView<T> A, ConstMatView<size_t> perm, const bool inverse = false)
+  {
+    const size_t n = vec_len(perm);
+    const size_t inc = vec_inc(perm);
+    const size_t* p = perm.data();
+    Workspace ws;
+    unsigned char* mark = ws.alloc<unsigned char>(n);
+    if (n != A.cols() || !detail::perm_leaders(p, n, inc, mark))
+      throw std::runtime_error("Invalid permutation in permute_cols");
+    IGM_PROF("permute_cols", 0, 2 * sizeof(T) * A.rows() * n, A.rows(), n);
+    detail::for_col_blocks(A.rows(), 1, A.rows() * n, [&](const size_t, const size_t r0, const size_t r1) {
+      for (size_t i = 0; i < n; ++i)
+      {
+        if (mark[i] != detail::perm_leader)
+          continue;
+        // column k takes the one of p(k), or with inverse column i carries
+        // the one for p(k) along the cycle
+        for (size_t k = i; p[k*inc] != i; k = p[k*inc])
+        {
+          T* a = A.begincol(inverse ? i : k);
+          std::swap_ranges(a + r0, a + r1, A.begincol(p[k*inc]) + r0);
+        }
+      }
+    });
+  }
+
+  template<typename T, typename Alloc>
+  void permute_cols(Mat<T, Alloc>& A, ConstMatView<size_t> perm, const bool inverse = false)
+  {
+    permute_cols(A.view(), perm, inverse);
+  }
+
+} // namespace igm
+
+#endif // _MATRIX_ARENA_H__
@@ -0,0 +1,250 @@
+#ifndef _MATRIX_BATCH_H__
+#define _MATRIX_BATCH_H__
+
+#include <cstddef>
+#include <cmath>
+#include <algorithm>
+#include <stdexcept>
+#include <omp.h>
+#include "matrix_storage.hpp"
+#include "matrix_simd.h"
+#include "matrix_igm.hpp"
+
+// Batches of many small matrices of one shape (e.g. tens of thousands of
+// 8 x 8 to 64 x 64 least squares problems) in an interleaved layout: the
+// matrices are stored in groups of MatBatch::lanes (one cache line of
+// elements), element (i, j) of the lanes of a group is contiguous. The
+// kernels of matrix_batch_kernels.h run each step of the algorithm on all
+// lanes of a group at once, so they vectorize across the batch, and the
+// groups run in parallel. Padding lanes of the last group are zero.
+
+namespace igm {
+  namespace simd {
+
+    template<typename T>
+    struct batch_kernels {
+      void(*gemv)(bool, size_t, size_t, T, const T*, const T*, T, T*);
+      void(*geqr2)(size_t, size_t, T*, T*);
+      void(*ormqr_t)(size_t, size_t, const T*, const T*, size_t, T*);
+      void(*trsv)(bool, size_t, size_t, const T*, size_t, T*, size_t);
+    };
+
+    namespace scalar {
+#include "matrix_batch_kernels.h"
+    } // namespace scalar
+
+#ifdef IGM_SIMD_X86
+    IGM_SIMD_BEGIN("sse2")
+    namespace sse2 {
+#include "matrix_batch_kernels.h"
+    } // namespace sse2
+    IGM_SIMD_END
+
+    IGM_SIMD_BEGIN("avx2,fma")
+    namespace avx2 {
+#include "matrix_batch_kernels.h"
+    } // namespace avx2
+    IGM_SIMD_END
+
+    IGM_SIMD_BEGIN("avx512f")
+    namespace avx512 {
+#include "matrix_batch_kernels.h"
+    } // namespace avx512
+    IGM_SIMD_END
+#endif // IGM_SIMD_X86
+
+    template<typename T, size_t L>
+    batch_kernels<T> batch_kernels_for(const isa level)
+    {
+#ifdef IGM_SIMD_X86
+      switch (level) {
+      case isa::sse2: return sse2::batch_table<T, L>();
+      case isa::avx2: return avx2::batch_table<T, L>();
+      case isa::avx512: return avx512::batch_table<T, L>();
+      default: break;
+      }
+#endif
+      return scalar::batch_table<T, L>();
+    }
+
+  } // namespace simd
+
+
+  // count matrices of rows x cols, interleaved in groups of lanes
+  template<typename T, typename Alloc = aligned_allocator<T>>
+  class MatBatch {
+  public:
+    static constexpr size_t lanes = mat_align / sizeof(T) > 0 ? mat_align / sizeof(T) : 1;
+
+    MatBatch() = default;
+    MatBatch(const size_t count, const size_t rows, const size_t cols)
+      : _count(count), _nr(rows), _nc(cols),
+      _data((count + lanes - 1) / lanes * rows * cols * lanes, T{ 0 }) {}
+
+    size_t count() const { return _count; }
+    size_t rows() const { return _nr; }
+    size_t cols() const { return _nc; }
+    size_t groups() const { return (_count + lanes - 1) / lanes; }
+    // elements of one group
+    size_t group_size() const { return _nr * _nc * lanes; }
+
+    T* data() { return _data.data(); }
+    const T* data() const { return _data.data(); }
+    T* group(const size_t g) { return _data.data() + g * group_size(); }
+    const T* group(const size_t g) const { return _data.data() + g * group_size(); }
+
+    // element (r, c) of matrix b
+    T& operator()(const size_t b, const size_t r, const size_t c)
+    {
+      return _data[((b / lanes * _nc + c) * _nr + r) * lanes + b % lanes];
+    }
+    const T& operator()(const size_t b, const size_t r, const size_t c) const
+    {
+      return _data[((b / lanes * _nc + c) * _nr + r) * lanes + b % lanes];
+    }
+
+    // copies a matrix into / out of slot b
+    void set(const size_t b, Nondeduced<ConstMatView<T>> A)
+    {
+      if (b >= _count || A.rows() != _nr || A.cols() != _nc)
+        throw std::runtime_error("Invalid dimensions in MatBatch::set");
+      for (size_t c = 0; c < _nc; ++c)
+        for (size_t r = 0; r < _nr; ++r)
+          (*this)(b, r, c) = A(r, c);
+    }
+
+    void get(const size_t b, MatView<T> A) const
+    {
+      if (b >= _count || A.rows() != _nr || A.cols() != _nc)
+        throw std::runtime_error("Invalid dimensions in MatBatch::get");
+      for (size_t c = 0; c < _nc; ++c)
+        for (size_t r = 0; r < _nr; ++r)
+          A(r, c) = (*this)(b, r, c);
+    }
+
+  private:
+    size_t _count{ 0 };
+    size_t _nr{ 0 };
+    size_t _nc{ 0 };
+    MatStorage<T, Alloc> _data;
+  };
+
+
+  namespace batch {
+
+    constexpr size_t par_min = size_t{ 1 } << 15; // elements of a batch below run on one thread
+
+    namespace detail {
+
+      template<typename T>
+      simd::batch_kernels<T> kernels()
+      {
+        return simd::batch_kernels_for<T, MatBatch<T>::lanes>(simd::current_isa());
+      }
+
+      // f(g) for every group, in parallel for large batches
+      template<typename F>
+      void for_groups(const size_t groups, const size_t elements, F f)
+      {
+        const bool par = groups > 1 && omp_get_max_threads() > 1 && !omp_in_parallel()
+          && elements >= par_min;
+#pragma omp parallel for if(par) schedule(static)
+        for (long long g = 0; g < static_cast<long long>(groups); ++g)
+          f(static_cast<size_t>(g));
+      }
+
+      template<typename T, typename A1, typename A2>
+      void check_count(const MatBatch<T, A1>& a, const MatBatch<T, A2>& b, const char* msg)
+      {
+        if (a.count() != b.count())
+          throw std::runtime_error(msg);
+      }
+
+    } // namespace detail
+
+
+    // y = alpha*op(A)*x + beta*y for every matrix of the batch, x and y are
+    // batches of column vectors
+    template<typename T, typename Alloc>
+    void gemv(MatBatch<T, Alloc>& y, const MatBatch<T, Alloc>& A, const MatBatch<T, Alloc>& x,
+      const T alpha = T{ 1 }, const T beta = T{ 0 }, const bool trans = false)
+    {
+      detail::check_count(y, A, "Invalid batch count in batch::gemv");
+      detail::check_count(x, A, "Invalid batch count in batch::gemv");
+      if (x.rows() != (trans ? A.rows() : A.cols()) || y.rows() != (trans ? A.cols() : A.rows())
+        || x.cols() != 1 || y.cols() != 1)
+        throw std::runtime_error("Invalid dimensions in batch::gemv");
+      const auto k = detail::kernels<T>();
+      detail::for_groups(A.groups(), A.count() * A.rows() * A.cols(), [&](const size_t g) {
+        k.gemv(trans, A.rows(), A.cols(), alpha, A.group(g), x.group(g), beta, y.group(g));
+      });
+    }
+
+
+    // Householder QR of every matrix in place, like geqrf of matrix_qr.h;
+    // tau is a batch of min(rows, cols) x 1
+    template<typename T, typename Alloc>
+    void qr(MatBatch<T, Alloc>& A, MatBatch<T, Alloc>& tau)
+    {
+      detail::check_count(tau, A, "Invalid batch count in batch::qr");
+      if (tau.rows() != std::min(A.rows(), A.cols()) || tau.cols() != 1)
+        throw std::runtime_error("Invalid dimensions in batch::qr");
+      const auto k = detail::kernels<T>();
+      detail::for_groups(A.groups(), A.count() * A.rows() * A.cols(), [&](const size_t g) {
+        k.geqr2(A.rows(), A.cols(), A.group(g), tau.group(g));
+      });
+    }
+
+
+    // B = Q'*B with Q of batch::qr
+    template<typename T, typename Alloc>
+    void apply_qt(const MatBatch<T, Alloc>& A, const MatBatch<T, Alloc>& tau, MatBatch<T, Alloc>& B)
+    {
+      detail::check_count(tau, A, "Invalid batch count in batch::apply_qt");
+      detail::check_count(B, A, "Invalid batch count in batch::apply_qt");
+      if (B.rows() != A.rows() || tau.rows() != std::min(A.rows(), A.cols()))
+        throw std::runtime_error("Invalid dimensions in batch::apply_qt");
+      const auto k = detail::kernels<T>();
+      detail::for_groups(A.groups(), A.count() * A.rows() * (A.cols() + B.cols()), [&](const size_t g) {
+        k.ormqr_t(A.rows(), A.cols(), A.group(g), tau.group(g), B.cols(), B.group(g));
+      });
+    }
+
+
+    // solves R*X = B (R'*X = B with trans) in place for the first cols rows
+    // of B, R is the upper triangle of the leading cols x cols block of A
+    template<typename T, typename Alloc>
+    void trsv(const MatBatch<T, Alloc>& A, MatBatch<T, Alloc>& B, const bool trans = false)
+    {
+      detail::check_count(B, A, "Invalid batch count in batch::trsv");
+      if (A.rows() < A.cols() || B.rows() < A.cols())
+        throw std::runtime_error("Invalid dimensions in batch::trsv");
+      const auto k = detail::kernels<T>();
+      detail::for_groups(A.groups(), A.count() * A.cols() * (A.cols() + B.cols()), [&](const size_t g) {
+        k.trsv(trans, A.rows(), A.cols(), A.group(g), B.cols(), B.group(g), B.rows());
+      });
+    }
+
+
+    // least squares min |A*X - B| of every problem (rows >= cols, full
+    // rank); A is overwritten by its QR, the first cols rows of B by X.
+    // The three steps run on one group after the other while it is in cache.
+    template<typename T, typename Alloc>
+    void lstsq(MatBatch<T, Alloc>& A, MatBatch<T, Alloc>& tau, MatBatch<T, Alloc>& B)
+    {
+      detail::check_count(tau, A, "Invalid batch count in batch::lstsq");
+      detail::check_count(B, A, "Invalid batch count in batch::lstsq");
+      if (A.rows() < A.cols() || B.rows() != A.rows() || tau.rows() != A.cols() || tau.cols() != 1)
+        throw std::runtime_error("Invalid dimensions in batch::lstsq");
+      const auto k = detail::kernels<T>();
+      detail::for_groups(A.groups(), A.count() * A.rows() * (A.cols() + B.cols()), [&](const size_t g) {
+        k.geqr2(A.rows(), A.cols(), A.group(g), tau.group(g));
+        k.ormqr_t(A.rows(), A.cols(), A.group(g), tau.group(g), B.cols(), B.group(g));
+        k.trsv(false, A.rows(), A.cols(), A.group(g), B.cols(), B.group(g), B.rows());
+      });
+    }
+
+  } // namespace batch
+} // namespace igm
+
+#endif // _MATRIX_BATCH_H__
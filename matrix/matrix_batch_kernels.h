@@ -0,0 +1,169 @@
+// Kernels of matrix_batch.h on one group of L interleaved matrices.
+// Like matrix_gemm_kernels.h this file is included once per instruction
+// set inside its namespace and target region; no include guard on purpose.
+// Element (i, j) of lane l of an m x n group is a[(j*m + i)*L + l], the
+// innermost loops run over the L lanes and are vectorized.
+
+// y = alpha*op(A)*x + beta*y, x and y are groups of vectors
+template<typename T, size_t L>
+void batch_gemv(const bool ta, const size_t m, const size_t n, const T alpha,
+  const T* a, const T* x, const T beta, T* y)
+{
+  const size_t ny = ta ? n : m;
+  if (!ta) {
+    for (size_t i = 0; i < ny; ++i)
+#pragma omp simd
+      for (size_t l = 0; l < L; ++l)
+        y[i * L + l] = beta == T{ 0 } ? T{ 0 } : beta * y[i * L + l];
+    for (size_t j = 0; j < n; ++j)
+    {
+      alignas(64) T s[L];
+#pragma omp simd
+      for (size_t l = 0; l < L; ++l)
+        s[l] = alpha * x[j * L + l];
+      const T* aj = a + j * m * L;
+      for (size_t i = 0; i < m; ++i)
+#pragma omp simd
+        for (size_t l = 0; l < L; ++l)
+          y[i * L + l] += aj[i * L + l] * s[l];
+    }
+    return;
+  }
+
+  for (size_t j = 0; j < n; ++j)
+  {
+    alignas(64) T s[L] = {};
+    const T* aj = a + j * m * L;
+    for (size_t i = 0; i < m; ++i)
+#pragma omp simd
+      for (size_t l = 0; l < L; ++l)
+        s[l] += aj[i * L + l] * x[i * L + l];
+#pragma omp simd
+    for (size_t l = 0; l < L; ++l)
+      y[j * L + l] = beta == T{ 0 } ? alpha * s[l] : alpha * s[l] + beta * y[j * L + l];
+  }
+}
+
+
+// b(c:m, j) = H(c)*b(c:m, j) for the columns j of b, H(c) = I - tau*v*v'
+// with v = [1; a(c+1:m, c)]
+template<typename T, size_t L>
+void batch_larf(const size_t m, const size_t c, const T* ac, const T* tau,
+  const size_t nb, T* b, const size_t ldb)
+{
+  for (size_t j = 0; j < nb; ++j)
+  {
+    T* bj = b + j * ldb * L;
+    alignas(64) T w[L];
+#pragma omp simd
+    for (size_t l = 0; l < L; ++l)
+      w[l] = bj[c * L + l];
+    for (size_t i = c + 1; i < m; ++i)
+#pragma omp simd
+      for (size_t l = 0; l < L; ++l)
+        w[l] += ac[i * L + l] * bj[i * L + l];
+#pragma omp simd
+    for (size_t l = 0; l < L; ++l)
+    {
+      w[l] *= tau[l];
+      bj[c * L + l] -= w[l];
+    }
+    for (size_t i = c + 1; i < m; ++i)
+#pragma omp simd
+      for (size_t l = 0; l < L; ++l)
+        bj[i * L + l] -= w[l] * ac[i * L + l];
+  }
+}
+
+
+// unblocked Householder QR, like geqr2 of matrix_qr.h: R in the upper
+// triangle, the vectors below the diagonal, tau a group of min(m, n)
+// scalars. Lanes with a zero column get tau = 0 (H = I).
+template<typename T, size_t L>
+void batch_geqr2(const size_t m, const size_t n, T* a, T* tau)
+{
+  const size_t k = std::min(m, n);
+  for (size_t c = 0; c < k; ++c)
+  {
+    T* ac = a + c * m * L;
+    T* tc = tau + c * L;
+    alignas(64) T xn[L] = {};
+    alignas(64) T sc[L];
+    for (size_t i = c + 1; i < m; ++i)
+#pragma omp simd
+      for (size_t l = 0; l < L; ++l)
+        xn[l] += ac[i * L + l] * ac[i * L + l];
+    for (size_t l = 0; l < L; ++l)
+    {
+      const T al = ac[c * L + l];
+      const T nr = std::sqrt(al * al + xn[l]);
+      const T be = al >= T{ 0 } ? -nr : nr;
+      const bool z = xn[l] == T{ 0 };
+      tc[l] = z ? T{ 0 } : (be - al) / be;
+      sc[l] = z ? T{ 0 } : T{ 1 } / (al - be);
+      ac[c * L + l] = z ? al : be;
+    }
+    for (size_t i = c + 1; i < m; ++i)
+#pragma omp simd
+      for (size_t l = 0; l < L; ++l)
+        ac[i * L + l] *= sc[l];
+    batch_larf<T, L>(m, c, ac, tc, n - c - 1, a + (c + 1) * m * L, m);
+  }
+}
+
+
+// b = Q'*b, Q of batch_geqr2 of the m x n group a, b is m x nb
+template<typename T, size_t L>
+void batch_ormqr_t(const size_t m, const size_t n, const T* a, const T* tau,
+  const size_t nb, T* b)
+{
+  const size_t k = std::min(m, n);
+  for (size_t c = 0; c < k; ++c)
+    batch_larf<T, L>(m, c, a + c * m * L, tau + c * L, nb, b, m);
+}
+
+
+// solves R*x = b (or R'*x = b) in place, R is the upper triangle of the
+// leading n x n block of the m x n group a, b is ldb x nb and its first n
+// rows are solved
+template<typename T, size_t L>
+void batch_trsv(const bool tr, const size_t m, const size_t n, const T* a,
+  const size_t nb, T* b, const size_t ldb)
+{
+  for (size_t r = 0; r < nb; ++r)
+  {
+    T* x = b + r * ldb * L;
+    if (!tr) {
+      for (size_t j = n; j-- > 0;)
+      {
+        const T* aj = a + j * m * L;
+#pragma omp simd
+        for (size_t l = 0; l < L; ++l)
+          x[j * L + l] /= aj[j * L + l];
+        for (size_t i = 0; i < j; ++i)
+#pragma omp simd
+          for (size_t l = 0; l < L; ++l)
+            x[i * L + l] -= aj[i * L + l] * x[j * L + l];
+      }
+      continue;
+    }
+    for (size_t j = 0; j < n; ++j)
+    {
+      const T* aj = a + j * m * L;
+      for (size_t i = 0; i < j; ++i)
+#pragma omp simd
+        for (size_t l = 0; l < L; ++l)
+          x[j * L + l] -= aj[i * L + l] * x[i * L + l];
+#pragma omp simd
+      for (size_t l = 0; l < L; ++l)
+        x[j * L + l] /= aj[j * L + l];
+    }
+  }
+}
+
+
+template<typename T, size_t L>
+batch_kernels<T> batch_table()
+{
+  return { &batch_gemv<T, L>, &batch_geqr2<T, L>, &batch_ormqr_t<T, L>, &batch_trsv<T, L> };
+}
@@ -0,0 +1,332 @@
+#ifndef _MATRIX_BLAS_BACKEND_H__
+#define _MATRIX_BLAS_BACKEND_H__
+
+// Compile time BLAS backend of matrix_lpack_blas.h. The backend is chosen
+// by defining one of
+//   IGM_USE_MKL       Intel MKL, MKL_ILP64 selects the 64-bit interface
+//   IGM_USE_OPENBLAS  OpenBLAS cblas.h, built with INTERFACE64=1 for ILP64
+//   IGM_USE_BLIS      BLIS cblas compatibility layer
+// otherwise the reference backend runs the native kernels of
+// matrix_gemm.h, which need no external library.
+// backend::gemm/gemv/ger map T = float, double, std::complex<float> and
+// std::complex<double> to the s/d/c/z routine; other types always run in
+// the reference backend.
+
+#include <cstddef>
+#include <complex>
+#include <limits>
+#include <stdexcept>
+#include <type_traits>
+
+#if (defined(IGM_USE_MKL) + defined(IGM_USE_OPENBLAS) + defined(IGM_USE_BLIS)) > 1
+#error "define only one of IGM_USE_MKL, IGM_USE_OPENBLAS, IGM_USE_BLIS"
+#endif
+
+#if defined(IGM_USE_MKL)
+#include "mkl.h"
+#define IGM_CBLAS 1
+#elif defined(IGM_USE_OPENBLAS)
+#include <cblas.h>
+#define IGM_CBLAS 1
+#elif defined(IGM_USE_BLIS)
+#include <blis/cblas.h>
+#define IGM_CBLAS 1
+#else
+#define IGM_CBLAS 0
+// flags of the CBLAS interface
+enum CBLAS_ORDER { CblasRowMajor = 101, CblasColMajor = 102 };
+enum CBLAS_TRANSPOSE { CblasNoTrans = 111, CblasTrans = 112, CblasConjTrans = 113 };
+#endif
+
+#include "matrix_gemm.h"
+
+namespace igm {
+
+  // integer of the BLAS interface, 64-bit for ILP64 libraries
+#if defined(IGM_USE_MKL)
+  using blasint = MKL_INT;
+#elif defined(IGM_USE_OPENBLAS)
+  using blasint = ::blasint;
+#elif defined(IGM_USE_BLIS)
+  using blasint = f77_int;
+#else
+  using blasint = std::ptrdiff_t;
+#endif
+
+  namespace blas {
+    namespace backend {
+
+      inline const char* name()
+      {
+#if defined(IGM_USE_MKL)
+        return sizeof(blasint) == 8 ? "mkl ilp64" : "mkl lp64";
+#elif defined(IGM_USE_OPENBLAS)
+        return sizeof(blasint) == 8 ? "openblas ilp64" : "openblas lp64";
+#elif defined(IGM_USE_BLIS)
+        return sizeof(blasint) == 8 ? "blis ilp64" : "blis lp64";
+#else
+        return "reference";
+#endif
+      }
+
+
+      template<typename T> struct is_complex : std::false_type {};
+      template<typename T> struct is_complex<std::complex<T>> : std::true_type {};
+
+      // the types of the s/d/c/z routines
+      template<typename T>
+      struct is_blas_type : std::integral_constant<bool,
+        std::is_same<T, float>::value || std::is_same<T, double>::value ||
+        std::is_same<T, std::complex<float>>::value || std::is_same<T, std::complex<double>>::value> {};
+
+
+      // size or increment as the BLAS integer, an LP64 interface cannot
+      // address more than 2^31 - 1 elements per dimension
+      inline blasint to_blasint(const size_t n)
+      {
+        if (n > static_cast<size_t>(std::numeric_limits<blasint>::max()))
+          throw std::runtime_error("Dimension exceeds the BLAS integer range");
+        return static_cast<blasint>(n);
+      }
+
+
+      namespace reference {
+
+        template<typename T>
+        T conj_if(const T& a, std::false_type) { return a; }
+
+        template<typename T>
+        T conj_if(const T& a, std::true_type) { return std::conj(a); }
+
+        template<typename T>
+        T op(const CBLAS_TRANSPOSE t, const T& a)
+        {
+          return t == CblasConjTrans ? conj_if(a, is_complex<T>()) : a;
+        }
+
+
+        // conjugate transposes of complex matrices run in plain loops,
+        // everything else in the native kernels
+        template<typename T>
+        void gemm(CBLAS_TRANSPOSE transa, CBLAS_TRANSPOSE transb,
+          const size_t m, const size_t n, const size_t k, const T a,
+          const T* A, const size_t lda, const T* B, const size_t ldb,
+          const T b, T* C, const size_t ldc)
+        {
+          if (!is_complex<T>::value || (transa != CblasConjTrans && transb != CblasConjTrans)) {
+            native::gemm(transa != CblasNoTrans, transb != CblasNoTrans, m, n, k, a,
+              A, lda, B, ldb, b, C, ldc);
+            return;
+          }
+          for (size_t j = 0; j < n; ++j)
+            for (size_t i = 0; i < m; ++i)
+            {
+              T s{ 0 };
+              for (size_t p = 0; p < k; ++p)
+                s += op(transa, transa == CblasNoTrans ? A[p * lda + i] : A[i * lda + p])
+                  * op(transb, transb == CblasNoTrans ? B[j * ldb + p] : B[p * ldb + j]);
+              T& c = C[j * ldc + i];
+              c = b == T{ 0 } ? a * s : a * s + b * c;
+            }
+        }
+
+
+        template<typename T>
+        void gemv(CBLAS_TRANSPOSE transa, const size_t m, const size_t n, const T a,
+          const T* A, const size_t lda, const T* x, const size_t incx,
+          const T b, T* y, const size_t incy)
+        {
+          if (!is_complex<T>::value || transa != CblasConjTrans) {
+            native::gemv(transa != CblasNoTrans, m, n, a, A, lda, x, incx, b, y, incy);
+            return;
+          }
+          for (size_t j = 0; j < n; ++j)
+          {
+            T s{ 0 };
+            for (size_t i = 0; i < m; ++i)
+              s += op(transa, A[j * lda + i]) * x[i * incx];
+            T& yj = y[j * incy];
+            yj = b == T{ 0 } ? a * s : a * s + b * yj;
+          }
+        }
+
+      } // namespace reference
+
+
+#if IGM_CBLAS
+      template<typename T> struct cblas;
+
+      template<>
+      struct cblas<float> {
+        static void gemm(CBLAS_TRANSPOSE ta, CBLAS_TRANSPOSE tb, blasint m, blasint n, blasint k,
+          float a, const float* A, blasint lda, const float* B, blasint ldb, float b, float* C, blasint ldc)
+        {
+          cblas_sgemm(CblasColMajor, ta, tb, m, n, k, a, A, lda, B, ldb, b, C, ldc);
+        }
+        static void gemv(CBLAS_TRANSPOSE ta, blasint m, blasint n, float a, const float* A, blasint lda,
+          const float* x, blasint incx, float b, float* y, blasint incy)
+        {
+          cblas_sgemv(CblasColMajor, ta, m, n, a, A, lda, x, incx, b, y, incy);
+        }
+        static void ger(blasint m, blasint n, float a, const float* x, blasint incx,
+          const float* y, blasint incy, float* A, blasint lda)
+        {
+          cblas_sger(CblasColMajor, m, n, a, x, incx, y, incy, A, lda);
+        }
+      };
+
+      template<>
+      struct cblas<double> {
+        static void gemm(CBLAS_TRANSPOSE ta, CBLAS_TRANSPOSE tb, blasint m, blasint n, blasint k,
+          double a, const double* A, blasint lda, const double* B, blasint ldb, double b, double* C, blasint ldc)
+        {
+          cblas_dgemm(CblasColMajor, ta, tb, m, n, k, a, A, lda, B, ldb, b, C, ldc);
+        }
+        static void gemv(CBLAS_TRANSPOSE ta, blasint m, blasint n, double a, const double* A, blasint lda,
+          const double* x, blasint incx, double b, double* y, blasint incy)
+        {
+          cblas_dgemv(CblasColMajor, ta, m, n, a, A, lda, x, incx, b, y, incy);
+        }
+        static void ger(blasint m, blasint n, double a, const double* x, blasint incx,
+          const double* y, blasint incy, double* A, blasint lda)
+        {
+          cblas_dger(CblasColMajor, m, n, a, x, incx, y, incy, A, lda);
+        }
+      };
+
+      // ger is the unconjugated geru, like x*y' of the real types
+      template<>
+      struct cblas<std::complex<float>> {
+        using T = std::complex<float>;
+        static void gemm(CBLAS_TRANSPOSE ta, CBLAS_TRANSPOSE tb, blasint m, blasint n, blasint k,
+          T a, const T* A, blasint lda, const T* B, blasint ldb, T b, T* C, blasint ldc)
+        {
+          cblas_cgemm(CblasColMajor, ta, tb, m, n, k, &a, A, lda, B, ldb, &b, C, ldc);
+        }
+        static void gemv(CBLAS_TRANSPOSE ta, blasint m, blasint n, T a, const T* A, blasint lda,
+          const T* x, blasint incx, T b, T* y, blasint incy)
+        {
+          cblas_cgemv(CblasColMajor, ta, m, n, &a, A, lda, x, incx, &b, y, incy);
+        }
+        static void ger(blasint m, blasint n, T a, const T* x, blasint incx,
+          const T* y, blasint incy, T* A, blasint lda)
+        {
+          cblas_cgeru(CblasColMajor, m, n, &a, x, incx, y, incy, A, lda);
+        }
+      };
+
+      template<>
+      struct cblas<std::complex<double>> {
+        using T = std::complex<double>;
+        static void gemm(CBLAS_TRANSPOSE ta, CBLAS_TRANSPOSE tb, blasint m, blasint n, blasint k,
+          T a, const T* A, blasint lda, const T* B, blasint ldb, T b, T* C, blasint ldc)
+        {
+          cblas_zgemm(CblasColMajor, ta, tb, m, n, k, &a, A, lda, B, ldb, &b, C, ldc);
+        }
+        static void gemv(CBLAS_TRANSPOSE ta, blasint m, blasint n, T a, const T* A, blasint lda,
+          const T* x, blasint incx, T b, T* y, blasint incy)
+        {
+          cblas_zgemv(CblasColMajor, ta, m, n, &a, A, lda, x, incx, &b, y, incy);
+        }
+        static void ger(blasint m, blasint n, T a, const T* x, blasint incx,
+          const T* y, blasint incy, T* A, blasint lda)
+        {
+          cblas_zgeru(CblasColMajor, m, n, &a, x, incx, y, incy, A, lda);
+        }
+      };
+#endif
+
+
+      namespace detail {
+
+        template<typename T>
+        void gemm(std::false_type, CBLAS_TRANSPOSE transa, CBLAS_TRANSPOSE transb,
+          const size_t m, const size_t n, const size_t k, const T a,
+          const T* A, const size_t lda, const T* B, const size_t ldb,
+          const T b, T* C, const size_t ldc)
+        {
+          reference::gemm(transa, transb, m, n, k, a, A, lda, B, ldb, b, C, ldc);
+        }
+
+        template<typename T>
+        void gemv(std::false_type, CBLAS_TRANSPOSE transa, const size_t m, const size_t n, const T a,
+          const T* A, const size_t lda, const T* x, const size_t incx,
+          const T b, T* y, const size_t incy)
+        {
+          reference::gemv(transa, m, n, a, A, lda, x, incx, b, y, incy);
+        }
+
+        template<typename T>
+        void ger(std::false_type, const size_t m, const size_t n, const T a, const T* x, const size_t incx,
+          const T* y, const size_t incy, T* A, const size_t lda)
+        {
+          native::ger(m, n, a, x, incx, y, incy, A, lda);
+        }
+
+#if IGM_CBLAS
+        template<typename T>
+        void gemm(std::true_type, CBLAS_TRANSPOSE transa, CBLAS_TRANSPOSE transb,
+          const size_t m, const size_t n, const size_t k, const T a,
+          const T* A, const size_t lda, const T* B, const size_t ldb,
+          const T b, T* C, const size_t ldc)
+        {
+          cblas<T>::gemm(transa, transb, to_blasint(m), to_blasint(n), to_blasint(k), a,
+            A, to_blasint(lda), B, to_blasint(ldb), b, C, to_blasint(ldc));
+        }
+
+        template<typename T>
+        void gemv(std::true_type, CBLAS_TRANSPOSE transa, const size_t m, const size_t n, const T a,
+          const T* A, const size_t lda, const T* x, const size_t incx,
+          const T b, T* y, const size_t incy)
+        {
+          cblas<T>::gemv(transa, to_blasint(m), to_blasint(n), a, A, to_blasint(lda),
+            x, to_blasint(incx), b, y, to_blasint(incy));
+        }
+
+        template<typename T>
+        void ger(std::true_type, const size_t m, const size_t n, const T a, const T* x, const size_t incx,
+          const T* y, const size_t incy, T* A, const size_t lda)
+        {
+          cblas<T>::ger(to_blasint(m), to_blasint(n), a, x, to_blasint(incx),
+            y, to_blasint(incy), A, to_blasint(lda));
+        }
+#endif
+
+        template<typename T>
+        using use_cblas = std::integral_constant<bool, IGM_CBLAS && is_blas_type<T>::value>;
+
+      } // namespace detail
+
+
+      // C = a*op(A)*op(B) + b*C, op(A) is m x k and op(B) k x n
+      template<typename T>
+      void gemm(CBLAS_TRANSPOSE transa, CBLAS_TRANSPOSE transb,
+        const size_t m, const size_t n, const size_t k, const T a,
+        const T* A, const size_t lda, const T* B, const size_t ldb,
+        const T b, T* C, const size_t ldc)
+      {
+        detail::gemm(detail::use_cblas<T>(), transa, transb, m, n, k, a, A, lda, B, ldb, b, C, ldc);
+      }
+
+      // y = a*op(A)*x + b*y, A is m x n
+      template<typename T>
+      void gemv(CBLAS_TRANSPOSE transa, const size_t m, const size_t n, const T a,
+        const T* A, const size_t lda, const T* x, const size_t incx,
+        const T b, T* y, const size_t incy)
+      {
+        detail::gemv(detail::use_cblas<T>(), transa, m, n, a, A, lda, x, incx, b, y, incy);
+      }
+
+      // A = a*x*y' + A (unconjugated), A is m x n
+      template<typename T>
+      void ger(const size_t m, const size_t n, const T a, const T* x, const size_t incx,
+        const T* y, const size_t incy, T* A, const size_t lda)
+      {
+        detail::ger(detail::use_cblas<T>(), m, n, a, x, incx, y, incy, A, lda);
+      }
+
+    } // namespace backend
+  } // namespace blas
+} // namespace igm
+
+#endif // _MATRIX_BLAS_BACKEND_H__
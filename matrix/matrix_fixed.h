@@ -0,0 +1,317 @@
+#ifndef _MATRIX_FIXED_H__
+#define _MATRIX_FIXED_H__
+
+#include <cstddef>
+#include <initializer_list>
+#include <stdexcept>
+#include <utility>
+#include "matrix_igm.hpp"
+
+// Fixed size R x C column major matrix with the elements stored in the
+// object (stack or enclosing object, no allocation, no gslice), for the
+// 3x3 ... 6x6 matrices of geometry code. Element access, rows/cols/lda,
+// begincol/endcol and view() are those of Mat, so generic code and the
+// view kernels take both, and a FixedMat is a leaf of the Mat expressions.
+// Arithmetic among FixedMat, mul, transpose, solve, det and inv are
+// constexpr; element-wise operations expand over the elements, the other
+// loops have compile time trip counts and are unrolled by the compiler.
+// As for Mat, * is element-wise, mul is the matrix product.
+
+namespace igm {
+
+  template<typename T, size_t R, size_t C>
+  class FixedMat;
+
+  template<typename T, size_t R, size_t C>
+  struct expr_ref<FixedMat<T, R, C>> { using type = const FixedMat<T, R, C>&; };
+
+
+  template<typename T, size_t R, size_t C>
+  class FixedMat : public MatExpr<FixedMat<T, R, C>> {
+  public:
+    using val_type = T;
+    using idx_type = size_t;
+
+    constexpr FixedMat() : _a{} {}
+    explicit constexpr FixedMat(const T init) : _a{} { fill(init); }
+    // one inner list per column, as Mat
+    constexpr FixedMat(std::initializer_list<std::initializer_list<T>> list) : _a{}
+    {
+      if (list.size() != C)
+        throw std::runtime_error("Invalid dimensions in FixedMat");
+      size_t j = 0;
+      for (const auto& col : list)
+      {
+        if (col.size() != R)
+          throw std::runtime_error("Invalid dimensions in FixedMat");
+        size_t i = 0;
+        for (const T a : col)
+          _a[R * j + i++] = a;
+        ++j;
+      }
+    }
+
+    // element-wise expressions of Mat, views and FixedMat
+    template<typename E>
+    FixedMat(const MatExpr<E>& e) : _a{} { eval_cols(_a, R, R, C, e.self(), assign_op<T>()); }
+    template<typename E>
+    FixedMat& operator=(const MatExpr<E>& e)
+    {
+      eval_cols(_a, R, R, C, e.self(), assign_op<T>());
+      return *this;
+    }
+
+    static constexpr size_t rows() { return R; }
+    static constexpr size_t cols() { return C; }
+    static constexpr size_t lda() { return R; }
+    static constexpr size_t size() { return R * C; }
+    static constexpr bool empty() { return R == 0 || C == 0; }
+    static constexpr bool dense() { return true; }
+
+    constexpr T* data() { return _a; }
+    constexpr const T* data() const { return _a; }
+    constexpr T* begin() { return _a; }
+    constexpr const T* begin() const { return _a; }
+    constexpr T* end() { return _a + R * C; }
+    constexpr const T* end() const { return _a + R * C; }
+    constexpr T* begincol(const size_t col) { return _a + R * col; }
+    constexpr const T* begincol(const size_t col) const { return _a + R * col; }
+    constexpr T* endcol(const size_t col) { return _a + R * col + R; }
+    constexpr const T* endcol(const size_t col) const { return _a + R * col + R; }
+    constexpr const T* ecol(const size_t j) const { return begincol(j); }
+
+    constexpr T& operator()(const size_t r, const size_t c) { return _a[R * c + r]; }
+    constexpr const T& operator()(const size_t r, const size_t c) const { return _a[R * c + r]; }
+    // i-th column of a row vector, as Mat
+    constexpr T& operator()(const size_t idx) { return _a[R * idx]; }
+    constexpr const T& operator()(const size_t idx) const { return _a[R * idx]; }
+    constexpr T at(const size_t idx) const { return _a[idx]; }
+
+    MatView<T> view() { return MatView<T>(_a, R, C, R); }
+    ConstMatView<T> view() const { return ConstMatView<T>(_a, R, C, R); }
+    MatView<T> view(const size_t rFirst, const size_t rLast, const size_t cFirst, const size_t cLast)
+    { return MatView<T>(_a + R * cFirst + rFirst, rLast - rFirst + 1, cLast - cFirst + 1, R); }
+    ConstMatView<T> view(const size_t rFirst, const size_t rLast, const size_t cFirst, const size_t cLast) const
+    { return ConstMatView<T>(_a + R * cFirst + rFirst, rLast - rFirst + 1, cLast - cFirst + 1, R); }
+    operator MatView<T>() { return view(); }
+    operator ConstMatView<T>() const { return view(); }
+
+    constexpr void fill(const T val)
+    {
+      for (size_t i = 0; i < R * C; ++i)
+        _a[i] = val;
+    }
+    constexpr void zeros() { fill(T{ 0 }); }
+    constexpr void eye()
+    {
+      static_assert(R == C, "eye of a non square FixedMat");
+      zeros();
+      for (size_t i = 0; i < R; ++i)
+        _a[i * (R + 1)] = T{ 1 };
+    }
+
+    constexpr void swapcols(const size_t c1, const size_t c2)
+    {
+      for (size_t i = 0; i < R; ++i)
+      {
+        const T t = _a[R * c1 + i];
+        _a[R * c1 + i] = _a[R * c2 + i];
+        _a[R * c2 + i] = t;
+      }
+    }
+
+    constexpr FixedMat& operator+=(const FixedMat& b) { return apply_to<add_op>(b); }
+    constexpr FixedMat& operator-=(const FixedMat& b) { return apply_to<sub_op>(b); }
+    constexpr FixedMat& operator*=(const FixedMat& b) { return apply_to<mul_op>(b); }
+    constexpr FixedMat& operator/=(const FixedMat& b) { return apply_to<div_op>(b); }
+    constexpr FixedMat& operator+=(const T s) { return apply_to<add_op>(FixedMat(s)); }
+    constexpr FixedMat& operator-=(const T s) { return apply_to<sub_op>(FixedMat(s)); }
+    constexpr FixedMat& operator*=(const T s) { return apply_to<mul_op>(FixedMat(s)); }
+    constexpr FixedMat& operator/=(const T s) { return apply_to<div_op>(FixedMat(s)); }
+
+    // element-wise a op b, expanded over the elements
+    template<typename Op>
+    static constexpr FixedMat apply(const FixedMat& a, const FixedMat& b)
+    {
+      return apply<Op>(a, b, std::make_index_sequence<R * C>());
+    }
+
+  private:
+    struct elems_t {};
+    template<typename... V>
+    constexpr FixedMat(elems_t, const V... v) : _a{ v... } {}
+
+    template<typename Op, size_t... I>
+    static constexpr FixedMat apply(const FixedMat& a, const FixedMat& b, std::index_sequence<I...>)
+    {
+      return FixedMat(elems_t{}, Op::apply(a._a[I], b._a[I])...);
+    }
+
+    template<typename Op>
+    constexpr FixedMat& apply_to(const FixedMat& b)
+    {
+      *this = apply<Op>(*this, b);
+      return *this;
+    }
+
+    T _a[R * C > 0 ? R * C : 1];  // a zero sized array is not standard
+  };
+
+
+  // element-wise, as for Mat; these are exact matches and win over the
+  // MatExpr operators, the result is a FixedMat and not an expression
+  template<typename T, size_t R, size_t C>
+  constexpr FixedMat<T, R, C> operator+(const FixedMat<T, R, C>& a, const FixedMat<T, R, C>& b)
+  { return FixedMat<T, R, C>::template apply<add_op>(a, b); }
+
+  template<typename T, size_t R, size_t C>
+  constexpr FixedMat<T, R, C> operator-(const FixedMat<T, R, C>& a, const FixedMat<T, R, C>& b)
+  { return FixedMat<T, R, C>::template apply<sub_op>(a, b); }
+
+  template<typename T, size_t R, size_t C>
+  constexpr FixedMat<T, R, C> operator*(const FixedMat<T, R, C>& a, const FixedMat<T, R, C>& b)
+  { return FixedMat<T, R, C>::template apply<mul_op>(a, b); }
+
+  template<typename T, size_t R, size_t C>
+  constexpr FixedMat<T, R, C> operator/(const FixedMat<T, R, C>& a, const FixedMat<T, R, C>& b)
+  { return FixedMat<T, R, C>::template apply<div_op>(a, b); }
+
+  template<typename T, size_t R, size_t C>
+  constexpr FixedMat<T, R, C> operator+(const FixedMat<T, R, C>& a, const T s)
+  { return FixedMat<T, R, C>::template apply<add_op>(a, FixedMat<T, R, C>(s)); }
+
+  template<typename T, size_t R, size_t C>
+  constexpr FixedMat<T, R, C> operator-(const FixedMat<T, R, C>& a, const T s)
+  { return FixedMat<T, R, C>::template apply<sub_op>(a, FixedMat<T, R, C>(s)); }
+
+  template<typename T, size_t R, size_t C>
+  constexpr FixedMat<T, R, C> operator*(const FixedMat<T, R, C>& a, const T s)
+  { return FixedMat<T, R, C>::template apply<mul_op>(a, FixedMat<T, R, C>(s)); }
+
+  template<typename T, size_t R, size_t C>
+  constexpr FixedMat<T, R, C> operator/(const FixedMat<T, R, C>& a, const T s)
+  { return FixedMat<T, R, C>::template apply<div_op>(a, FixedMat<T, R, C>(s)); }
+
+
+  // matrix product A*B
+  template<typename T, size_t R, size_t K, size_t C>
+  constexpr FixedMat<T, R, C> mul(const FixedMat<T, R, K>& A, const FixedMat<T, K, C>& B)
+  {
+    FixedMat<T, R, C> P;
+    for (size_t j = 0; j < C; ++j)
+      for (size_t p = 0; p < K; ++p)
+      {
+        const T b = B(p, j);
+        for (size_t i = 0; i < R; ++i)
+          P(i, j) += A(i, p) * b;
+      }
+    return P;
+  }
+
+
+  template<typename T, size_t R, size_t C>
+  constexpr FixedMat<T, C, R> transpose(const FixedMat<T, R, C>& A)
+  {
+    FixedMat<T, C, R> At;
+    for (size_t j = 0; j < C; ++j)
+      for (size_t i = 0; i < R; ++i)
+        At(j, i) = A(i, j);
+    return At;
+  }
+
+
+  namespace detail {
+
+    // LU with partial pivoting of the N x N A in place, the row swaps
+    // applied to B too; returns the sign of the permutation, 0 when a
+    // pivot is exactly zero
+    template<typename T, size_t N, size_t K>
+    constexpr int lu_fixed(FixedMat<T, N, N>& A, FixedMat<T, N, K>& B)
+    {
+      int sign = 1;
+      for (size_t k = 0; k < N; ++k)
+      {
+        size_t p = k;
+        T big = A(k, k) < T{ 0 } ? -A(k, k) : A(k, k);
+        for (size_t i = k + 1; i < N; ++i)
+        {
+          const T a = A(i, k) < T{ 0 } ? -A(i, k) : A(i, k);
+          if (a > big) {
+            big = a;
+            p = i;
+          }
+        }
+        if (big == T{ 0 })
+          return 0;
+        if (p != k) {
+          sign = -sign;
+          for (size_t j = 0; j < N; ++j)
+          {
+            const T t = A(k, j);
+            A(k, j) = A(p, j);
+            A(p, j) = t;
+          }
+          for (size_t j = 0; j < K; ++j)
+          {
+            const T t = B(k, j);
+            B(k, j) = B(p, j);
+            B(p, j) = t;
+          }
+        }
+        for (size_t i = k + 1; i < N; ++i)
+          A(i, k) /= A(k, k);
+        for (size_t j = k + 1; j < N; ++j)
+          for (size_t i = k + 1; i < N; ++i)
+            A(i, j) -= A(i, k) * A(k, j);
+      }
+      return sign;
+    }
+
+  } // namespace detail
+
+
+  // X = A\B by Gaussian elimination with partial pivoting
+  template<typename T, size_t N, size_t K>
+  constexpr FixedMat<T, N, K> solve(FixedMat<T, N, N> A, FixedMat<T, N, K> B)
+  {
+    if (detail::lu_fixed(A, B) == 0)
+      throw std::runtime_error("Singular matrix in solve");
+    for (size_t c = 0; c < K; ++c)
+    {
+      for (size_t i = 0; i < N; ++i)
+        for (size_t l = 0; l < i; ++l)
+          B(i, c) -= A(i, l) * B(l, c);
+      for (size_t i = N; i-- > 0;)
+      {
+        for (size_t l = i + 1; l < N; ++l)
+          B(i, c) -= A(i, l) * B(l, c);
+        B(i, c) /= A(i, i);
+      }
+    }
+    return B;
+  }
+
+
+  template<typename T, size_t N>
+  constexpr T det(FixedMat<T, N, N> A)
+  {
+    FixedMat<T, N, 0> none;
+    const int sign = detail::lu_fixed(A, none);
+    T d = static_cast<T>(sign);
+    for (size_t i = 0; i < N; ++i)
+      d *= A(i, i);
+    return d;
+  }
+
+
+  template<typename T, size_t N>
+  constexpr FixedMat<T, N, N> inv(const FixedMat<T, N, N>& A)
+  {
+    FixedMat<T, N, N> I;
+    I.eye();
+    return solve(A, I);
+  }
+
+} // namespace igm
+
+#endif // _MATRIX_FIXED_H__
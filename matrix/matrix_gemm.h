@@ -0,0 +1,392 @@
+#ifndef _MATRIX_GEMM_H__
+#define _MATRIX_GEMM_H__
+
+#include <cstddef>
+#include <algorithm>
+#include <type_traits>
+#include <omp.h>
+#include "matrix_storage.hpp"
+#include "matrix_simd.h"
+
+// Native column-major gemm, gemv and ger, used by matrix_lpack_blas.h when
+// no external BLAS is configured.
+// gemm follows the BLIS scheme: a kc x nc panel of op(B) and an mc x kc
+// block of op(A) are packed into micro-panels of nr columns and mr rows,
+// and a register blocked micro-kernel updates one mr x nr block of C per
+// pass over kc. The micro-kernel is chosen at run time like the kernels
+// of matrix_simd.h; the micro-tiles of all kernels of one thread team run
+// in parallel.
+
+namespace igm {
+  namespace simd {
+
+    namespace scalar {
+#include "matrix_gemm_kernels.h"
+    } // namespace scalar
+
+#ifdef IGM_SIMD_X86
+    IGM_SIMD_BEGIN("sse2")
+    namespace sse2 {
+#include "matrix_gemm_kernels.h"
+    } // namespace sse2
+    IGM_SIMD_END
+
+    IGM_SIMD_BEGIN("avx2,fma")
+    namespace avx2 {
+#include "matrix_gemm_kernels.h"
+    } // namespace avx2
+    IGM_SIMD_END
+
+    IGM_SIMD_BEGIN("avx512f")
+    namespace avx512 {
+#include "matrix_gemm_kernels.h"
+    } // namespace avx512
+    IGM_SIMD_END
+#endif // IGM_SIMD_X86
+
+  } // namespace simd
+
+
+  namespace blas {
+    namespace native {
+
+      constexpr size_t gemm_small = 32 * 32 * 32;        // m*n*k below runs unpacked
+      constexpr size_t gemm_thin = 16 * 16;              // the two short sides of a thin product below run unpacked
+      constexpr size_t gemm_strip = 256;                 // rows of the long side per pass of the unpacked gemm
+      constexpr double gemm_par_min = 64.0 * 64.0 * 64.0; // m*n*k below runs on one thread
+      constexpr size_t gemv_par_min = size_t{ 1 } << 16;  // m*n below runs on one thread
+
+      // micro-kernel and blocking of one instruction set
+      //   mr x nr   register block of C
+      //   kc        depth of one pass, an mr x kc and a kc x nr micro-panel stay in L1
+      //   mc        rows of the packed block of A, mc x kc stays in L2
+      //   nc        columns of the packed panel of B, kc x nc stays in L3
+      template<typename T>
+      struct gemm_kernel {
+        void(*micro)(size_t, const T*, const T*, T*, size_t, size_t, size_t, T, T);
+        size_t mr, nr, mc, kc, nc;
+      };
+
+      namespace detail {
+
+        template<typename T>
+        gemm_kernel<T> gemm_kernel_for(const simd::isa level, std::true_type)
+        {
+          // float has twice the elements per register and per cache line
+          const size_t e = sizeof(double) / sizeof(T);
+          switch (level) {
+#ifdef IGM_SIMD_X86
+          case simd::isa::avx512:
+            return { &simd::avx512::gemm_micro<simd::avx512::vec<T>, 2, 12>, 16 * e, 12, 128 * e, 256, 4080 };
+          case simd::isa::avx2:
+            return { &simd::avx2::gemm_micro<simd::avx2::vec<T>, 2, 6>, 8 * e, 6, 96 * e, 256, 4080 };
+          case simd::isa::sse2:
+            return { &simd::sse2::gemm_micro<simd::sse2::vec<T>, 2, 4>, 4 * e, 4, 96 * e, 256, 4096 };
+#endif
+          default:
+            return { &simd::scalar::gemm_micro<simd::scalar::vec<T>, 4, 4>, 4, 4, 64, 256, 4096 };
+          }
+        }
+
+        template<typename T>
+        gemm_kernel<T> gemm_kernel_for(const simd::isa, std::false_type)
+        {
+          return { &simd::scalar::gemm_micro<simd::scalar::vec<T>, 4, 4>, 4, 4, 64, 256, 4096 };
+        }
+
+        // packing buffers of the calling thread, they only grow
+        template<typename T>
+        T* gemm_buffer(const size_t which, const size_t n)
+        {
+          static thread_local MatStorage<T> buf[2];
+          if (buf[which].size() < n)
+            buf[which].resize(n, uninit);
+          return buf[which].data();
+        }
+
+        // op(A)(0:ib, 0:kc) into one micro-panel of mr rows, zero padded
+        template<typename T>
+        void pack_a(const bool ta, const size_t ib, const size_t kc, const T* A, const size_t lda,
+          T* ap, const size_t mr)
+        {
+          if (!ta) {
+            for (size_t p = 0; p < kc; ++p, ap += mr)
+            {
+              const T* a = A + p * lda;
+              size_t i = 0;
+              for (; i < ib; ++i)
+                ap[i] = a[i];
+              for (; i < mr; ++i)
+                ap[i] = T{ 0 };
+            }
+            return;
+          }
+          for (size_t i = 0; i < ib; ++i)
+          {
+            const T* a = A + i * lda;
+            for (size_t p = 0; p < kc; ++p)
+              ap[p * mr + i] = a[p];
+          }
+          for (size_t i = ib; i < mr; ++i)
+            for (size_t p = 0; p < kc; ++p)
+              ap[p * mr + i] = T{ 0 };
+        }
+
+        // op(B)(0:kc, 0:jb) into one micro-panel of nr columns, zero padded
+        template<typename T>
+        void pack_b(const bool tb, const size_t kc, const size_t jb, const T* B, const size_t ldb,
+          T* bp, const size_t nr)
+        {
+          if (tb) {
+            for (size_t p = 0; p < kc; ++p, bp += nr)
+            {
+              const T* b = B + p * ldb;
+              size_t j = 0;
+              for (; j < jb; ++j)
+                bp[j] = b[j];
+              for (; j < nr; ++j)
+                bp[j] = T{ 0 };
+            }
+            return;
+          }
+          for (size_t j = 0; j < jb; ++j)
+          {
+            const T* b = B + j * ldb;
+            for (size_t p = 0; p < kc; ++p)
+              bp[p * nr + j] = b[p];
+          }
+          for (size_t j = jb; j < nr; ++j)
+            for (size_t p = 0; p < kc; ++p)
+              bp[p * nr + j] = T{ 0 };
+        }
+
+        // C = beta*C, beta == 0 does not read C
+        template<typename T>
+        void scale(const size_t m, const size_t n, const T beta, T* C, const size_t ldc)
+        {
+          if (beta == T{ 1 })
+            return;
+          for (size_t j = 0; j < n; ++j)
+          {
+            if (beta == T{ 0 })
+              std::fill(C + j * ldc, C + j * ldc + m, T{ 0 });
+            else
+              simd::scal(m, beta, C + j * ldc);
+          }
+        }
+
+        // unpacked gemm for small, vector shaped and thin products. The long
+        // side (m of op(A), k of a transposed A) is taken in strips of
+        // gemm_strip rows, so the columns of one strip stay in L1 while all
+        // of their products are formed; the row strips of C run in parallel
+        template<typename T>
+        void gemm_small(const bool ta, const bool tb, const size_t m, const size_t n, const size_t k,
+          const T alpha, const T* A, const size_t lda, const T* B, const size_t ldb,
+          const T beta, T* C, const size_t ldc, const bool par = false)
+        {
+          if (!ta) {
+            const long long ns = static_cast<long long>((m + gemm_strip - 1) / gemm_strip);
+#pragma omp parallel for if(par && ns > 1) schedule(static)
+            for (long long s = 0; s < ns; ++s)
+            {
+              const size_t r0 = static_cast<size_t>(s) * gemm_strip, mr = std::min(gemm_strip, m - r0);
+              for (size_t j = 0; j < n; ++j)
+              {
+                T* cj = C + j * ldc + r0;
+                scale(mr, 1, beta, cj, ldc);
+                for (size_t p = 0; p < k; ++p)
+                  simd::axpy(mr, alpha * (tb ? B[p * ldb + j] : B[j * ldb + p]), A + p * lda + r0, cj);
+              }
+            }
+            return;
+          }
+          scale(m, n, beta, C, ldc);
+          for (size_t p0 = 0; p0 < k; p0 += gemm_strip)
+          {
+            const size_t kr = std::min(gemm_strip, k - p0);
+            for (size_t j = 0; j < n; ++j)
+            {
+              T* cj = C + j * ldc;
+              for (size_t i = 0; i < m; ++i)
+              {
+                const T* ai = A + i * lda + p0;
+                T s{ 0 };
+                if (!tb)
+                  s = simd::dot(kr, ai, B + j * ldb + p0);
+                else
+                  for (size_t p = 0; p < kr; ++p)
+                    s += ai[p] * B[(p0 + p) * ldb + j];
+                cj[i] += alpha * s;
+              }
+            }
+          }
+        }
+
+        // rows [r0, r1) of m for the calling thread of a team
+        inline void thread_rows(const size_t m, size_t& r0, size_t& r1)
+        {
+          const size_t nt = static_cast<size_t>(omp_get_num_threads());
+          const size_t t = static_cast<size_t>(omp_get_thread_num());
+          r0 = m * t / nt;
+          r1 = m * (t + 1) / nt;
+        }
+
+      } // namespace detail
+
+
+      // micro-kernel and blocking of the active instruction set
+      template<typename T>
+      gemm_kernel<T> gemm_kernel_for(const simd::isa level)
+      {
+        return detail::gemm_kernel_for<T>(level, std::integral_constant<bool,
+          std::is_same<T, float>::value || std::is_same<T, double>::value>());
+      }
+
+
+      // C = alpha*op(A)*op(B) + beta*C, op(A) is m x k and op(B) k x n
+      template<typename T>
+      void gemm(const bool ta, const bool tb, const size_t m, const size_t n, const size_t k,
+        const T alpha, const T* A, const size_t lda, const T* B, const size_t ldb,
+        const T beta, T* C, const size_t ldc)
+      {
+        if (m == 0 || n == 0)
+          return;
+        if (k == 0 || alpha == T{ 0 }) {
+          detail::scale(m, n, beta, C, ldc);
+          return;
+        }
+        const bool par = omp_get_max_threads() > 1 && !omp_in_parallel()
+          && static_cast<double>(m) * n * k >= gemm_par_min;
+        // thin products (the panels of a narrow QR: V'*C of a few columns,
+        // C - V*W) fill a fraction of one register block, packing costs more
+        // than the unpacked strips
+        const bool thin = ta ? !tb && m * n <= gemm_thin : n * k <= gemm_thin;
+        if (m == 1 || n == 1 || m * n * k < gemm_small || thin) {
+          detail::gemm_small(ta, tb, m, n, k, alpha, A, lda, B, ldb, beta, C, ldc, par);
+          return;
+        }
+
+        const gemm_kernel<T> g = gemm_kernel_for<T>(simd::current_isa());
+        const size_t kcb = std::min(k, g.kc);
+        T* bp = detail::gemm_buffer<T>(0, (std::min(n, g.nc) + g.nr - 1) / g.nr * g.nr * kcb);
+        T* ap = detail::gemm_buffer<T>(1, (std::min(m, g.mc) + g.mr - 1) / g.mr * g.mr * kcb);
+
+#pragma omp parallel if(par)
+        for (size_t jc = 0; jc < n; jc += g.nc)
+        {
+          const size_t nc = std::min(g.nc, n - jc);
+          const long long npan = static_cast<long long>((nc + g.nr - 1) / g.nr);
+          for (size_t pc = 0; pc < k; pc += g.kc)
+          {
+            const size_t kc = std::min(g.kc, k - pc);
+            const T bt = pc == 0 ? beta : T{ 1 };
+
+#pragma omp for schedule(static)
+            for (long long jp = 0; jp < npan; ++jp)
+            {
+              const size_t j = jc + jp * g.nr;
+              const T* b = tb ? B + pc * ldb + j : B + j * ldb + pc;
+              detail::pack_b(tb, kc, std::min(g.nr, n - j), b, ldb, bp + jp * g.nr * kc, g.nr);
+            }
+
+            for (size_t ic = 0; ic < m; ic += g.mc)
+            {
+              const size_t mc = std::min(g.mc, m - ic);
+              const long long mpan = static_cast<long long>((mc + g.mr - 1) / g.mr);
+
+#pragma omp for schedule(static)
+              for (long long ip = 0; ip < mpan; ++ip)
+              {
+                const size_t i = ic + ip * g.mr;
+                const T* a = ta ? A + i * lda + pc : A + pc * lda + i;
+                detail::pack_a(ta, std::min(g.mr, m - i), kc, a, lda, ap + ip * g.mr * kc, g.mr);
+              }
+
+#pragma omp for collapse(2) schedule(static)
+              for (long long jp = 0; jp < npan; ++jp)
+                for (long long ip = 0; ip < mpan; ++ip)
+                {
+                  const size_t j = jp * g.nr;
+                  const size_t i = ip * g.mr;
+                  g.micro(kc, ap + ip * g.mr * kc, bp + jp * g.nr * kc,
+                    C + (jc + j) * ldc + ic + i, ldc,
+                    std::min(g.mr, mc - i), std::min(g.nr, nc - j), alpha, bt);
+                }
+            }
+          }
+        }
+      }
+
+
+      // y = alpha*op(A)*x + beta*y, A is m x n
+      template<typename T>
+      void gemv(const bool ta, const size_t m, const size_t n, const T alpha,
+        const T* A, const size_t lda, const T* x, const size_t incx,
+        const T beta, T* y, const size_t incy)
+      {
+        const bool par = omp_get_max_threads() > 1 && !omp_in_parallel() && m * n >= gemv_par_min;
+        if (ta) {
+#pragma omp parallel for if(par) schedule(static)
+          for (long long j = 0; j < static_cast<long long>(n); ++j)
+          {
+            const T* aj = A + j * lda;
+            T s{ 0 };
+            if (incx == 1)
+              s = simd::dot(m, aj, x);
+            else
+              for (size_t i = 0; i < m; ++i)
+                s += aj[i] * x[i * incx];
+            T& yj = y[j * incy];
+            yj = beta == T{ 0 } ? alpha * s : alpha * s + beta * yj;
+          }
+          return;
+        }
+
+        if (incy != 1) {
+          for (size_t i = 0; i < m; ++i)
+            y[i * incy] = beta == T{ 0 } ? T{ 0 } : beta * y[i * incy];
+          for (size_t j = 0; j < n; ++j)
+          {
+            const T s = alpha * x[j * incx];
+            for (size_t i = 0; i < m; ++i)
+              y[i * incy] += s * A[j * lda + i];
+          }
+          return;
+        }
+
+        // the rows of y are split between the threads
+#pragma omp parallel if(par)
+        {
+          size_t r0, r1;
+          detail::thread_rows(m, r0, r1);
+          detail::scale(r1 - r0, 1, beta, y + r0, m);
+          for (size_t j = 0; j < n; ++j)
+            simd::axpy(r1 - r0, alpha * x[j * incx], A + j * lda + r0, y + r0);
+        }
+      }
+
+
+      // A = alpha*x*y' + A, A is m x n
+      template<typename T>
+      void ger(const size_t m, const size_t n, const T alpha, const T* x, const size_t incx,
+        const T* y, const size_t incy, T* A, const size_t lda)
+      {
+        const bool par = omp_get_max_threads() > 1 && !omp_in_parallel() && m * n >= gemv_par_min;
+#pragma omp parallel for if(par) schedule(static)
+        for (long long j = 0; j < static_cast<long long>(n); ++j)
+        {
+          const T s = alpha * y[j * incy];
+          T* aj = A + j * lda;
+          if (incx == 1)
+            simd::axpy(m, s, x, aj);
+          else
+            for (size_t i = 0; i < m; ++i)
+              aj[i] += s * x[i * incx];
+        }
+      }
+
+    } // namespace native
+  } // namespace blas
+} // namespace igm
+
+#endif // _MATRIX_GEMM_H__
@@ -0,0 +1,69 @@
+// Register blocked gemm micro-kernel of matrix_gemm.h. Like
+// matrix_simd_kernels.h this file is included once per instruction set
+// inside its namespace and target region, V is the register type of
+// matrix_simd.h; no include guard on purpose.
+
+// C(0:mr, 0:nr) = alpha*Ap*Bp + beta*C, Ap is a packed MR x kc micro-panel
+// (MR = MV*w elements per k) and Bp a packed kc x NR micro-panel (NR
+// elements per k). The MR x NR block of C is held in MV*NR registers;
+// edge blocks (mr < MR or nr < NR) go through a buffer. beta == 0 does not
+// read C.
+template<typename V, size_t MV, size_t NR>
+void gemm_micro(const size_t kc, const typename V::T* a, const typename V::T* b,
+  typename V::T* c, const size_t ldc, const size_t mr, const size_t nr,
+  const typename V::T alpha, const typename V::T beta)
+{
+  using T = typename V::T;
+  using R = typename V::R;
+  const size_t w = V::w;
+  const size_t MR = MV * V::w;
+
+  R acc[NR][MV];
+  for (size_t j = 0; j < NR; ++j)
+    for (size_t i = 0; i < MV; ++i)
+      acc[j][i] = V::zero();
+
+  for (size_t p = 0; p < kc; ++p)
+  {
+    R av[MV];
+    for (size_t i = 0; i < MV; ++i)
+      av[i] = V::load(a + i * w);
+    for (size_t j = 0; j < NR; ++j)
+    {
+      const R bj = V::set1(b[j]);
+      for (size_t i = 0; i < MV; ++i)
+        acc[j][i] = V::fmadd(av[i], bj, acc[j][i]);
+    }
+    a += MR;
+    b += NR;
+  }
+
+  const R va = V::set1(alpha);
+  if (mr == MR && nr == NR) {
+    const R vb = V::set1(beta);
+    for (size_t j = 0; j < NR; ++j)
+      for (size_t i = 0; i < MV; ++i)
+      {
+        T* cij = c + j * ldc + i * w;
+        const R r = V::mul(va, acc[j][i]);
+        V::store(cij, beta == T{ 0 } ? r : V::fmadd(vb, V::load(cij), r));
+      }
+    return;
+  }
+
+  alignas(64) T t[MR * NR];
+  for (size_t j = 0; j < NR; ++j)
+    for (size_t i = 0; i < MV; ++i)
+      V::store(t + j * MR + i * w, V::mul(va, acc[j][i]));
+  for (size_t j = 0; j < nr; ++j)
+  {
+    T* cj = c + j * ldc;
+    const T* tj = t + j * MR;
+    if (beta == T{ 0 })
+      for (size_t i = 0; i < mr; ++i)
+        cj[i] = tj[i];
+    else
+      for (size_t i = 0; i < mr; ++i)
+        cj[i] = beta * cj[i] + tj[i];
+  }
+}
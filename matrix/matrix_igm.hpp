@@ -4,8 +4,14 @@
 #include <array>
 #include <valarray>
 #include <cassert>
+#include <stdexcept>
+#include <iostream>
 #include <numeric>
+#include <utility>
 #include <omp.h>
+#include "matrix_storage.hpp"
+#include "matrix_simd.h"
+#include "matrix_prof.h"
 
 
 namespace igm
@@ -24,18 +30,18 @@ namespace igm
   }
   
   template<size_t N, typename I, typename List>
-  Enable_if<(N>1), void> add_extents(I& first, const List& list)
+  Enable_if<(N == 1), void> add_extents(I& first, const List& list)
   {
-    assert(check_non_jagged(list));
-    *first = list.size();
-    add_extents<N - 1>(++first, *list.begin());
+    *(first++) = list.size(); // we reached the deepest nesting
   }
 
 
   template<size_t N, typename I, typename List>
-  Enable_if<(N == 1), void> add_extents(I& first, const List& list)
+  Enable_if<(N>1), void> add_extents(I& first, const List& list)
   {
-    *(first++) = list.size(); // we reached the deepest nesting
+    assert(check_non_jagged(list));
+    *first = list.size();
+    add_extents<N - 1>(++first, *list.begin());
   }
 
 
@@ -48,95 +54,418 @@ namespace igm
     return a;
   }
 
+  template<typename T, typename Alloc = aligned_allocator<T>>
+  class Mat;
+
+
+  // Expression templates: element-wise expressions of matrices and views are
+  // kept as a tree of lightweight nodes and evaluated column by column in a
+  // single loop straight into the destination, no temporaries are created.
+  // Every node has rows(), cols() and ecol(j) returning an object indexable
+  // by the row within column j, and dense() telling whether all its columns
+  // follow each other in memory (ecol(0) then indexes all rows*cols).
+  template<typename E>
+  struct MatExpr {
+    const E& self() const { return static_cast<const E&>(*this); }
+  };
+
+  // leaves are held by reference, inner nodes by value
+  template<typename E>
+  struct expr_ref { using type = const E; };
+
+  template<typename T, typename Alloc>
+  struct expr_ref<Mat<T, Alloc>> { using type = const Mat<T, Alloc>&; };
+
+  struct add_op { template<typename T> static constexpr T apply(const T a, const T b) { return a + b; } };
+  struct sub_op { template<typename T> static constexpr T apply(const T a, const T b) { return a - b; } };
+  struct mul_op { template<typename T> static constexpr T apply(const T a, const T b) { return a * b; } };
+  struct div_op { template<typename T> static constexpr T apply(const T a, const T b) { return a / b; } };
+  struct mod_op { template<typename T> static constexpr T apply(const T a, const T b) { return a % b; } };
+
+
+  template<typename Op, typename L, typename R>
+  class MatBinExpr : public MatExpr<MatBinExpr<Op, L, R>> {
+  public:
+    using val_type = typename L::val_type;
+
+    MatBinExpr(const L& l, const R& r) : _l(l), _r(r)
+    {
+      if (l.rows() != r.rows() || l.cols() != r.cols())
+        throw std::runtime_error("Invalid dimensions in matrix expression");
+    }
+
+    struct column {
+      decltype(std::declval<L>().ecol(0)) l;
+      decltype(std::declval<R>().ecol(0)) r;
+      val_type operator[](const size_t i) const { return Op::apply(l[i], r[i]); }
+    };
+
+    size_t rows() const { return _l.rows(); }
+    size_t cols() const { return _l.cols(); }
+    bool dense() const { return _l.dense() && _r.dense(); }
+    column ecol(const size_t j) const { return column{ _l.ecol(j), _r.ecol(j) }; }
+
+  private:
+    typename expr_ref<L>::type _l;
+    typename expr_ref<R>::type _r;
+  };
+
+
+  template<typename Op, typename L>
+  class MatScalarExpr : public MatExpr<MatScalarExpr<Op, L>> {
+  public:
+    using val_type = typename L::val_type;
+
+    MatScalarExpr(const L& l, const val_type s) : _l(l), _s(s) {}
+
+    struct column {
+      decltype(std::declval<L>().ecol(0)) l;
+      val_type s;
+      val_type operator[](const size_t i) const { return Op::apply(l[i], s); }
+    };
+
+    size_t rows() const { return _l.rows(); }
+    size_t cols() const { return _l.cols(); }
+    bool dense() const { return _l.dense(); }
+    column ecol(const size_t j) const { return column{ _l.ecol(j), _s }; }
+
+  private:
+    typename expr_ref<L>::type _l;
+    val_type _s;
+  };
+
+
+  template<typename L, typename R>
+  MatBinExpr<add_op, L, R> operator+(const MatExpr<L>& l, const MatExpr<R>& r)
+  { return MatBinExpr<add_op, L, R>(l.self(), r.self()); }
+
+  template<typename L, typename R>
+  MatBinExpr<sub_op, L, R> operator-(const MatExpr<L>& l, const MatExpr<R>& r)
+  { return MatBinExpr<sub_op, L, R>(l.self(), r.self()); }
+
+  template<typename L, typename R>
+  MatBinExpr<mul_op, L, R> operator*(const MatExpr<L>& l, const MatExpr<R>& r)
+  { return MatBinExpr<mul_op, L, R>(l.self(), r.self()); }
+
+  template<typename L, typename R>
+  MatBinExpr<div_op, L, R> operator/(const MatExpr<L>& l, const MatExpr<R>& r)
+  { return MatBinExpr<div_op, L, R>(l.self(), r.self()); }
+
+  template<typename L, typename R>
+  MatBinExpr<mod_op, L, R> operator%(const MatExpr<L>& l, const MatExpr<R>& r)
+  { return MatBinExpr<mod_op, L, R>(l.self(), r.self()); }
+
+  template<typename L>
+  MatScalarExpr<add_op, L> operator+(const MatExpr<L>& l, const typename L::val_type s)
+  { return MatScalarExpr<add_op, L>(l.self(), s); }
+
+  template<typename L>
+  MatScalarExpr<sub_op, L> operator-(const MatExpr<L>& l, const typename L::val_type s)
+  { return MatScalarExpr<sub_op, L>(l.self(), s); }
+
+  template<typename L>
+  MatScalarExpr<mul_op, L> operator*(const MatExpr<L>& l, const typename L::val_type s)
+  { return MatScalarExpr<mul_op, L>(l.self(), s); }
+
+  template<typename L>
+  MatScalarExpr<div_op, L> operator/(const MatExpr<L>& l, const typename L::val_type s)
+  { return MatScalarExpr<div_op, L>(l.self(), s); }
+
+  template<typename L>
+  MatScalarExpr<mod_op, L> operator%(const MatExpr<L>& l, const typename L::val_type s)
+  { return MatScalarExpr<mod_op, L>(l.self(), s); }
+
+
+  // a block of nc columns of nr elements, ld apart, is one contiguous run
+  // when it covers whole columns
+  inline bool dense_block(const size_t nr, const size_t nc, const size_t ld)
+  {
+    return nr == ld || nc <= 1;
+  }
+
+  // evaluates the expression e column by column into the nr x nc block at d;
+  // a block and an expression covering whole columns run as one loop
+  template<typename T, typename E, typename Op>
+  void eval_cols(T* d, const size_t ld, const size_t nr, const size_t nc, const E& e, Op)
+  {
+    if (e.rows() != nr || e.cols() != nc)
+      throw std::runtime_error("Invalid dimensions in matrix expression");
+    if (nr == 0 || nc == 0)
+      return;
+    if (dense_block(nr, nc, ld) && e.dense()) {
+      const auto c = e.ecol(0);
+      const size_t n = nr * nc;
+      for (size_t i = 0; i < n; ++i)
+        d[i] = Op::apply(d[i], c[i]);
+      return;
+    }
+    for (size_t j = 0; j < nc; ++j, d += ld)
+    {
+      const auto c = e.ecol(j);
+      for (size_t i = 0; i < nr; ++i)
+        d[i] = Op::apply(d[i], c[i]);
+    }
+  }
+
+  // d(i, j) = Op(d(i, j), s) over the nr x nc block at d
+  template<typename T, typename Op>
+  void eval_block(T* d, const size_t ld, const size_t nr, const size_t nc, const T s, Op)
+  {
+    if (dense_block(nr, nc, ld)) {
+      const size_t n = nr * nc;
+      for (size_t i = 0; i < n; ++i)
+        d[i] = Op::apply(d[i], s);
+      return;
+    }
+    for (size_t j = 0; j < nc; ++j, d += ld)
+    {
+      for (size_t i = 0; i < nr; ++i)
+        d[i] = Op::apply(d[i], s);
+    }
+  }
+
+  // copies the nr x nc block at s into the one at d
+  template<typename T>
+  void copy_block(T* d, const size_t ldd, const T* s, const size_t lds, const size_t nr, const size_t nc)
+  {
+    if (dense_block(nr, nc, ldd) && dense_block(nr, nc, lds)) {
+      std::copy(s, s + nr * nc, d);
+      return;
+    }
+    for (size_t j = 0; j < nc; ++j, d += ldd, s += lds)
+      std::copy(s, s + nr, d);
+  }
+
+  template<typename T>
+  struct assign_op { static T apply(const T&, const T b) { return b; } };
+
+  // keeps a function parameter out of template argument deduction, so a
+  // MatView<T> argument converts to a ConstMatView<T> parameter
+  template<typename T>
+  struct Identity { using type = T; };
+  template<typename T>
+  using Nondeduced = typename Identity<T>::type;
+
+
+  // Non-owning column major view: pointer, rows, cols and leading dimension.
+  // A view is a plain value, any number of threads can create views of the
+  // same matrix concurrently without modifying the matrix.
+  // Indexing follows Mat: (r, c), and (i) for the i-th column of a row vector.
   template<typename T>
-  class Mat {
+  class MatView : public MatExpr<MatView<T>> {
   public:
-    using vec_type = std::valarray<T>;
+    using val_type = T;
+    MatView() = default;
+    MatView(T* p, const size_t rows, const size_t cols, const size_t ld)
+      : _p{ p }, _nr{ rows }, _nc{ cols }, _ld{ ld } {}
+
+    size_t rows() const { return _nr; }
+    size_t cols() const { return _nc; }
+    size_t lda() const { return _ld; }
+    bool empty() const { return _nr == 0 || _nc == 0; }
+    bool dense() const { return dense_block(_nr, _nc, _ld); }
+
+    T* data() const { return _p; }
+    T* begincol(const size_t col) const { return _p + _ld*col; }
+    T* endcol(const size_t col) const { return _p + _ld*col + _nr; }
+    T& operator()(const size_t r, const size_t c) const { return _p[_ld*c + r]; }
+    T& operator()(const size_t idx) const { return _p[_ld*idx]; }
+    const T* ecol(const size_t j) const { return begincol(j); }
+
+    // inclusive bounds relative to this view, as Mat::sub
+    MatView sub(const size_t rFirst, const size_t rLast, const size_t cFirst, const size_t cLast) const
+    { return MatView(_p + _ld*cFirst + rFirst, rLast - rFirst + 1, cLast - cFirst + 1, _ld); }
+    MatView subcols(const size_t first, const size_t last) const { return sub(0, _nr - 1, first, last); }
+    MatView col(const size_t c) const { return MatView(begincol(c), _nr, 1, _ld); }
+    MatView row(const size_t r) const { return MatView(_p + r, 1, _nc, _ld); }
+
+    // writes the element-wise expression into the viewed elements
+    template<typename E>
+    void assign(const MatExpr<E>& e) const { eval_cols(_p, _ld, _nr, _nc, e.self(), assign_op<T>()); }
+    void fill(const T val) const { eval_block(_p, _ld, _nr, _nc, val, assign_op<T>()); }
+    void zeros() const { fill(T{ 0 }); }
+
+  private:
+    T* _p = nullptr;
+    size_t _nr = 0;
+    size_t _nc = 0;
+    size_t _ld = 0;
+  };
+
+
+  template<typename T>
+  class ConstMatView : public MatExpr<ConstMatView<T>> {
+  public:
+    using val_type = T;
+    ConstMatView() = default;
+    ConstMatView(const T* p, const size_t rows, const size_t cols, const size_t ld)
+      : _p{ p }, _nr{ rows }, _nc{ cols }, _ld{ ld } {}
+    ConstMatView(const MatView<T>& v) : ConstMatView(v.data(), v.rows(), v.cols(), v.lda()) {}
+
+    size_t rows() const { return _nr; }
+    size_t cols() const { return _nc; }
+    size_t lda() const { return _ld; }
+    bool empty() const { return _nr == 0 || _nc == 0; }
+    bool dense() const { return dense_block(_nr, _nc, _ld); }
+
+    const T* data() const { return _p; }
+    const T* begincol(const size_t col) const { return _p + _ld*col; }
+    const T* endcol(const size_t col) const { return _p + _ld*col + _nr; }
+    const T& operator()(const size_t r, const size_t c) const { return _p[_ld*c + r]; }
+    const T& operator()(const size_t idx) const { return _p[_ld*idx]; }
+    const T* ecol(const size_t j) const { return begincol(j); }
+
+    ConstMatView sub(const size_t rFirst, const size_t rLast, const size_t cFirst, const size_t cLast) const
+    { return ConstMatView(_p + _ld*cFirst + rFirst, rLast - rFirst + 1, cLast - cFirst + 1, _ld); }
+    ConstMatView subcols(const size_t first, const size_t last) const { return sub(0, _nr - 1, first, last); }
+    ConstMatView col(const size_t c) const { return ConstMatView(begincol(c), _nr, 1, _ld); }
+    ConstMatView row(const size_t r) const { return ConstMatView(_p + r, 1, _nc, _ld); }
+
+  private:
+    const T* _p = nullptr;
+    size_t _nr = 0;
+    size_t _nc = 0;
+    size_t _ld = 0;
+  };
+
+  // length and stride of a row (1 x n) or column (n x 1) vector view
+  template<typename V>
+  size_t vec_len(const V& v) { return v.rows() == 1 ? v.cols() : v.rows(); }
+  template<typename V>
+  size_t vec_inc(const V& v) { return v.rows() == 1 ? v.lda() : 1; }
+
+
+  // Column major matrix. The data live in a 64-byte aligned MatStorage
+  // buffer; the allocator is a policy, the default one is used by all kernels.
+  // Column j starts on an aligned address when rows*sizeof(T) is a multiple
+  // of mat_align.
+  // The current view (sub) is the offset of its first element and its
+  // rows and cols, lda() apart; slc() and sub(gslice) translate from and to
+  // the equivalent std::gslice.
+  template<typename T, typename Alloc>
+  class Mat : public MatExpr<Mat<T, Alloc>> {
+  public:
+    using vec_type = MatStorage<T, Alloc>;
     using val_type = T;
     using idx_type = size_t;
-    Mat() : Mat(0, 0) {}
-    Mat(const Mat& M) : Mat(M._rows, M._cols) {
-      _data = M._data;
-      _slc = M._slc;
-    }
+    using alloc_type = Alloc;
+    Mat() : _nr{ 0 }, _nc{ 0 } {}
+    Mat(const Mat& M) : _rows{ M._rows }, _cols{ M._cols }, _data(M._data), _off{ M._off },
+      _nr{ M._nr }, _nc{ M._nc } {}
+    // the source is left an empty 0 x 0 matrix
+    Mat(Mat&& M) noexcept : _rows{ M._rows }, _cols{ M._cols }, _data(std::move(M._data)),
+      _off{ M._off }, _nr{ M._nr }, _nc{ M._nc } { M.clear(); }
     Mat(const size_t rows, const size_t cols, const T init = 0) : _rows{ rows }, _cols{ cols },
-      _data(init, rows*cols), _slc{ 0,{ rows, cols },{ rows, 1 } },
-      _nc{ _slc.size()[1] }, _nr{ _slc.size()[0] } {} // column major matrix
+      _data(rows*cols, init), _off{ 0 },
+      _nr{ rows }, _nc{ cols } {} // column major matrix
+    // elements are left uninitialized, for outputs which are overwritten anyway
+    Mat(const size_t rows, const size_t cols, uninit_t) : _rows{ rows }, _cols{ cols },
+      _data(rows*cols, uninit), _off{ 0 },
+      _nr{ rows }, _nc{ cols } {}
 
     void resize(const size_t rows, const size_t cols, const T init = 0)
     {
-      _rows = rows;
-      _cols = cols;
       _data.resize(rows*cols, init);
-      _slc = std::gslice{ 0, { rows, cols },{ rows, 1 } };
-      _nc = _slc.size()[1];
-      _nr = _slc.size()[0];
+      reshape(rows, cols);
+    }
+    void resize(const size_t rows, const size_t cols, uninit_t)
+    {
+      _data.resize(rows*cols, uninit);
+      reshape(rows, cols);
     }
     Mat(std::initializer_list<std::initializer_list<T>> list);
 
     Mat& operator=(std::initializer_list<T>) = delete;
-    Mat operator+(const Mat& A);
-    void operator+=(const Mat& A);
-    Mat operator-(const Mat& A);
-    void operator-=(const Mat& A);
-    Mat operator/(const Mat& A);
-    void operator/=(const Mat& A);
-    Mat operator*(const Mat& A);
-    void operator*=(const Mat& A);
-    Mat operator%(const Mat& A);
-    void operator%=(const Mat& A);
-
-    Mat operator+(const T s);
-    void operator+=(T s) { _data += s; }
-    Mat operator-(const T s);
-    void operator-=(T s) { _data -= s; }
-    Mat operator/(const T s);
-    void operator/=(T s) { _data /= s; }
-    Mat operator*(const T s);
-    void operator*=(T s) { _data *= s; }
-    Mat operator%(const T s);
-    void operator%=(T s) { _data %= s; }
+    Mat& operator=(const Mat& M) = default;
+    Mat& operator=(Mat&& M) noexcept
+    {
+      if (this != &M) {
+        _rows = M._rows;
+        _cols = M._cols;
+        _data = std::move(M._data);
+        _off = M._off;
+        _nr = M._nr;
+        _nc = M._nc;
+        M.clear();
+      }
+      return *this;
+    }
+
+    void operator+=(T s) { eval_scalar(s, add_op()); }
+    void operator-=(T s) { eval_scalar(s, sub_op()); }
+    void operator/=(T s) { eval_scalar(s, div_op()); }
+    void operator*=(T s) { eval_scalar(s, mul_op()); }
+    void operator%=(T s) { eval_scalar(s, mod_op()); }
+
+    // element-wise expressions, evaluated into this matrix or its view
+    template<typename E>
+    Mat(const MatExpr<E>& e) : Mat(e.self().rows(), e.self().cols(), uninit) { eval(e.self(), AssignOp()); }
+    template<typename E>
+    Mat& operator=(const MatExpr<E>& e);
+    template<typename E>
+    void operator+=(const MatExpr<E>& e) { eval(e.self(), add_op()); }
+    template<typename E>
+    void operator-=(const MatExpr<E>& e) { eval(e.self(), sub_op()); }
+    template<typename E>
+    void operator*=(const MatExpr<E>& e) { eval(e.self(), mul_op()); }
+    template<typename E>
+    void operator/=(const MatExpr<E>& e) { eval(e.self(), div_op()); }
+    template<typename E>
+    void operator%=(const MatExpr<E>& e) { eval(e.self(), mod_op()); }
+    const T* ecol(const size_t j) const { return begincol(j); }
+
+    // non-owning views of the current view, or of an absolute block as sub()
+    MatView<T> view() { return MatView<T>(begincol(0), rows(), cols(), lda()); }
+    ConstMatView<T> view() const { return ConstMatView<T>(begincol(0), rows(), cols(), lda()); }
+    MatView<T> view(const size_t rFirst, const size_t rLast, const size_t cFirst, const size_t cLast)
+    { return MatView<T>(_data.begin() + lda()*cFirst + rFirst, rLast - rFirst + 1, cLast - cFirst + 1, lda()); }
+    ConstMatView<T> view(const size_t rFirst, const size_t rLast, const size_t cFirst, const size_t cLast) const
+    { return ConstMatView<T>(_data.begin() + lda()*cFirst + rFirst, rLast - rFirst + 1, cLast - cFirst + 1, lda()); }
+    operator MatView<T>() { return view(); }
+    operator ConstMatView<T>() const { return view(); }
 
     vec_type& v() { return _data; }
-    T* M() { return &_data[0]; }
+    T* M() { return _data.data(); }
     T* M(size_t r, size_t c) {
-      return &_data[_slc.start() + lda()*c + r];
+      return &_data[_off + lda()*c + r];
     }
-    T* begin() { return std::begin(_data); }
-    const T* begin() const { return std::begin(_data); }
-    T* end() { return std::end(_data); }
-    const T* end() const { return std::end(_data); }
-    T* begincol(const size_t col) { return std::begin(_data) + (_slc.start() + lda()*col); }
-    const T* begincol(const size_t col) const { return std::begin(_data) + (_slc.start() + lda()*col); }
-    T* endcol(const size_t col) { return std::begin(_data) + (_slc.start() + lda()*col + rows()); }
-    const T* endcol(const size_t col) const { return std::begin(_data) + (_slc.start() + lda()*col + rows()); }
-
-    size_t rows() { return _slc.size()[0]; }
-    size_t cols() { return _slc.size()[1]; }
-    const size_t rows() const { return _slc.size()[0]; }
-    const size_t cols() const { return _slc.size()[1]; }
+    T* begin() { return _data.begin(); }
+    const T* begin() const { return _data.begin(); }
+    T* end() { return _data.end(); }
+    const T* end() const { return _data.end(); }
+    T* begincol(const size_t col) { return _data.begin() + (_off + lda()*col); }
+    const T* begincol(const size_t col) const { return _data.begin() + (_off + lda()*col); }
+    T* endcol(const size_t col) { return _data.begin() + (_off + lda()*col + rows()); }
+    const T* endcol(const size_t col) const { return _data.begin() + (_off + lda()*col + rows()); }
+
+    // _nr, _nc are the extents of the view
+    size_t rows() { return _nr; }
+    size_t cols() { return _nc; }
+    const size_t rows() const { return _nr; }
+    const size_t cols() const { return _nc; }
 
     size_t size() { return _rows*_cols; }
     const size_t size() const { return _rows*_cols; }
     size_t lda() { return _rows; }
     const size_t lda() const { return _rows; }
+    bool dense() const { return dense_block(_nr, _nc, _rows); }
 
     bool issub() {
-      return _slc != std::gslice{ 0,{ _rows, _cols },{ _rows, 1 } };
+      return _off != 0 || _nr != _rows || _nc != _cols;
     }
     void subreset() 
-    { _slc = { 0,{ _rows, _cols },{ _rows, 1 } }; 
+    { _off = 0; 
       _nc = _cols; _nr = _rows; }
-    std::gslice slc() { return _slc; }
-    const std::gslice slc() const { return _slc; }
-    void sub(std::gslice slc) { _slc = slc; }
-    Mat<T> sub(Mat<size_t>& idx);
+    std::gslice slc() const
+    { return std::gslice{ _off,{ _nr, _nc },{ 1, _rows } }; }
+    void sub(std::gslice slc);
+    Mat sub(Mat<size_t>& idx);
     void subcols(Mat& A, Mat<size_t>& idx);
     void sub(const size_t rFirst, const size_t rLast,
       const size_t cFirst, const size_t cLast);
     void subcols(const size_t first, const size_t last);
     void subcols(const size_t first);
-    Mat<T>& subcol(const size_t col);
+    Mat& subcol(const size_t col);
     void subrow(const size_t col);
 
     void swapcols(const size_t c1, const size_t c2);
@@ -145,48 +474,68 @@ namespace igm
 
 
     T max(size_t& idx);
-    void fill(const T val) { _data[_slc] = val; }
-    void zeros() { _data[_slc] = T{ 0 }; }
-    void iota(const T start) { std::iota(std::begin(_data), std::end(_data), start); }
+    void fill(const T val) { eval_scalar(val, AssignOp()); }
+    void zeros() { eval_scalar(T{ 0 }, AssignOp()); }
+    void iota(const T start) { std::iota(_data.begin(), _data.end(), start); }
     T& operator()(size_t r, size_t c) {
-      return _data[_slc.start() + lda()*c + r];
+      return _data[_off + lda()*c + r];
     }
     const T& operator()(size_t r, size_t c) const {
-      //std::cout << "*idx " << (_slc.start() + lda()*c + r) << " of " << _data.size() << "\n";
-      return _data[_slc.start() + lda()*c + r];
+      //std::cout << "*idx " << (_off + lda()*c + r) << " of " << _data.size() << "\n";
+      return _data[_off + lda()*c + r];
     }
     T& operator()(size_t idx) {
-      //std::cout << "*idx " << _slc.start() + lda()*idx << " of " << _data.size() << "\n";
-      return _data[_slc.start() + lda()*idx];
+      //std::cout << "*idx " << _off + lda()*idx << " of " << _data.size() << "\n";
+      return _data[_off + lda()*idx];
     }
     const T& operator()(size_t idx) const {
-      return _data[_slc.start() + lda()*idx];
+      return _data[_off + lda()*idx];
     }
 
     T at(const size_t idx) {
-      return _data[_slc.start() + idx];
+      return _data[_off + idx];
     }
     const T at(const size_t idx) const {
-      return _data[_slc.start() + idx];
+      return _data[_off + idx];
     }
 
     // misc algorithms
     void eye()
     {
       if (_nc != _nr)
-        throw std::exception("Invalid dimensions in eye!");
-      _data = 0;
-      _data[std::slice(0, _nr, _nc + 1)] = T{ 1 };
+        throw std::runtime_error("Invalid dimensions in eye!");
+      zeros();
+      for (size_t i = 0; i < _nr; ++i)
+        (*this)(i, i) = T{ 1 };
     }
 
     // output
     void print(const char* str);
 
   protected:
+    using AssignOp = assign_op<T>;
+    template<typename E, typename Op>
+    void eval(const E& e, Op);
+    template<typename Op>
+    void eval_scalar(const T s, Op);
+    void reshape(const size_t rows, const size_t cols)
+    {
+      _rows = rows;
+      _cols = cols;
+      _off = 0;
+      _nr = rows;
+      _nc = cols;
+    }
+    // state of a moved-from matrix, does not allocate
+    void clear() noexcept
+    {
+      _rows = _cols = _nr = _nc = _off = 0;
+    }
+
     size_t _rows = 0;
     size_t _cols = 0;
     vec_type _data;
-    std::gslice _slc;
+    size_t _off = 0;  // first element of the view
 
   public:
     size_t _nr;
@@ -207,14 +556,14 @@ namespace igm
     return os;
   }
 
-  template<typename T>
-  inline Mat<T>::Mat(std::initializer_list<std::initializer_list<T>> list)
+  template<typename T, typename Alloc>
+  inline Mat<T, Alloc>::Mat(std::initializer_list<std::initializer_list<T>> list)
   {
     auto ext = derive_extents<2>(list);
     _nr = _rows = ext[1];
     _nc = _cols = ext[0];
-    _slc = { 0,{ _rows, _cols },{ 1, _rows } };
-    _data.resize(_rows*_cols);
+    _off = 0;
+    _data.resize(_rows*_cols, uninit);
     for (size_t i = 0; i < _cols; ++i)
     {
       auto nl = list.begin() + i;
@@ -227,170 +576,367 @@ namespace igm
   }
 
 
-  template<typename T>
-  Mat<T> Mat<T>::operator+(const Mat & A)
+
+  template<typename T, typename Alloc>
+  template<typename E, typename Op>
+  void Mat<T, Alloc>::eval(const E& e, Op)
   {
-    Mat<T> B(A);
-    B._data[B._slc] += _data[_slc];
+    eval_cols(begincol(0), lda(), rows(), cols(), e, Op());
+  }
 
-    return B;
+
+  template<typename T, typename Alloc>
+  template<typename Op>
+  void Mat<T, Alloc>::eval_scalar(const T s, Op)
+  {
+    eval_block(begincol(0), lda(), rows(), cols(), s, Op());
   }
 
 
-  template<typename T>
-  void Mat<T>::operator+=(const Mat & A)
+  // a matrix of different shape is resized, a view must match the expression
+  template<typename T, typename Alloc>
+  template<typename E>
+  Mat<T, Alloc>& Mat<T, Alloc>::operator=(const MatExpr<E>& e)
   {
-    _data[_slc] += A._data[A._slc];
+    const E& x = e.self();
+    if ((x.rows() != rows() || x.cols() != cols()) && !issub())
+      resize(x.rows(), x.cols(), uninit);
+    eval(x, AssignOp());
+    return *this;
   }
 
 
-  template<typename T>
-  Mat<T> Mat<T>::operator-(const Mat & A)
+
+
+
+
+
+
+
+
+
+
+  template<typename T, typename Alloc>
+  void Mat<T, Alloc>::sub(const size_t rFirst, const size_t rLast, 
+    const size_t cFirst, const size_t cLast)
   {
-    Mat<T> B(A);
-    B._data[B._slc] -= _data[_slc];
+    auto rows = rLast - rFirst + 1;
+    auto cols = cLast - cFirst + 1;
+    _off = cFirst*lda() + rFirst;
+    _nc = cols;
+    _nr = rows;
+  }
 
-    return B;
+
+  // the slice must be a block of this matrix, rows then columns lda() apart
+  template<typename T, typename Alloc>
+  void Mat<T, Alloc>::sub(std::gslice slc)
+  {
+    const std::valarray<size_t> size = slc.size();
+    const std::valarray<size_t> stride = slc.stride();
+    if (size.size() != 2 || stride.size() != 2 || stride[0] != 1 || (size[1] > 1 && stride[1] != lda()))
+      throw std::runtime_error("Invalid slice in sub");
+    _off = slc.start();
+    _nr = size[0];
+    _nc = size[1];
   }
 
-  template<typename T>
-  void Mat<T>::operator-=(const Mat & A)
+
+
+  template<typename T, typename Alloc>
+  void Mat<T, Alloc>::subcols(const size_t first, const size_t last)
   {
-    _data[_slc] -= A._data[A._slc];
+    sub(0, _rows - 1, first, last);
   }
 
+  template<typename T, typename Alloc>
+  void Mat<T, Alloc>::subcols(const size_t first)
+  {
+    sub(0, _rows - 1, first, _cols - 1);
+  }
 
-  template<typename T>
-  Mat<T> Mat<T>::operator/(const Mat & A)
+  template<typename T, typename Alloc>
+  inline Mat<T, Alloc>& Mat<T, Alloc>::subcol(const size_t col)
   {
-    Mat<T> B(A);
-    B._data[B._slc] /= _data[_slc];
+    sub(0, _rows - 1, col, col);
+    return *this;
+  }
 
-    return B;
+  template<typename T, typename Alloc>
+  inline void Mat<T, Alloc>::subrow(const size_t row)
+  {
+    sub(row, row, 0, _cols - 1);
   }
 
-  template<typename T>
-  void Mat<T>::operator/=(const Mat & A)
+  template<typename T, typename Alloc>
+  void Mat<T, Alloc>::swapcols(const size_t c1, const size_t c2)
   {
-    _data[_slc] /= A._data[A._slc];
+    std::swap_ranges(begincol(c1), endcol(c1), begincol(c2));
   }
 
+  template<typename T, typename Alloc>
+  inline T Mat<T, Alloc>::max(size_t & idx)
+  {
+    T max = at(0);
+    idx = 0;
+    for (size_t i = 0; i < _nc; ++i)
+    {
+      if (at(i) > max) {
+        idx = i;
+        max = at(i);
+      }
+    }
+    return max;
+  }
 
-  template<typename T>
-  Mat<T> Mat<T>::operator%(const Mat & A)
+  template<typename T, typename Alloc>
+  void Mat<T, Alloc>::print(const char * str)
   {
-    Mat<T> B(A);
-    B._data[B._slc] %= _data[_slc];
+    std::cout << str << *this;
+  }
 
-    return B;
+  template<typename T, typename Alloc>
+  Mat<T, Alloc> Mat<T, Alloc>::sub(Mat<size_t>& idx)
+  {
+    Mat<T, Alloc> A(_nr, idx._nc, uninit);
+    sub_into(A.view(), view(), idx);
+    return A;
   }
 
-  template<typename T>
-  void Mat<T>::operator%=(const Mat & A)
+  template<typename T, typename Alloc>
+  inline void Mat<T, Alloc>::subcols(Mat& A, Mat<size_t>& idx)
   {
-    _data[_slc] %= A._data[A._slc];
+    sub_into(A.view(), view(), idx);
   }
 
-  template<typename T>
-  Mat<T> Mat<T>::operator*(const Mat & A)
+
+  // destination reusing variants of the value returning functions
+  // a Mat destination is resized (its buffer kept when the size does not
+  // change) unless it is a sub-view, a view destination must match
+
+  template<typename T, typename Alloc, typename E>
+  void eval_into(Mat<T, Alloc>& dst, const MatExpr<E>& e)
   {
-    Mat<T> B(A);
-    B._data[B._slc] *= _data[_slc];
+    dst = e;
+  }
 
-    return B;
+  template<typename T, typename E>
+  void eval_into(MatView<T> dst, const MatExpr<E>& e)
+  {
+    if (dst.rows() != e.self().rows() || dst.cols() != e.self().cols())
+      throw std::runtime_error("Invalid dimensions in eval_into");
+    dst.assign(e);
   }
 
-  template<typename T>
-  void Mat<T>::operator*=(const Mat & A)
+  template<typename D, typename L, typename R>
+  void add_into(D&& dst, const MatExpr<L>& a, const MatExpr<R>& b)
   {
-    _data[_slc] *= A._data[A._slc];
+    eval_into(std::forward<D>(dst), a.self() + b.self());
   }
 
+  // element-wise a - b, sub_into is the column gather of Mat::sub(idx)
+  template<typename D, typename L, typename R>
+  void subtract_into(D&& dst, const MatExpr<L>& a, const MatExpr<R>& b)
+  {
+    eval_into(std::forward<D>(dst), a.self() - b.self());
+  }
 
+  template<typename D, typename L, typename R>
+  void mul_into(D&& dst, const MatExpr<L>& a, const MatExpr<R>& b)
+  {
+    eval_into(std::forward<D>(dst), a.self() * b.self());
+  }
 
-  template<typename T>
-  void Mat<T>::sub(const size_t rFirst, const size_t rLast, 
-    const size_t cFirst, const size_t cLast)
+  template<typename D, typename L, typename R>
+  void div_into(D&& dst, const MatExpr<L>& a, const MatExpr<R>& b)
   {
-    auto rows = rLast - rFirst + 1;
-    auto cols = cLast - cFirst + 1;
-    _slc = std::gslice{ cFirst*lda() + rFirst,
-      { rows, cols }, { 1, lda() } };
-    _nc = _slc.size()[1];
-    _nr = _slc.size()[0];
+    eval_into(std::forward<D>(dst), a.self() / b.self());
   }
 
+  // Column and row gather/scatter. gather_cols copies dst(:, i) =
+  // src(:, idx(i)), scatter_cols is its inverse dst(:, idx(i)) = src(:, i),
+  // gather_rows and scatter_rows do the same for rows; idx is a row or
+  // column vector, e.g. the permutation of geqp3. Copies of gather_par_min
+  // elements and more are split across threads in tasks of gather_block
+  // rows of one column. copy_mode::stream writes the columns with
+  // non-temporal stores, which leave the cache to the source when the
+  // destination is not read soon; automatic streams destinations of
+  // gather_stream_min bytes and more, beyond a last level cache.
+  // dst and src must not overlap and the idx of a scatter must not repeat.
+  enum class copy_mode { automatic, cached, stream };
+
+  constexpr size_t gather_par_min = size_t{ 1 } << 15;     // elements, below runs serial
+  constexpr size_t gather_block = 8192;                    // rows of a column per task
+  constexpr size_t gather_stream_min = size_t{ 1 } << 25;  // bytes, from here automatic streams
+
+  namespace detail {
+
+    // every index of the row or column vector idx is below bound
+    inline bool idx_below(ConstMatView<size_t> idx, const size_t bound)
+    {
+      const size_t n = vec_len(idx);
+      const size_t inc = vec_inc(idx);
+      for (size_t i = 0; i < n; ++i)
+        if (idx.data()[i*inc] >= bound)
+          return false;
+      return true;
+    }
 
+    // f(j, r0, r1) for the rows [r0, r1) of the columns j < n of an m x n
+    // block, the tasks split across threads when they move gather_par_min
+    // elements or more
+    template<typename F>
+    void for_col_blocks(const size_t m, const size_t n, const size_t work, F f)
+    {
+      const size_t nb = (m + gather_block - 1) / gather_block;
+      const long long tasks = static_cast<long long>(n * nb);
+      const bool par = work >= gather_par_min && !omp_in_parallel();
+#pragma omp parallel for schedule(static) if(par)
+      for (long long k = 0; k < tasks; ++k)
+      {
+        const size_t j = static_cast<size_t>(k) / nb;
+        const size_t r0 = static_cast<size_t>(k) % nb * gather_block;
+        f(j, r0, std::min(m, r0 + gather_block));
+      }
+    }
 
+    // column j of the m x n destination dcol(j) = scol(j)
+    template<typename T, typename D, typename S>
+    void copy_cols(const size_t m, const size_t n, D dcol, S scol, const copy_mode mode)
+    {
+      const bool stream = mode == copy_mode::stream ||
+        (mode == copy_mode::automatic && m * n * sizeof(T) >= gather_stream_min);
+      for_col_blocks(m, n, m * n, [&](const size_t j, const size_t r0, const size_t r1) {
+        const T* s = scol(j) + r0;
+        T* d = dcol(j) + r0;
+        if (stream)
+          simd::stream_copy(r1 - r0, s, d);
+        else
+          std::copy(s, s + (r1 - r0), d);
+      });
+    }
+
+  } // namespace detail
+
+
+  // dst(:, i) = src(:, idx(i))
   template<typename T>
-  void Mat<T>::subcols(const size_t first, const size_t last)
+  void gather_cols(MatView<T> dst, Nondeduced<ConstMatView<T>> src, ConstMatView<size_t> idx,
+    const copy_mode mode = copy_mode::automatic)
   {
-    sub(0, _rows - 1, first, last);
+    const size_t n = vec_len(idx);
+    const size_t inc = vec_inc(idx);
+    if (dst.rows() != src.rows() || dst.cols() != n || !detail::idx_below(idx, src.cols()))
+      throw std::runtime_error("Invalid dimensions in gather_cols");
+    IGM_PROF("gather_cols", 0, 2 * sizeof(T) * dst.rows() * n, dst.rows(), n);
+    const size_t* p = idx.data();
+    detail::copy_cols<T>(dst.rows(), n, [&](const size_t j) { return dst.begincol(j); },
+      [&](const size_t j) { return src.begincol(p[j*inc]); }, mode);
   }
 
-  template<typename T>
-  void Mat<T>::subcols(const size_t first)
+  template<typename T, typename Alloc>
+  void gather_cols(Mat<T, Alloc>& dst, const Mat<T, Alloc>& src, ConstMatView<size_t> idx,
+    const copy_mode mode = copy_mode::automatic)
   {
-    sub(0, _rows - 1, first, _cols - 1);
+    if ((dst.rows() != src.rows() || dst.cols() != vec_len(idx)) && !dst.issub())
+      dst.resize(src.rows(), vec_len(idx), uninit);
+    gather_cols(dst.view(), src.view(), idx, mode);
   }
 
+  // dst(:, idx(i)) = src(:, i), the other columns of dst are kept
   template<typename T>
-  inline Mat<T>& Mat<T>::subcol(const size_t col)
+  void scatter_cols(MatView<T> dst, Nondeduced<ConstMatView<T>> src, ConstMatView<size_t> idx,
+    const copy_mode mode = copy_mode::automatic)
   {
-    sub(0, _rows - 1, col, col);
-    return *this;
+    const size_t n = vec_len(idx);
+    const size_t inc = vec_inc(idx);
+    if (dst.rows() != src.rows() || src.cols() != n || !detail::idx_below(idx, dst.cols()))
+      throw std::runtime_error("Invalid dimensions in scatter_cols");
+    IGM_PROF("scatter_cols", 0, 2 * sizeof(T) * src.rows() * n, src.rows(), n);
+    const size_t* p = idx.data();
+    detail::copy_cols<T>(src.rows(), n, [&](const size_t j) { return dst.begincol(p[j*inc]); },
+      [&](const size_t j) { return src.begincol(j); }, mode);
   }
 
-  template<typename T>
-  inline void Mat<T>::subrow(const size_t row)
+  template<typename T, typename Alloc>
+  void scatter_cols(Mat<T, Alloc>& dst, const Mat<T, Alloc>& src, ConstMatView<size_t> idx,
+    const copy_mode mode = copy_mode::automatic)
   {
-    sub(row, row, 0, _cols - 1);
+    scatter_cols(dst.view(), src.view(), idx, mode);
   }
 
+  // dst(i, :) = src(idx(i), :)
   template<typename T>
-  void Mat<T>::swapcols(const size_t c1, const size_t c2)
+  void gather_rows(MatView<T> dst, Nondeduced<ConstMatView<T>> src, ConstMatView<size_t> idx)
   {
-    std::swap_ranges(begincol(c1), endcol(c1), begincol(c2));
+    const size_t n = vec_len(idx);
+    const size_t inc = vec_inc(idx);
+    if (dst.rows() != n || dst.cols() != src.cols() || !detail::idx_below(idx, src.rows()))
+      throw std::runtime_error("Invalid dimensions in gather_rows");
+    IGM_PROF("gather_rows", 0, 2 * sizeof(T) * n * dst.cols(), n, dst.cols());
+    const size_t* p = idx.data();
+    detail::for_col_blocks(n, dst.cols(), n * dst.cols(), [&](const size_t j, const size_t r0, const size_t r1) {
+      const T* s = src.begincol(j);
+      T* d = dst.begincol(j);
+      for (size_t i = r0; i < r1; ++i)
+        d[i] = s[p[i*inc]];
+    });
   }
 
-  template<typename T>
-  inline T Mat<T>::max(size_t & idx)
+  template<typename T, typename Alloc>
+  void gather_rows(Mat<T, Alloc>& dst, const Mat<T, Alloc>& src, ConstMatView<size_t> idx)
   {
-    T max = at(0);
-    idx = 0;
-    for (size_t i = 0; i < _nc; ++i)
-    {
-      if (at(i) > max) {
-        idx = i;
-        max = at(i);
-      }
-    }
-    return max;
+    if ((dst.rows() != vec_len(idx) || dst.cols() != src.cols()) && !dst.issub())
+      dst.resize(vec_len(idx), src.cols(), uninit);
+    gather_rows(dst.view(), src.view(), idx);
   }
 
+  // dst(idx(i), :) = src(i, :), the other rows of dst are kept
   template<typename T>
-  void Mat<T>::print(const char * str)
+  void scatter_rows(MatView<T> dst, Nondeduced<ConstMatView<T>> src, ConstMatView<size_t> idx)
   {
-    std::cout << str << *this;
+    const size_t n = vec_len(idx);
+    const size_t inc = vec_inc(idx);
+    if (src.rows() != n || dst.cols() != src.cols() || !detail::idx_below(idx, dst.rows()))
+      throw std::runtime_error("Invalid dimensions in scatter_rows");
+    IGM_PROF("scatter_rows", 0, 2 * sizeof(T) * n * src.cols(), n, src.cols());
+    const size_t* p = idx.data();
+    detail::for_col_blocks(n, src.cols(), n * src.cols(), [&](const size_t j, const size_t r0, const size_t r1) {
+      const T* s = src.begincol(j);
+      T* d = dst.begincol(j);
+      for (size_t i = r0; i < r1; ++i)
+        d[p[i*inc]] = s[i];
+    });
   }
 
-  template<typename T>
-  Mat<T> Mat<T>::sub(Mat<size_t>& idx)
+  template<typename T, typename Alloc>
+  void scatter_rows(Mat<T, Alloc>& dst, const Mat<T, Alloc>& src, ConstMatView<size_t> idx)
   {
-    Mat<T> A(_nr, idx._nc);
+    scatter_rows(dst.view(), src.view(), idx);
+  }
 
-    for (size_t i = 0; i < idx._nc; ++i) {
-      std::memcpy(A.begincol(i), begincol(idx(0,i)), sizeof(T)*_nr);
-    }
+  // dst(:, i) = src(:, idx(i)), the gather of Mat::sub(idx)
+  template<typename T>
+  void sub_into(MatView<T> dst, Nondeduced<ConstMatView<T>> src, ConstMatView<size_t> idx)
+  {
+    gather_cols(dst, src, idx);
+  }
 
-    return A;
+  template<typename T, typename Alloc>
+  void sub_into(Mat<T, Alloc>& dst, const Mat<T, Alloc>& src, ConstMatView<size_t> idx)
+  {
+    gather_cols(dst, src, idx);
   }
 
   template<typename T>
-  inline void Mat<T>::subcols(Mat& A, Mat<size_t>& idx)
+  void eye_into(MatView<T> dst)
   {
-    for (size_t i = 0; i < idx._nc; ++i) {
-      std::memcpy(A.begincol(i), begincol(idx(0, i)), sizeof(T)*_nr);
+    if (dst.rows() != dst.cols())
+      throw std::runtime_error("Invalid dimensions in eye_into");
+    for (size_t j = 0; j < dst.cols(); ++j)
+    {
+      std::fill(dst.begincol(j), dst.endcol(j), T{ 0 });
+      dst(j, j) = T{ 1 };
     }
   }
 
@@ -399,65 +945,138 @@ namespace igm
   T sum(const Mat<T>& v)
   {
     //if (v.issub())
-    //  throw std::exception("sum doesnt't operate on sub-views!");
-    return std::accumulate(v.begin(), v.end(), T{ 0 });
+    //  throw std::runtime_error("sum doesnt't operate on sub-views!");
+    return simd::sum(v.size(), v.begin());
   }
 
-  template<typename T>
-  T sumabs2_col1(const Mat<T>& src, const size_t col)
-  {
-//#define TRY_PARALLEL
-#ifdef TRY_PARALLEL
-    int nelements = src._nr;
-    T* a = const_cast<double*>(src.begincol(col));
-    T* b = a;
-    T sumt{ 0 };
-    int nthreads;
+  // column sums of squares
+  // Small inputs run on the calling thread. Wide matrices are split across
+  // columns. Matrices with fewer columns than threads split each column
+  // into row blocks, one per thread; the partial sums are added atomically,
+  // so the last bits may differ from run to run.
+  constexpr size_t norm_par_min = size_t{ 1 } << 15;  // elements, below runs serial
+  constexpr size_t norm_row_block = 4096;             // min rows per thread of the row split
+
+  enum class norm_split { serial, columns, rows };
 
+  inline norm_split norm_strategy(const size_t rows, const size_t cols, const int threads)
+  {
+    if (threads < 2 || rows * cols < norm_par_min || omp_in_parallel())
+      return norm_split::serial;
+    if (cols >= 2 * static_cast<size_t>(threads) || rows < 2 * norm_row_block)
+      return norm_split::columns;
+    return norm_split::rows;
+  }
 
-#pragma omp parallel 
-#pragma omp single
-    nthreads = omp_get_num_threads();
-    std::cout << nthreads << "\n";
+  namespace detail {
 
-#pragma omp parallel default(none) reduction(+:sumt) shared(a, b, nthreads, nelements) 
+    // dst(0, j) = |src(:, j)|^2 + add[j*inca] for j >= first, add may be null
+    template<typename T>
+    void sumsq_cols(MatView<T> dst, ConstMatView<T> src, const size_t first,
+      const T* add, const size_t inca, const norm_split split)
     {
-      int tid = omp_get_thread_num();
-      int nitems = nelements / nthreads;
-      int start = tid * nitems;
-      int end = start + nitems;
-      if (tid == nthreads - 1) end = nelements;
+      const long long n = static_cast<long long>(src.cols());
+      const size_t m = src.rows();
+      switch (split) {
+      case norm_split::columns:
+#pragma omp parallel for schedule(static)
+        for (long long j = first; j < n; ++j)
+          dst(0, j) = simd::sumsq(m, src.begincol(j)) + (add ? add[j*inca] : T{ 0 });
+        break;
+
+      case norm_split::rows:
+        for (long long j = first; j < n; ++j)
+          dst(0, j) = add ? add[j*inca] : T{ 0 };
+#pragma omp parallel
+        {
+          // blocks start on multiples of 16 elements, a cache line of float
+          const size_t nt = static_cast<size_t>(omp_get_num_threads());
+          const size_t t = static_cast<size_t>(omp_get_thread_num());
+          const size_t r0 = std::min(m, (m * t / nt + 15) / 16 * 16);
+          const size_t r1 = t + 1 == nt ? m : std::min(m, (m * (t + 1) / nt + 15) / 16 * 16);
+          for (long long j = first; j < n; ++j)
+          {
+            const T s = simd::sumsq(r1 - r0, src.begincol(j) + r0);
+            T& d = dst(0, j);
+#pragma omp atomic
+            d += s;
+          }
+        }
+        break;
+
+      default:
+        for (long long j = first; j < n; ++j)
+          dst(0, j) = simd::sumsq(m, src.begincol(j)) + (add ? add[j*inca] : T{ 0 });
+      }
+    }
 
-      sumt += std::inner_product(a + start, a + end, b + start, 0);
+    template<typename T>
+    void sumsq_cols(MatView<T> dst, ConstMatView<T> src, const size_t first,
+      const T* add, const size_t inca)
+    {
+      if (dst.cols() != src.cols())
+        throw std::runtime_error("Invalid dimensions in sumabs2_col");
+      const size_t n = first < src.cols() ? src.cols() - first : 0;
+      sumsq_cols(dst, src, first, add, inca, norm_strategy(src.rows(), n, omp_get_max_threads()));
     }
-    return sumt;
-#else
-    return std::inner_product(src.begincol(col), src.endcol(col), src.begincol(col), T{ 0 });
-#endif
+
+  } // namespace detail
+
+
+  template<typename T>
+  T sumabs2_col1(ConstMatView<T> src, const size_t col)
+  {
+    const size_t m = src.rows();
+    IGM_PROF("sumabs2_col1", 2 * m, sizeof(T) * m, m, 1);
+    if (m < norm_par_min)
+      return simd::sumsq(m, src.begincol(col));
+    T s{ 0 };
+    detail::sumsq_cols(MatView<T>(&s, 1, 1, 1), src.col(col), 0, static_cast<const T*>(nullptr), 0);
+    return s;
+  }
+
+  template<typename T>
+  T sumabs2_col1(MatView<T> src, const size_t col)
+  {
+    return sumabs2_col1(ConstMatView<T>(src), col);
+  }
+
+  template<typename T>
+  T sumabs2_col1(const Mat<T>& src, const size_t col)
+  {
+    return sumabs2_col1(src.view(), col);
+  }
+
+  // dst(0, i) = sum of squares of column i of src, for the columns i >= first
+  template<typename T>
+  void sumabs2_col(MatView<T> dst, Nondeduced<ConstMatView<T>> src, const size_t first)
+  {
+    IGM_PROF("sumabs2_col", 2 * src.rows() * src.cols(), sizeof(T) * src.rows() * src.cols(), src.rows(), src.cols());
+    detail::sumsq_cols(dst, src, first, static_cast<const T*>(nullptr), 0);
+  }
+
+  // as above plus v(i)
+  template<typename T>
+  void sumabs2_col(MatView<T> dst, Nondeduced<ConstMatView<T>> src, const size_t first,
+    Nondeduced<ConstMatView<T>> v)
+  {
+    if (vec_len(v) < src.cols())
+      throw std::runtime_error("Invalid dimensions in sumabs2_col");
+    IGM_PROF("sumabs2_col", 2 * src.rows() * src.cols(), sizeof(T) * src.rows() * src.cols(), src.rows(), src.cols());
+    detail::sumsq_cols(dst, src, first, v.data(), vec_inc(v));
   }
 
   template<typename T>
   void sumabs2_col(Mat<T>& dst, const Mat<T>& src, const size_t first)
   {
-    if (dst.cols() != src.cols())
-      throw std::exception("Invalid dimensions in sumabs2_col");
-    for (size_t i = first; i < first+src._nc; ++i)
-    {
-      dst(0, i) = sumabs2_col1(src, i);
-    }
+    sumabs2_col(dst.view(), src.view(), first);
   }
 
   template<typename T>
   void sumabs2_col(Mat<T>& dst, const Mat<T>& src, const size_t first,
      const Mat<T>& v)
   {
-    if (dst.cols() != src.cols())
-      throw std::exception("Invalid dimensions in sumabs2_col");
-#pragma omp parallel for
-    for (long long i = first; i < static_cast<long long>(src.cols()); ++i)
-    {
-      dst(0, i) = sumabs2_col1(src, i) + v(i);
-    }
+    sumabs2_col(dst.view(), src.view(), first, v.view());
   }
 
   template<typename T>
@@ -472,15 +1091,15 @@ namespace igm
   template<typename T>
   T sumabs2(const Mat<T>& src)
   {
-    return std::inner_product(src.begin(), src.end(), src.begin(), T{ 0 });
+    return simd::sumsq(src.size(), src.begin());
   }
 
 
   template<typename T>
   Mat<T> eye(const size_t rc)
   {
-    Mat<T> A(rc, rc);
-    A.eye();
+    Mat<T> A(rc, rc, uninit);
+    eye_into(A.view());
 
     return A;
   }
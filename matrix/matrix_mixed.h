@@ -0,0 +1,175 @@
+#ifndef _MATRIX_MIXED_H__
+#define _MATRIX_MIXED_H__
+
+#include <cmath>
+#include <limits>
+#include <algorithm>
+#include <stdexcept>
+#include "matrix_igm.hpp"
+#include "matrix_lpack_blas.h"
+#include "matrix_qr.h"
+#include "matrix_trsm.h"
+
+// Mixed precision least squares / linear solve. A is factored by geqrf in
+// the low precision L (float: half the memory traffic, twice the SIMD
+// width), the solution is refined in the high precision H of A and B.
+// The refinement is the one of the augmented system (Bjorck)
+//   [I A; A' 0] * [r; x] = [b; 0]
+// which also refines the residual r, so it converges for least squares
+// problems with a large residual too: f = b - r - A*x and g = -A'*r are
+// computed in H, the correction
+//   h = R'\g,  d = Q'*f,  dx = R\(d(0:n) - h),  dr = Q*[h; d(n:m)]
+// with the factors in L. The rate is about cond(A)*eps(L). The refinement
+// stops when the correction of x drops to the rounding level of H; when
+// it stalls above it (cond(A)*eps(L) near 1) or does not finish in
+// max_iter steps, X is recomputed by a QR in H.
+
+namespace igm {
+
+  constexpr size_t refine_max_iter = 30;
+
+  struct refine_info {
+    size_t iterations = 0;    // corrections after the first low precision solve
+    bool converged = false;   // refinement reached the high precision
+    bool fallback = false;    // refinement stalled, X comes from a QR in H
+    double correction = 0.0;  // last relative correction max |dX|/|X|
+  };
+
+  namespace detail {
+
+    // B(0:n, :) = R\B(0:n, :) (R'\B(0:n, :) with trans), R is the upper
+    // triangle of the leading n x n block of the factored A
+    template<typename T>
+    void solve_upper(const Mat<T>& A, Mat<T>& B, const bool trans = false)
+    {
+      const size_t n = A.cols();
+      trsm(ConstMatView<T>(A.begincol(0), n, n, A.lda()), MatView<T>(B.begincol(0), n, B.cols(), B.lda()),
+        uplo::upper, trans);
+    }
+
+
+    template<typename To, typename From>
+    void convert(Mat<To>& dst, const Mat<From>& src)
+    {
+      for (size_t j = 0; j < src.cols(); ++j)
+        std::transform(src.begincol(j), src.endcol(j), dst.begincol(j), [](const From a) { return static_cast<To>(a); });
+    }
+
+    // X(0:n, :) = least squares solution of A*X = B by a QR in T
+    template<typename T>
+    void solve_qr(Mat<T>& X, const Mat<T>& A, const Mat<T>& B)
+    {
+      Mat<T> F(A), tau(1, A.cols()), C(B);
+      geqrf(F, tau);
+      ormqr(C, F, tau);
+      solve_upper(F, C);
+      for (size_t c = 0; c < X.cols(); ++c)
+        std::copy(C.begincol(c), C.begincol(c) + X.rows(), X.begincol(c));
+    }
+
+  } // namespace detail
+
+
+  // least squares (rows >= cols, full rank) or square solve of A*X = B;
+  // X receives the cols x B.cols() solution
+  template<typename L = float, typename H>
+  refine_info solve_mixed(Mat<H>& X, const Mat<H>& A, const Mat<H>& B,
+    const size_t max_iter = refine_max_iter)
+  {
+    const size_t m = A.rows(), n = A.cols(), k = B.cols();
+    if (m < n || B.rows() != m)
+      throw std::runtime_error("Invalid dimensions in solve_mixed");
+    IGM_PROF("solve_mixed", 2 * m * n * n, sizeof(H) * 2 * m * (n + k), m, n);
+    if (X.rows() != n || X.cols() != k)
+      X = Mat<H>(n, k);
+    else
+      X.zeros();
+
+    Mat<L> F(m, n, uninit), tau(1, n);
+    detail::convert(F, A);
+    geqrf(F, tau);
+
+    // r, f in H; d, h (n x k) the correction in L
+    Mat<H> r(m, k), f(m, k, uninit), g(n, k, uninit);
+    Mat<L> d(m, k, uninit), h(n, k, uninit);
+    const double tol = std::sqrt(static_cast<double>(n)) * std::numeric_limits<H>::epsilon();
+    refine_info info;
+    double last = std::numeric_limits<double>::infinity();
+    for (size_t it = 0; it <= max_iter; ++it)
+    {
+      // f = b - r - A*x, g = -A'*r; the first pass (x = 0, r = 0) is the
+      // plain solve in L
+      for (size_t c = 0; c < k; ++c)
+        std::copy(B.begincol(c), B.endcol(c), f.begincol(c));
+      if (it > 0) {
+        f -= r;
+        blas::gemm(f, A, X, H{ -1 }, H{ 1 });
+        blas::gemm(g, A, r, H{ -1 }, H{ 0 }, CblasTrans);
+        detail::convert(h, g);
+        detail::solve_upper(F, h, true);
+      }
+      else
+        h.zeros();
+      detail::convert(d, f);
+      ormqr(d, F, tau);
+
+      // dx = R\(d(0:n) - h) into X, d(0:n) = h and dr = Q*d into r
+      double dx = 0.0, x = 0.0;
+      for (size_t c = 0; c < k; ++c)
+      {
+        L* dc = d.begincol(c);
+        L* hc = h.begincol(c);
+        for (size_t i = 0; i < n; ++i)
+        {
+          const L di = dc[i];
+          dc[i] = hc[i];
+          hc[i] = di - hc[i];
+        }
+      }
+      detail::solve_upper(F, h);
+      ormqr(d, F, tau, false);
+      for (size_t c = 0; c < k; ++c)
+      {
+        H* xc = X.begincol(c);
+        const L* dc = h.begincol(c);
+        for (size_t i = 0; i < n; ++i)
+        {
+          xc[i] += static_cast<H>(dc[i]);
+          dx = std::max(dx, static_cast<double>(std::abs(dc[i])));
+          x = std::max(x, static_cast<double>(std::abs(xc[i])));
+        }
+        std::transform(d.begincol(c), d.endcol(c), r.begincol(c), r.begincol(c),
+          [](const L a, const H b) { return b + static_cast<H>(a); });
+      }
+      if (it == 0)
+        continue;
+
+      info.iterations = it;
+      info.correction = x > 0.0 ? dx / x : dx;
+      if (!(info.correction == info.correction) || std::isinf(info.correction))
+        break;
+      if (info.correction <= tol) {
+        info.converged = true;
+        return info;
+      }
+      // no contraction any more: a stall within a few rounding errors of H
+      // is as good as a solve in H, anywhere above it the factorization is
+      // too inaccurate for the conditioning of A
+      if (info.correction > 0.5 * last) {
+        if (info.correction <= 16.0 * tol) {
+          info.converged = true;
+          return info;
+        }
+        break;
+      }
+      last = info.correction;
+    }
+
+    info.fallback = true;
+    detail::solve_qr(X, A, B);
+    return info;
+  }
+
+} // namespace igm
+
+#endif // _MATRIX_MIXED_H__
@@ -0,0 +1,332 @@
+#ifndef _MATRIX_MMAP_H__
+#define _MATRIX_MMAP_H__
+
+#include <cstddef>
+#include <cstdint>
+#include <algorithm>
+#include <utility>
+#include <cstring>
+#include <complex>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "matrix_igm.hpp"
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// File backed matrices. A matrix file is a 64 byte header (magic, dtype,
+// rows, cols, leading dimension, data offset) followed by the column major
+// elements, every column padded to the leading dimension. MatMap maps the
+// file into memory and hands out MatView / ConstMatView of it, so every
+// kernel taking views (sumabs2_col, mtv, gemv, ...) runs on matrices larger
+// than the memory and the OS pages the columns in and out on demand:
+//   read_only      the file is never written, there is no writable_view
+//   copy_on_write  writes go to private copies of the touched pages
+//   read_write     writes go to the file
+// advise() passes the access pattern of a column range to the OS, e.g.
+// map_advice::sequential before a scan over all columns.
+
+namespace igm {
+
+  enum class map_mode { read_only, copy_on_write, read_write };
+  enum class map_advice { normal, sequential, random, willneed, dontneed };
+
+  // element type codes of the file header
+  template<typename T> struct mat_dtype;
+  template<> struct mat_dtype<float> { static constexpr uint32_t value = 1; };
+  template<> struct mat_dtype<double> { static constexpr uint32_t value = 2; };
+  template<> struct mat_dtype<std::complex<float>> { static constexpr uint32_t value = 3; };
+  template<> struct mat_dtype<std::complex<double>> { static constexpr uint32_t value = 4; };
+  template<> struct mat_dtype<int32_t> { static constexpr uint32_t value = 5; };
+  template<> struct mat_dtype<int64_t> { static constexpr uint32_t value = 6; };
+  template<> struct mat_dtype<uint64_t> { static constexpr uint32_t value = 7; };
+
+  struct mat_file_header {
+    char magic[8];      // "IGMMAT\0\0"
+    uint32_t version;
+    uint32_t dtype;     // mat_dtype<T>::value
+    uint64_t rows;
+    uint64_t cols;
+    uint64_t ld;        // elements from one column to the next
+    uint64_t offset;    // bytes from the start of the file to element (0, 0)
+    char reserved[16];
+  };
+  static_assert(sizeof(mat_file_header) == 64, "mat_file_header is one cache line");
+
+  namespace detail {
+
+    constexpr char mat_magic[8] = { 'I', 'G', 'M', 'M', 'A', 'T', 0, 0 };
+    constexpr uint32_t mat_version = 1;
+
+    template<typename T>
+    mat_file_header make_header(const size_t rows, const size_t cols, const size_t ld)
+    {
+      mat_file_header h{};
+      std::memcpy(h.magic, mat_magic, sizeof(h.magic));
+      h.version = mat_version;
+      h.dtype = mat_dtype<T>::value;
+      h.rows = rows;
+      h.cols = cols;
+      h.ld = ld;
+      h.offset = sizeof(mat_file_header);
+      return h;
+    }
+
+    // rows rounded up to whole cache lines, keeps every column aligned
+    template<typename T>
+    size_t padded_ld(const size_t rows)
+    {
+      const size_t e = mat_align % sizeof(T) == 0 ? mat_align / sizeof(T) : 1;
+      return (rows + e - 1) / e * e;
+    }
+
+  } // namespace detail
+
+
+  // writes A to a matrix file with the columns padded to ld elements
+  // (0: whole cache lines)
+  template<typename T>
+  void write_mat(const std::string& path, Nondeduced<ConstMatView<T>> A, size_t ld = 0)
+  {
+    if (ld == 0)
+      ld = detail::padded_ld<T>(A.rows());
+    if (ld < A.rows())
+      throw std::runtime_error("Invalid leading dimension in write_mat");
+    std::ofstream f(path, std::ios::binary | std::ios::trunc);
+    if (!f)
+      throw std::runtime_error("Cannot write " + path);
+    const mat_file_header h = detail::make_header<T>(A.rows(), A.cols(), ld);
+    f.write(reinterpret_cast<const char*>(&h), sizeof(h));
+    const std::vector<T> pad(ld - A.rows(), T{ 0 });
+    for (size_t c = 0; c < A.cols(); ++c)
+    {
+      f.write(reinterpret_cast<const char*>(A.begincol(c)), A.rows() * sizeof(T));
+      f.write(reinterpret_cast<const char*>(pad.data()), pad.size() * sizeof(T));
+    }
+    if (!f)
+      throw std::runtime_error("Cannot write " + path);
+  }
+
+  template<typename T, typename Alloc>
+  void write_mat(const std::string& path, const Mat<T, Alloc>& A, const size_t ld = 0)
+  {
+    write_mat<T>(path, A.view(), ld);
+  }
+
+
+  // a matrix file mapped into memory; move only, the mapping lives until
+  // the MatMap is destroyed, views of it must not outlive it
+  template<typename T>
+  class MatMap {
+  public:
+    MatMap() = default;
+    explicit MatMap(const std::string& path, const map_mode mode = map_mode::read_only)
+    {
+      open(path, mode);
+    }
+
+    // creates a zero filled rows x cols matrix file and maps it read_write;
+    // the file is sparse where the file system allows it
+    static MatMap create(const std::string& path, const size_t rows, const size_t cols, size_t ld = 0)
+    {
+      if (ld == 0)
+        ld = detail::padded_ld<T>(rows);
+      if (ld < rows)
+        throw std::runtime_error("Invalid leading dimension in MatMap::create");
+      {
+        std::ofstream f(path, std::ios::binary | std::ios::trunc);
+        const mat_file_header h = detail::make_header<T>(rows, cols, ld);
+        f.write(reinterpret_cast<const char*>(&h), sizeof(h));
+        if (!f)
+          throw std::runtime_error("Cannot write " + path);
+      }
+      MatMap m;
+      m.open(path, map_mode::read_write, sizeof(mat_file_header) + ld * cols * sizeof(T));
+      return m;
+    }
+
+    MatMap(const MatMap&) = delete;
+    MatMap& operator=(const MatMap&) = delete;
+    MatMap(MatMap&& o) noexcept { swap(o); }
+    MatMap& operator=(MatMap&& o) noexcept
+    {
+      if (this != &o) {
+        close();
+        swap(o);
+      }
+      return *this;
+    }
+    ~MatMap() { close(); }
+
+    size_t rows() const { return _nr; }
+    size_t cols() const { return _nc; }
+    size_t lda() const { return _ld; }
+    map_mode mode() const { return _mode; }
+    bool is_open() const { return _base != nullptr; }
+
+    const T* data() const { return _p; }
+    ConstMatView<T> view() const { return ConstMatView<T>(_p, _nr, _nc, _ld); }
+    // not for read_only maps
+    MatView<T> writable_view()
+    {
+      if (_mode == map_mode::read_only)
+        throw std::runtime_error("MatMap is read only");
+      return MatView<T>(_p, _nr, _nc, _ld);
+    }
+
+    // access pattern of the columns first to last (inclusive, as sub)
+    void advise(const map_advice a) const
+    {
+      if (_nc > 0)
+        advise(a, 0, _nc - 1);
+    }
+    void advise(const map_advice a, const size_t first, const size_t last) const
+    {
+      if (first > last || last >= _nc)
+        throw std::runtime_error("Invalid columns in MatMap::advise");
+      const char* p0 = reinterpret_cast<const char*>(_p + first * _ld);
+      const char* p1 = reinterpret_cast<const char*>(_p + last * _ld + _nr);
+      const size_t page = page_size();
+      const size_t off = static_cast<size_t>(p0 - static_cast<const char*>(_base)) / page * page;
+      char* start = static_cast<char*>(_base) + off;
+      const size_t len = static_cast<size_t>(p1 - start);
+#ifdef _WIN32
+#if _WIN32_WINNT >= 0x0602
+      if (a == map_advice::willneed) {
+        WIN32_MEMORY_RANGE_ENTRY r{ start, len };
+        PrefetchVirtualMemory(GetCurrentProcess(), 1, &r, 0);
+      }
+#else
+      (void)start; (void)len; (void)a;
+#endif
+#else
+      // posix_madvise: unlike madvise, dontneed never drops the private
+      // pages of a copy_on_write map
+      static const int advice[] = { POSIX_MADV_NORMAL, POSIX_MADV_SEQUENTIAL, POSIX_MADV_RANDOM,
+        POSIX_MADV_WILLNEED, POSIX_MADV_DONTNEED };
+      posix_madvise(start, len, advice[static_cast<int>(a)]);
+#endif
+    }
+
+  private:
+    static size_t page_size()
+    {
+#ifdef _WIN32
+      SYSTEM_INFO si;
+      GetSystemInfo(&si);
+      return si.dwAllocationGranularity;
+#else
+      return static_cast<size_t>(sysconf(_SC_PAGESIZE));
+#endif
+    }
+
+    // maps the file, extended to size bytes first if it is shorter
+    void open(const std::string& path, const map_mode mode, const size_t size = 0)
+    {
+      _mode = mode;
+      const bool write = mode == map_mode::read_write;
+#ifdef _WIN32
+      HANDLE f = CreateFileA(path.c_str(), GENERIC_READ | (write ? GENERIC_WRITE : 0), FILE_SHARE_READ,
+        nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+      if (f == INVALID_HANDLE_VALUE)
+        throw std::runtime_error("Cannot open " + path);
+      LARGE_INTEGER fs;
+      GetFileSizeEx(f, &fs);
+      _bytes = std::max(static_cast<size_t>(fs.QuadPart), size);
+      const DWORD prot = mode == map_mode::read_only ? PAGE_READONLY
+        : mode == map_mode::copy_on_write ? PAGE_WRITECOPY : PAGE_READWRITE;
+      const DWORD access = mode == map_mode::read_only ? FILE_MAP_READ
+        : mode == map_mode::copy_on_write ? FILE_MAP_COPY : FILE_MAP_WRITE;
+      const unsigned long long sz = _bytes;
+      HANDLE h = _bytes ? CreateFileMappingA(f, nullptr, prot, static_cast<DWORD>(sz >> 32),
+        static_cast<DWORD>(sz & 0xffffffffu), nullptr) : nullptr;
+      CloseHandle(f);
+      _base = h ? MapViewOfFile(h, access, 0, 0, 0) : nullptr;
+      if (h)
+        CloseHandle(h);
+#else
+      const int fd = ::open(path.c_str(), write ? O_RDWR : O_RDONLY);
+      if (fd < 0)
+        throw std::runtime_error("Cannot open " + path);
+      struct stat st;
+      if (fstat(fd, &st) != 0 || (static_cast<size_t>(st.st_size) < size && ftruncate(fd, static_cast<off_t>(size)) != 0)) {
+        ::close(fd);
+        throw std::runtime_error("Cannot open " + path);
+      }
+      _bytes = std::max(static_cast<size_t>(st.st_size), size);
+      const int prot = mode == map_mode::read_only ? PROT_READ : PROT_READ | PROT_WRITE;
+      const int flags = mode == map_mode::copy_on_write ? MAP_PRIVATE : MAP_SHARED;
+      void* p = _bytes ? mmap(nullptr, _bytes, prot, flags, fd, 0) : MAP_FAILED;
+      ::close(fd);
+      _base = p == MAP_FAILED ? nullptr : p;
+#endif
+      if (!_base)
+        throw std::runtime_error("Cannot map " + path);
+
+      mat_file_header h;
+      if (_bytes < sizeof(h)) {
+        close();
+        throw std::runtime_error("Invalid header in " + path);
+      }
+      std::memcpy(&h, _base, sizeof(h));
+      const bool ok = std::memcmp(h.magic, detail::mat_magic, sizeof(h.magic)) == 0
+        && h.version == detail::mat_version && h.ld >= h.rows && h.offset >= sizeof(h)
+        && h.offset % alignof(T) == 0 && h.offset + h.ld * h.cols * sizeof(T) <= _bytes;
+      if (!ok || h.dtype != mat_dtype<T>::value) {
+        close();
+        throw std::runtime_error((ok ? "Invalid element type in " : "Invalid header in ") + path);
+      }
+      _nr = static_cast<size_t>(h.rows);
+      _nc = static_cast<size_t>(h.cols);
+      _ld = static_cast<size_t>(h.ld);
+      _p = reinterpret_cast<T*>(static_cast<char*>(_base) + h.offset);
+    }
+
+    void close()
+    {
+      if (_base) {
+#ifdef _WIN32
+        UnmapViewOfFile(_base);
+#else
+        munmap(_base, _bytes);
+#endif
+      }
+      _base = nullptr;
+      _p = nullptr;
+      _bytes = _nr = _nc = _ld = 0;
+    }
+
+    void swap(MatMap& o) noexcept
+    {
+      std::swap(_base, o._base);
+      std::swap(_bytes, o._bytes);
+      std::swap(_p, o._p);
+      std::swap(_nr, o._nr);
+      std::swap(_nc, o._nc);
+      std::swap(_ld, o._ld);
+      std::swap(_mode, o._mode);
+    }
+
+    void* _base = nullptr;
+    size_t _bytes = 0;
+    T* _p = nullptr;
+    size_t _nr = 0;
+    size_t _nc = 0;
+    size_t _ld = 0;
+    map_mode _mode = map_mode::read_only;
+  };
+
+} // namespace igm
+
+#endif // _MATRIX_MMAP_H__
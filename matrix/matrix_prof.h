@@ -0,0 +1,291 @@
+#ifndef _MATRIX_PROF_H__
+#define _MATRIX_PROF_H__
+
+#include <cstddef>
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <ostream>
+#include <iomanip>
+
+// Kernel instrumentation. With IGM_PROFILE defined every kernel entry
+// (IGM_PROF at the top of its body) counts its calls, the elapsed time and
+// the modeled flops and bytes per call site and shape, in counters of the
+// calling thread; report() merges the threads on demand. Without
+// IGM_PROFILE the macro expands to nothing, the arguments are not
+// evaluated and report() is empty. The per thread tables are allocated on
+// the first sample of a thread, so the kernels keep allocating nothing.
+// Times are inclusive: a kernel calling another one (the gemm of geqrf)
+// is counted in both. report/reset/print must not run concurrently with
+// instrumented kernels.
+
+#define IGM_PROF_CAT2(a, b) a##b
+#define IGM_PROF_CAT(a, b) IGM_PROF_CAT2(a, b)
+
+#ifdef IGM_PROFILE
+#define IGM_PROF(name, flops, bytes, rows, cols) \
+  static const size_t IGM_PROF_CAT(igm_prof_site_, __LINE__) = ::igm::prof::site(name); \
+  const ::igm::prof::scope IGM_PROF_CAT(igm_prof_scope_, __LINE__)(IGM_PROF_CAT(igm_prof_site_, __LINE__), \
+    static_cast<double>(flops), static_cast<double>(bytes), static_cast<size_t>(rows), static_cast<size_t>(cols))
+#else
+#define IGM_PROF(name, flops, bytes, rows, cols) ((void)0)
+#endif
+
+namespace igm {
+
+  namespace prof {
+
+    // totals of one call site and shape
+    struct record {
+      std::string name;
+      size_t rows;
+      size_t cols;
+      unsigned long long calls;
+      double seconds;
+      double flops;
+      double bytes;
+    };
+
+    constexpr size_t prof_slots = 2048;   // call site and shape pairs per thread
+
+    namespace detail {
+
+      struct key {
+        size_t site, rows, cols;
+        bool operator<(const key& o) const
+        {
+          return site != o.site ? site < o.site : rows != o.rows ? rows < o.rows : cols < o.cols;
+        }
+        bool operator==(const key& o) const { return site == o.site && rows == o.rows && cols == o.cols; }
+      };
+
+      struct counter {
+        unsigned long long calls = 0;
+        double seconds = 0.0, flops = 0.0, bytes = 0.0;
+
+        void add(const counter& o)
+        {
+          calls += o.calls;
+          seconds += o.seconds;
+          flops += o.flops;
+          bytes += o.bytes;
+        }
+      };
+
+      constexpr size_t no_site = ~size_t{ 0 };
+
+      // open addressing table of one thread, allocated once so that an
+      // instrumented kernel still allocates nothing; samples which find no
+      // free slot (the table 3/4 full) go to overflow
+      struct table {
+        struct slot {
+          key k;
+          counter c;
+        };
+        std::vector<slot> slots;
+        counter overflow;
+        size_t used = 0;
+
+        table() : slots(prof_slots) { clear(); }
+
+        counter& at(const key& k)
+        {
+          size_t h = (k.site * 0x9e3779b97f4a7c15ull) ^ (k.rows * 0xc2b2ae3d27d4eb4full) ^ (k.cols + 0x165667b19e3779f9ull);
+          for (;; ++h)
+          {
+            slot& s = slots[h % prof_slots];
+            if (s.k == k)
+              return s.c;
+            if (s.k.site == no_site) {
+              if (4 * (used + 1) > 3 * prof_slots)
+                return overflow;
+              ++used;
+              s.k = k;
+              return s.c;
+            }
+          }
+        }
+
+        void clear()
+        {
+          for (slot& s : slots)
+            s = slot{ key{ no_site, 0, 0 }, counter{} };
+          overflow = counter{};
+          used = 0;
+        }
+      };
+
+      using totals = std::map<key, counter>;
+
+      inline void merge(totals& dst, const table& t)
+      {
+        for (const table::slot& s : t.slots)
+          if (s.k.site != no_site)
+            dst[s.k].add(s.c);
+        if (t.overflow.calls > 0)
+          dst[key{ no_site, 0, 0 }].add(t.overflow);
+      }
+
+      // the names of the sites, the tables of the running threads and the
+      // totals of the finished ones
+      struct registry {
+        std::mutex mu;
+        std::vector<std::string> names;
+        std::vector<table*> live;
+        totals retired;
+      };
+
+      inline registry& reg()
+      {
+        static registry r;
+        return r;
+      }
+
+      // per thread table, registered while the thread runs
+      struct local {
+        table t;
+
+        local()
+        {
+          registry& r = reg();
+          std::lock_guard<std::mutex> lock(r.mu);
+          r.live.push_back(&t);
+        }
+
+        ~local()
+        {
+          registry& r = reg();
+          std::lock_guard<std::mutex> lock(r.mu);
+          merge(r.retired, t);
+          r.live.erase(std::remove(r.live.begin(), r.live.end(), &t), r.live.end());
+        }
+      };
+
+      inline table& tls()
+      {
+        static thread_local local l;
+        return l.t;
+      }
+
+    } // namespace detail
+
+
+    // id of the call site name, once per site (a function local static)
+    inline size_t site(const char* name)
+    {
+      detail::registry& r = detail::reg();
+      std::lock_guard<std::mutex> lock(r.mu);
+      const auto it = std::find(r.names.begin(), r.names.end(), name);
+      if (it != r.names.end())
+        return static_cast<size_t>(it - r.names.begin());
+      r.names.emplace_back(name);
+      return r.names.size() - 1;
+    }
+
+
+    // times the enclosing scope into the counters of the calling thread
+    class scope {
+    public:
+      scope(const size_t site, const double flops, const double bytes, const size_t rows, const size_t cols)
+        : _site(site), _rows(rows), _cols(cols), _flops(flops), _bytes(bytes),
+        _t0(std::chrono::steady_clock::now()) {}
+
+      ~scope()
+      {
+        const double t = std::chrono::duration<double>(std::chrono::steady_clock::now() - _t0).count();
+        detail::counter& c = detail::tls().at(detail::key{ _site, _rows, _cols });
+        ++c.calls;
+        c.seconds += t;
+        c.flops += _flops;
+        c.bytes += _bytes;
+      }
+
+      scope(const scope&) = delete;
+      scope& operator=(const scope&) = delete;
+
+    private:
+      size_t _site, _rows, _cols;
+      double _flops, _bytes;
+      std::chrono::steady_clock::time_point _t0;
+    };
+
+
+    // the counters of all threads merged, by site and shape
+    inline std::vector<record> report()
+    {
+      detail::registry& r = detail::reg();
+      std::lock_guard<std::mutex> lock(r.mu);
+      detail::totals all(r.retired);
+      for (const detail::table* t : r.live)
+        detail::merge(all, *t);
+
+      std::vector<record> out;
+      out.reserve(all.size());
+      for (const auto& e : all)
+      {
+        const detail::counter& c = e.second;
+        const std::string name = e.first.site == detail::no_site ? "(overflow)" : r.names[e.first.site];
+        out.push_back({ name, e.first.rows, e.first.cols, c.calls, c.seconds, c.flops, c.bytes });
+      }
+      return out;
+    }
+
+
+    // clears the counters, the call sites stay registered
+    inline void reset()
+    {
+      detail::registry& r = detail::reg();
+      std::lock_guard<std::mutex> lock(r.mu);
+      r.retired.clear();
+      for (detail::table* t : r.live)
+        t->clear();
+    }
+
+
+    // one line per site and shape, the most expensive first
+    inline void print(std::ostream& os)
+    {
+      std::vector<record> rs = report();
+      std::sort(rs.begin(), rs.end(), [](const record& a, const record& b) { return a.seconds > b.seconds; });
+      const std::ios_base::fmtflags flags = os.flags();
+      os << std::left << std::setw(20) << "kernel" << std::right << std::setw(14) << "shape"
+        << std::setw(10) << "calls" << std::setw(12) << "time[s]" << std::setw(10) << "GFLOP/s"
+        << std::setw(10) << "GB/s" << "\n";
+      for (const record& r : rs)
+      {
+        const std::string shape = std::to_string(r.rows) + "x" + std::to_string(r.cols);
+        const double s = r.seconds > 0.0 ? r.seconds : 1.0;
+        os << std::left << std::setw(20) << r.name << std::right << std::setw(14) << shape
+          << std::setw(10) << r.calls << std::setw(12) << std::setprecision(4) << std::scientific << r.seconds
+          << std::fixed << std::setprecision(2) << std::setw(10) << r.flops / s * 1e-9
+          << std::setw(10) << r.bytes / s * 1e-9 << "\n";
+      }
+      os.flags(flags);
+    }
+
+
+    // the records as a JSON array
+    inline void json(std::ostream& os)
+    {
+      const std::vector<record> rs = report();
+      const std::streamsize prec = os.precision(17);
+      os << "[";
+      for (size_t i = 0; i < rs.size(); ++i)
+      {
+        const record& r = rs[i];
+        os << (i ? ",\n " : "\n ") << "{\"kernel\": \"" << r.name << "\", \"rows\": " << r.rows
+          << ", \"cols\": " << r.cols << ", \"calls\": " << r.calls << ", \"seconds\": " << r.seconds
+          << ", \"flops\": " << r.flops << ", \"bytes\": " << r.bytes << "}";
+      }
+      os << (rs.empty() ? "]\n" : "\n]\n");
+      os.precision(prec);
+    }
+
+  } // namespace prof
+
+} // namespace igm
+
+#endif // _MATRIX_PROF_H__
@@ -0,0 +1,523 @@
+#ifndef _MATRIX_QR_H__
+#define _MATRIX_QR_H__
+
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+#include <vector>
+#include <algorithm>
+#include "matrix_igm.hpp"
+#include "matrix_lpack_blas.h"
+#include "matrix_arena.h"
+
+// Blocked Householder QR (geqrf/orgqr/ormqr in LAPACK terms).
+// Reflectors are stored below the diagonal of A, R on and above it, and the
+// scalar factors in tau. A block of nb reflectors H = I - V*T*V' is applied
+// in compact WY form so the trailing update runs in gemm.
+// geqp3 is the column pivoted variant (rank revealing, A*P = Q*R): the
+// partial column norms are downdated per step and only recomputed when the
+// downdate cancels, the trailing update of a panel is deferred to one gemm.
+
+namespace igm {
+
+  constexpr size_t qr_block = 32;   // panel width of the outer loop
+  constexpr size_t qr_leaf = 4;     // the recursive panel ends in unblocked code at this width
+
+  namespace detail {
+
+    // scratch shared by panel and trailing updates of one factorization,
+    // taken from the arena of the calling thread
+    template<typename T>
+    struct qr_work {
+      qr_work(const size_t m, const size_t n, const size_t nb)
+        : v(scope.alloc<T>(m*nb)), t(scope.alloc<T>(nb*nb)), w(scope.alloc<T>(nb*std::max(n, nb))) {}
+
+      static size_t bytes(const size_t m, const size_t n, const size_t nb)
+      {
+        return Arena::bytes<T>(m*nb) + Arena::bytes<T>(nb*nb) + Arena::bytes<T>(nb*std::max(n, nb));
+      }
+
+      Workspace scope;
+      T* v;  // V with explicit unit diagonal and zeros above it
+      T* t;  // upper triangular T of the compact WY form
+      T* w;  // nb x n product V'*C
+    };
+
+
+    // generates an elementary reflector H = I - tau*[1; v]*[1; v]' with
+    // H*[alpha; x] = [beta; 0], x is overwritten by v and alpha by beta
+    template<typename T>
+    T larfg(const size_t n, T& alpha, T* x)
+    {
+      const T xnorm2 = simd::sumsq(n, x);
+      if (xnorm2 == T{ 0 })
+        return T{ 0 };
+
+      T beta = std::sqrt(alpha*alpha + xnorm2);
+      if (alpha > T{ 0 })
+        beta = -beta;
+      const T tau = (beta - alpha) / beta;
+      simd::scal(n, T{ 1 } / (alpha - beta), x);
+      alpha = beta;
+      return tau;
+    }
+
+
+    // unblocked QR of the m x n block at a
+    template<typename T>
+    void geqr2(const size_t m, const size_t n, T* a, const size_t lda, T* tau)
+    {
+      const size_t k = std::min(m, n);
+      for (size_t i = 0; i < k; ++i)
+      {
+        T* ai = a + i*lda + i;
+        tau[i] = larfg(m - i - 1, ai[0], ai + 1);
+        if (tau[i] == T{ 0 })
+          continue;
+
+        const T beta = ai[0];
+        ai[0] = T{ 1 };
+        for (size_t j = i + 1; j < n; ++j)
+        {
+          T* aj = a + j*lda + i;
+          const T s = tau[i] * simd::dot(m - i, ai, aj);
+          simd::axpy(m - i, -s, ai, aj);
+        }
+        ai[0] = beta;
+      }
+    }
+
+
+    // copies the k reflectors at a into v (ldv = m) with the implicit unit
+    // diagonal and zero upper part made explicit, then forms T (ldt = k)
+    template<typename T>
+    void larft(const size_t m, const size_t k, const T* a, const size_t lda,
+      const T* tau, T* v, T* t)
+    {
+      for (size_t j = 0; j < k; ++j)
+      {
+        T* vj = v + j*m;
+        std::fill(vj, vj + j, T{ 0 });
+        vj[j] = T{ 1 };
+        std::copy(a + j*lda + j + 1, a + j*lda + m, vj + j + 1);
+      }
+
+      // the strict upper triangle of V'*V in one pass over V, the columns
+      // of T replace it left to right
+      if (k > 1)
+        blas::gemm(CblasTrans, CblasNoTrans, k, k, m, T{ 1 }, v, m, v, m, T{ 0 }, t, k);
+
+      for (size_t j = 0; j < k; ++j)
+      {
+        T* tj = t + j*k;
+        if (j == 0 || tau[j] == T{ 0 }) {
+          std::fill(tj, tj + k, T{ 0 });
+          tj[j] = tau[j];
+          continue;
+        }
+
+        // tj(0:j) = -tau_j * T(0:j, 0:j) * V(j:m, 0:j)' * v_j(j:m)
+        for (size_t l = 0; l < j; ++l)
+          tj[l] *= -tau[j];
+        std::fill(tj + j, tj + k, T{ 0 });
+        tj[j] = tau[j];
+        for (size_t l = 0; l < j; ++l)
+        {
+          T s{ 0 };
+          for (size_t c = l; c < j; ++c)
+            s += t[c*k + l] * tj[c];
+          tj[l] = s;
+        }
+      }
+    }
+
+
+    // C = H*C (trans == false) or C = H'*C with H = I - V*T*V'
+    // V is m x k (ldv = m), C is m x n, w is k x n scratch
+    template<typename T>
+    void larfb(const bool trans, const size_t m, const size_t n, const size_t k,
+      const T* v, const T* t, T* c, const size_t ldc, T* w)
+    {
+      if (n == 0 || k == 0)
+        return;
+
+      blas::gemm(CblasTrans, CblasNoTrans, k, n, m, T{ 1 }, v, m, c, ldc, T{ 0 }, w, k);
+
+      // w = T'*w or w = T*w in place, T is upper triangular
+      for (size_t j = 0; j < n; ++j)
+      {
+        T* wj = w + j*k;
+        if (trans) {
+          for (size_t i = k; i-- > 0;)
+          {
+            T s{ 0 };
+            for (size_t l = 0; l <= i; ++l)
+              s += t[i*k + l] * wj[l];
+            wj[i] = s;
+          }
+        }
+        else {
+          for (size_t i = 0; i < k; ++i)
+          {
+            T s{ 0 };
+            for (size_t l = i; l < k; ++l)
+              s += t[l*k + i] * wj[l];
+            wj[i] = s;
+          }
+        }
+      }
+
+      blas::gemm(CblasNoTrans, CblasNoTrans, m, n, k, T{ -1 }, v, m, w, k, T{ 1 }, c, ldc);
+    }
+
+
+    // recursive panel factorization, the right half is updated by larfb so
+    // even a tall panel spends most of its time in gemm
+    template<typename T>
+    void geqr_rec(const size_t m, const size_t n, T* a, const size_t lda, T* tau,
+      qr_work<T>& ws)
+    {
+      if (n <= qr_leaf || m <= qr_leaf) {
+        geqr2(m, n, a, lda, tau);
+        return;
+      }
+      const size_t n1 = n / 2;
+      const size_t n2 = n - n1;
+      geqr_rec(m, n1, a, lda, tau, ws);
+      larft(m, n1, a, lda, tau, ws.v, ws.t);
+      larfb(true, m, n2, n1, ws.v, ws.t, a + n1*lda, lda, ws.w);
+      geqr_rec(m - n1, n2, a + n1*lda + n1, lda, tau + n1, ws);
+    }
+
+
+    // blocked QR of the m x n block at a, see geqrf
+    template<typename T>
+    void geqrf_at(const size_t m, const size_t n, T* a, const size_t lda, T* t, const size_t nb)
+    {
+      const size_t k = std::min(m, n);
+      if (k == 0)
+        return;
+      qr_work<T> ws(m, n, nb);
+      for (size_t j = 0; j < k; j += nb)
+      {
+        const size_t jb = std::min(nb, k - j);
+        T* ajj = a + j*lda + j;
+        geqr_rec(m - j, jb, ajj, lda, t + j, ws);
+        if (j + jb < n) {
+          larft(m - j, jb, ajj, lda, t + j, ws.v, ws.t);
+          larfb(true, m - j, n - j - jb, jb, ws.v, ws.t,
+            ajj + jb*lda, lda, ws.w);
+        }
+      }
+    }
+
+
+    // the m x n block at c = Q'*c (trans == true) or Q*c, Q of the k
+    // reflectors of geqrf_at at a
+    template<typename T>
+    void ormqr_at(const bool trans, const size_t m, const size_t k, const T* a, const size_t lda,
+      const T* t, const size_t n, T* c, const size_t ldc, const size_t nb)
+    {
+      if (k == 0)
+        return;
+      qr_work<T> ws(m, n, nb);
+      const size_t nblk = (k + nb - 1) / nb;
+      for (size_t b = 0; b < nblk; ++b)
+      {
+        const size_t j = (trans ? b : nblk - 1 - b) * nb;
+        const size_t jb = std::min(nb, k - j);
+        larft(m - j, jb, a + j*lda + j, lda, t + j, ws.v, ws.t);
+        larfb(trans, m - j, n, jb, ws.v, ws.t, c + j, ldc, ws.w);
+      }
+    }
+
+
+
+    // one panel of geqp3 (laqps in LAPACK terms) on the m x n block at a,
+    // the first j columns are factored. Up to nb columns are pivoted and
+    // factored; the panel columns and rows are kept up to date through
+    // F = A'*V*T' (n - j x nb, ldf = n - j), the rest of the trailing
+    // matrix gets one gemm at the end. vn1 holds the partial norms,
+    // vn2 the norms at their last recomputation. The panel stops early
+    // when a downdate cancels, the marked norms are recomputed after the
+    // update. Returns the number of columns factored.
+    template<typename T>
+    size_t laqps(const size_t m, const size_t n, const size_t j, const size_t nb,
+      T* a, const size_t lda, T* tau, size_t* perm, T* vn1, T* vn2, T* f, T* aux)
+    {
+      const size_t ldf = n - j, kmax = std::min(nb, std::min(m, n) - j);
+      const T tol3z = std::sqrt(std::numeric_limits<T>::epsilon());
+      std::fill(f, f + ldf * kmax, T{ 0 });
+      bool recompute = false;
+      size_t k = 0;
+      while (k < kmax && !recompute)
+      {
+        const size_t rk = j + k;
+        T* ak = a + rk * lda;
+
+        // the pivot is the column with the largest partial norm
+        const size_t p = static_cast<size_t>(std::max_element(vn1 + rk, vn1 + n) - vn1);
+        if (p != rk) {
+          std::swap_ranges(a + p * lda, a + p * lda + m, ak);
+          for (size_t c = 0; c < k; ++c)
+            std::swap(f[c * ldf + p - j], f[c * ldf + k]);
+          std::swap(perm[p], perm[rk]);
+          vn1[p] = vn1[rk];
+          vn2[p] = vn2[rk];
+        }
+
+        // A(rk:m, rk) -= A(rk:m, j:rk)*F(k, 0:k)'
+        if (k > 0)
+          blas::gemv(CblasNoTrans, m - rk, k, T{ -1 }, a + j * lda + rk, lda, f + k, ldf,
+            T{ 1 }, ak + rk, size_t{ 1 });
+
+        tau[rk] = larfg(m - rk - 1, ak[rk], ak + rk + 1);
+        const T akk = ak[rk];
+        ak[rk] = T{ 1 };
+
+        // F(k+1:, k) = tau*A(rk:m, rk+1:n)'*v, corrected for the previous
+        // reflectors of the panel: F(:, k) -= tau*F(:, 0:k)*A(rk:m, j:rk)'*v
+        if (rk + 1 < n)
+          blas::gemv(CblasTrans, m - rk, n - rk - 1, tau[rk], ak + lda + rk, lda, ak + rk, size_t{ 1 },
+            T{ 0 }, f + k * ldf + k + 1, size_t{ 1 });
+        if (k > 0) {
+          blas::gemv(CblasTrans, m - rk, k, -tau[rk], a + j * lda + rk, lda, ak + rk, size_t{ 1 },
+            T{ 0 }, aux, size_t{ 1 });
+          blas::gemv(CblasNoTrans, ldf, k, T{ 1 }, f, ldf, aux, size_t{ 1 },
+            T{ 1 }, f + k * ldf, size_t{ 1 });
+        }
+
+        // row rk of the trailing columns: A(rk, rk+1:n) -= A(rk, j:rk+1)*F(k+1:, 0:k+1)'
+        if (rk + 1 < n)
+          blas::gemv(CblasNoTrans, n - rk - 1, k + 1, T{ -1 }, f + k + 1, ldf, a + j * lda + rk, lda,
+            T{ 1 }, ak + lda + rk, lda);
+
+        // downdate the norms with row rk; a column whose norm lost more
+        // than half the digits ends the panel and is recomputed
+        for (size_t c = rk + 1; c < n; ++c)
+        {
+          if (vn1[c] == T{ 0 })
+            continue;
+          T t = std::abs(a[c * lda + rk]) / vn1[c];
+          t = std::max(T{ 0 }, (T{ 1 } + t) * (T{ 1 } - t));
+          const T r = vn1[c] / vn2[c];
+          if (t * r * r <= tol3z) {
+            vn2[c] = T{ -1 };
+            recompute = true;
+          }
+          else
+            vn1[c] *= std::sqrt(t);
+        }
+        ak[rk] = akk;
+        ++k;
+      }
+
+      // A(j+k:m, j+k:n) -= A(j+k:m, j:j+k)*F(k:, 0:k)'
+      const size_t r0 = j + k;
+      if (r0 < m && r0 < n)
+        blas::gemm(CblasNoTrans, CblasTrans, m - r0, n - r0, k, T{ -1 }, a + j * lda + r0, lda,
+          f + k, ldf, T{ 1 }, a + r0 * lda + r0, lda);
+
+      for (size_t c = r0; c < n; ++c)
+      {
+        if (vn2[c] < T{ 0 }) {
+          vn1[c] = r0 < m ? std::sqrt(simd::sumsq(m - r0, a + c * lda + r0)) : T{ 0 };
+          vn2[c] = vn1[c];
+        }
+      }
+      return k;
+    }
+
+  } // namespace detail
+
+
+  // QR factorization of A in place, A may be a sub-view
+  // on exit R is on and above the diagonal, the reflectors below it and
+  // tau(0, i) holds the scalar factors of the min(rows, cols) reflectors
+  template<typename T>
+  void geqrf(Mat<T>& A, Mat<T>& tau, const size_t nb = qr_block)
+  {
+    if (tau.cols() < std::min(A.rows(), A.cols()))
+      throw std::runtime_error("Invalid dimensions in geqrf");
+    IGM_PROF("geqrf", 2 * A.rows() * A.cols() * A.cols(), sizeof(T) * 2 * A.rows() * A.cols(), A.rows(), A.cols());
+    if (A.rows() > 0 && A.cols() > 0)
+      detail::geqrf_at(A.rows(), A.cols(), A.begincol(0), A.lda(), &tau(0, 0), nb);
+  }
+
+
+  // overwrites the factored A (rows >= cols) with the thin Q = H1*H2*...*Hn
+  template<typename T>
+  void orgqr(Mat<T>& A, const Mat<T>& tau, const size_t nb = qr_block)
+  {
+    const size_t m = A.rows();
+    const size_t n = A.cols();
+    if (m < n || tau.cols() < n)
+      throw std::runtime_error("Invalid dimensions in orgqr");
+    if (n == 0)
+      return;
+    IGM_PROF("orgqr", 2 * m * n * n, sizeof(T) * 2 * m * n, m, n);
+
+    T* a = A.begincol(0);
+    const size_t lda = A.lda();
+    const T* t = &tau(0, 0);
+    detail::qr_work<T> ws(m, n, nb);
+
+    // blocks are applied last to first, columns left of a block are still
+    // unit vectors with zeros in the rows the block touches
+    for (size_t b = (n + nb - 1) / nb; b-- > 0;)
+    {
+      const size_t j = b * nb;
+      const size_t jb = std::min(nb, n - j);
+      T* ajj = a + j*lda + j;
+      detail::larft(m - j, jb, ajj, lda, t + j, ws.v, ws.t);
+      detail::larfb(false, m - j, n - j - jb, jb, ws.v, ws.t,
+        ajj + jb*lda, lda, ws.w);
+
+      for (size_t c = 0; c < jb; ++c)
+      {
+        T* ac = a + (j + c)*lda;
+        std::fill(ac, ac + m, T{ 0 });
+        ac[j + c] = T{ 1 };
+      }
+      detail::larfb(false, m - j, jb, jb, ws.v, ws.t, ajj, lda, ws.w);
+    }
+  }
+
+
+  // C = Q'*C (trans == true) or C = Q*C with Q from geqrf stored in A, tau
+  template<typename T>
+  void ormqr(Mat<T>& C, const Mat<T>& A, const Mat<T>& tau, const bool trans = true,
+    const size_t nb = qr_block)
+  {
+    const size_t m = A.rows();
+    const size_t k = std::min(m, A.cols());
+    if (C.rows() != m || tau.cols() < k)
+      throw std::runtime_error("Invalid dimensions in ormqr");
+    IGM_PROF("ormqr", 4 * m * k * C.cols(), sizeof(T) * (m * k + 2 * m * C.cols()), m, C.cols());
+    if (k > 0)
+      detail::ormqr_at(trans, m, k, A.begincol(0), A.lda(), &tau(0, 0), C.cols(), C.begincol(0), C.lda(), nb);
+  }
+
+
+  // column pivoted QR of A in place, A*P = Q*R with |R(i, i)| decreasing;
+  // A, tau as in geqrf, perm (resized to 1 x cols) receives the columns of
+  // the original A in pivot order, so A0.sub(perm) = Q*R
+  template<typename T>
+  void geqp3(Mat<T>& A, Mat<T>& tau, Mat<size_t>& perm, const size_t nb = qr_block)
+  {
+    const size_t m = A.rows(), n = A.cols();
+    const size_t k = std::min(m, n);
+    if (tau.cols() < k)
+      throw std::runtime_error("Invalid dimensions in geqp3");
+    IGM_PROF("geqp3", 2 * m * n * n, sizeof(T) * m * n * (n / 3 + 2), m, n);
+    if (perm.rows() != 1 || perm.cols() != n)
+      perm = Mat<size_t>(1, n, uninit);
+    for (size_t j = 0; j < n; ++j)
+      perm(0, j) = j;
+    if (k == 0)
+      return;
+
+    Workspace ws;
+    T* vn1 = ws.alloc<T>(n);
+    T* vn2 = ws.alloc<T>(n);
+    sumabs2_col(MatView<T>(vn1, 1, n, 1), A.view(), 0);
+    for (size_t j = 0; j < n; ++j)
+      vn2[j] = vn1[j] = std::sqrt(vn1[j]);
+    T* f = ws.alloc<T>(n * nb);
+    T* aux = ws.alloc<T>(nb);
+    for (size_t j = 0; j < k;)
+      j += detail::laqps(m, n, j, nb, A.begincol(0), A.lda(), &tau(0, 0), &perm(0, 0),
+        vn1, vn2, f, aux);
+  }
+
+
+  // numerical rank of a geqp3 factored A (or its R): the number of leading
+  // |R(i, i)| above tol*|R(0, 0)|, tol = 0 takes max(rows, cols)*eps
+  template<typename T>
+  size_t qr_rank(const Mat<T>& A, T tol = T{ 0 })
+  {
+    const size_t k = std::min(A.rows(), A.cols());
+    if (k == 0)
+      return 0;
+    if (tol == T{ 0 })
+      tol = static_cast<T>(std::max(A.rows(), A.cols())) * std::numeric_limits<T>::epsilon();
+    const T r0 = std::abs(A(0, 0));
+    size_t r = 0;
+    while (r < k && std::abs(A(r, r)) > tol * r0)
+      ++r;
+    return r;
+  }
+
+
+  // bytes of arena workspace of geqrf / orgqr / ormqr (with C of n
+  // columns) / geqp3 on an m x n matrix, for Arena::reserve
+  template<typename T>
+  size_t geqrf_workspace(const size_t m, const size_t n, const size_t nb = qr_block)
+  {
+    return detail::qr_work<T>::bytes(m, n, nb);
+  }
+
+  template<typename T>
+  size_t orgqr_workspace(const size_t m, const size_t n, const size_t nb = qr_block)
+  {
+    return detail::qr_work<T>::bytes(m, n, nb);
+  }
+
+  template<typename T>
+  size_t ormqr_workspace(const size_t m, const size_t n, const size_t nb = qr_block)
+  {
+    return detail::qr_work<T>::bytes(m, n, nb);
+  }
+
+  template<typename T>
+  size_t geqp3_workspace(const size_t m, const size_t n, const size_t nb = qr_block)
+  {
+    (void)m;
+    return 2 * Arena::bytes<T>(n) + Arena::bytes<T>(n * nb) + Arena::bytes<T>(nb);
+  }
+
+
+  // copies the upper triangle of the factored A into R (cols x cols)
+  template<typename T>
+  void triu(Mat<T>& R, const Mat<T>& A)
+  {
+    const size_t n = A.cols();
+    if (R.rows() < std::min(A.rows(), n) || R.cols() != n)
+      throw std::runtime_error("Invalid dimensions in triu");
+    for (size_t j = 0; j < n; ++j)
+    {
+      const T* aj = A.begincol(j);
+      T* rj = R.begincol(j);
+      const size_t d = std::min(j + 1, A.rows());
+      std::copy(aj, aj + d, rj);
+      std::fill(rj + d, rj + R.rows(), T{ 0 });
+    }
+  }
+
+
+  // thin QR: Q (rows >= cols) is factored in place into orthonormal columns
+  // and R (cols x cols) receives the upper triangular factor
+  // unlike dpr::mgs, Q is normalized and R carries the diagonal
+  template<typename T>
+  void qr(Mat<T>& Q, Mat<T>& R, const size_t nb = qr_block)
+  {
+    Mat<T> tau(1, Q.cols());
+    geqrf(Q, tau, nb);
+    triu(R, Q);
+    orgqr(Q, tau, nb);
+  }
+
+
+  // thin column pivoted QR: A(:, perm) = Q*R, Q and R as in qr
+  template<typename T>
+  void qrcp(Mat<T>& Q, Mat<T>& R, Mat<size_t>& perm, const size_t nb = qr_block)
+  {
+    Mat<T> tau(1, Q.cols());
+    geqp3(Q, tau, perm, nb);
+    triu(R, Q);
+    orgqr(Q, tau, nb);
+  }
+
+} // namespace igm
+
+#endif // _MATRIX_QR_H__
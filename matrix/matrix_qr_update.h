@@ -0,0 +1,170 @@
+#ifndef _MATRIX_QR_UPDATE_H__
+#define _MATRIX_QR_UPDATE_H__
+
+#include <cmath>
+#include <stdexcept>
+#include <limits>
+#include <algorithm>
+#include "matrix_igm.hpp"
+#include "matrix_lpack_blas.h"
+
+namespace igm {
+
+  // Thin QR of a growing set of selected columns, A(:, idx) = Q*R.
+  // Storage is allocated once for at most maxcols columns; only the first
+  // cols() columns of Q, R and idx are active. Append costs O(rows*cols),
+  // remove and swap re-triangularize R with Givens rotations.
+  template<typename T>
+  class QRUpdate {
+  public:
+    QRUpdate(const size_t rows, const size_t maxcols) : _q(rows, maxcols),
+      _r(maxcols, maxcols), _idx(1, maxcols), _w(1, maxcols) {}
+
+    size_t rows() const { return _q.rows(); }
+    size_t cols() const { return _k; }
+    size_t maxcols() const { return _q.cols(); }
+    bool full() const { return _k == maxcols(); }
+
+    Mat<T>& Q() { return _q; }
+    const Mat<T>& Q() const { return _q; }
+    Mat<T>& R() { return _r; }
+    const Mat<T>& R() const { return _r; }
+    Mat<size_t>& idx() { return _idx; }
+    const Mat<size_t>& idx() const { return _idx; }
+
+    void clear() { _k = 0; }
+    bool append(const T* a, const size_t id);
+    bool append(const Mat<T>& A, const size_t col) { return append(A.begincol(col), col); }
+    void remove(const size_t j);
+    void swap(const size_t i, const size_t j);
+
+  protected:
+    void rotate(const size_t c, const size_t first);
+    void swap_adjacent(const size_t c);
+
+    Mat<T> _q;
+    Mat<T> _r;
+    Mat<size_t> _idx;
+    Mat<T> _w;
+    size_t _k = 0;
+  };
+
+
+  // classical Gram-Schmidt with one reorthogonalization pass, a column that
+  // is numerically dependent on the active set is rejected
+  template<typename T>
+  bool QRUpdate<T>::append(const T* a, const size_t id)
+  {
+    if (full())
+      throw std::runtime_error("QRUpdate is full");
+
+    const size_t m = rows();
+    const size_t ldq = _q.lda();
+    T* q = _q.begincol(_k);
+    T* r = _r.begincol(_k);
+    T* w = _w.begincol(0);
+    std::copy(a, a + m, q);
+    const T anorm = std::sqrt(simd::sumsq(m, q));
+
+    std::fill(r, r + _r.rows(), T{ 0 });
+    for (int pass = 0; pass < 2 && _k > 0; ++pass)
+    {
+      blas::gemm(CblasTrans, CblasNoTrans, _k, 1, m, T{ 1 }, _q.begincol(0), ldq, q, m, T{ 0 }, w, _k);
+      blas::gemm(CblasNoTrans, CblasNoTrans, m, 1, _k, T{ -1 }, _q.begincol(0), ldq, w, _k, T{ 1 }, q, m);
+      for (size_t i = 0; i < _k; ++i)
+        r[i] += w[i];
+    }
+
+    const T rho = std::sqrt(simd::sumsq(m, q));
+    if (rho <= anorm * static_cast<T>(m) * std::numeric_limits<T>::epsilon())
+      return false;
+
+    simd::scal(m, T{ 1 } / rho, q);
+    r[_k] = rho;
+    _idx(0, _k) = id;
+    ++_k;
+    return true;
+  }
+
+
+  // drops active column j, the Hessenberg part left in R is annihilated by
+  // rotations which are also applied to the columns of Q
+  template<typename T>
+  void QRUpdate<T>::remove(const size_t j)
+  {
+    if (j >= _k)
+      throw std::runtime_error("Invalid column in QRUpdate::remove");
+
+    for (size_t c = j; c + 1 < _k; ++c)
+    {
+      std::copy(_r.begincol(c + 1), _r.begincol(c + 1) + c + 2, _r.begincol(c));
+      _idx(0, c) = _idx(0, c + 1);
+    }
+    --_k;
+    for (size_t c = j; c < _k; ++c)
+      rotate(c, c);
+  }
+
+
+  // exchanges active columns i and j by a chain of adjacent swaps
+  template<typename T>
+  void QRUpdate<T>::swap(const size_t i, const size_t j)
+  {
+    if (i >= _k || j >= _k)
+      throw std::runtime_error("Invalid column in QRUpdate::swap");
+    if (i == j)
+      return;
+    const size_t lo = std::min(i, j);
+    const size_t hi = std::max(i, j);
+    for (size_t c = hi; c-- > lo;)
+      swap_adjacent(c);
+    for (size_t c = lo + 1; c < hi; ++c)
+      swap_adjacent(c);
+  }
+
+
+  // Givens rotation of rows c, c+1 zeroing R(c+1, first), R is updated in
+  // columns first..cols()-1 and the rotation is undone on Q(:, c:c+1)
+  template<typename T>
+  void QRUpdate<T>::rotate(const size_t c, const size_t first)
+  {
+    const T a = _r(c, first);
+    const T b = _r(c + 1, first);
+    const T h = std::hypot(a, b);
+    if (h == T{ 0 })
+      return;
+    const T cs = a / h;
+    const T sn = b / h;
+
+    for (size_t l = first; l < _k; ++l)
+    {
+      const T x = _r(c, l);
+      const T y = _r(c + 1, l);
+      _r(c, l) = cs * x + sn * y;
+      _r(c + 1, l) = cs * y - sn * x;
+    }
+    _r(c + 1, first) = T{ 0 };
+
+    T* q0 = _q.begincol(c);
+    T* q1 = _q.begincol(c + 1);
+    for (size_t i = 0; i < rows(); ++i)
+    {
+      const T x = q0[i];
+      const T y = q1[i];
+      q0[i] = cs * x + sn * y;
+      q1[i] = cs * y - sn * x;
+    }
+  }
+
+
+  template<typename T>
+  void QRUpdate<T>::swap_adjacent(const size_t c)
+  {
+    std::swap_ranges(_r.begincol(c), _r.begincol(c) + c + 2, _r.begincol(c + 1));
+    std::swap(_idx(0, c), _idx(0, c + 1));
+    rotate(c, c);
+  }
+
+} // namespace igm
+
+#endif // _MATRIX_QR_UPDATE_H__
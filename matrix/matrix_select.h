@@ -0,0 +1,204 @@
+#ifndef _MATRIX_SELECT_H__
+#define _MATRIX_SELECT_H__
+
+#include <cmath>
+#include <chrono>
+#include <limits>
+#include <algorithm>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+#include "matrix_igm.hpp"
+#include "matrix_simd.h"
+#include "matrix_lpack_blas.h"
+#include "matrix_trsm.h"
+
+// Greedy forward selection (orthogonal matching pursuit / forward
+// regression) of columns of A to fit y. The working copy Q of A keeps the
+// selected columns in front, orthogonalized by modified Gram-Schmidt
+// (not normalized); the other columns are kept orthogonal to them, so
+//   A(:, perm(0:k)) = Q(:, 0:k) * U,  U unit upper triangular (R(0:k, 0:k)).
+// For every candidate j the solver keeps |q_j|^2 and the correlation
+// q_j'*r with the residual r (equal to a_j'*r, r being orthogonal to the
+// selected columns). A step takes the column with the largest reduction
+// of the residual, (q_j'*r)^2 / |q_j|^2, and updates Q with the special
+// view gemv/ger of matrix_lpack_blas.h; norms and correlations are
+// downdated in O(n), a norm is recomputed when the downdate cancels.
+// Every step is O(m*n) and allocates nothing.
+
+namespace igm {
+
+  template<typename T>
+  class ForwardSelect {
+  public:
+    struct step_info {
+      size_t col;       // selected column of A
+      T residual;       // |r| after the step
+      double time;      // seconds of the step
+    };
+
+    // A is copied, y is a vector of A.rows(); at most max_cols (0: all
+    // possible) columns are selected
+    ForwardSelect(const Mat<T>& A, const Mat<T>& y, const size_t max_cols = 0)
+      : ForwardSelect(Mat<T>(A), y, max_cols) {}
+
+    // A's buffer becomes the working copy
+    ForwardSelect(Mat<T>&& A, const Mat<T>& y, const size_t max_cols = 0)
+      : _q(std::move(A))
+    {
+      const size_t m = _q.rows(), n = _q.cols();
+      if (vec_len(y.view()) != m)
+        throw std::runtime_error("Invalid dimensions in ForwardSelect");
+      _kmax = std::min(m, n);
+      if (max_cols > 0)
+        _kmax = std::min(_kmax, max_cols);
+      _r = Mat<T>(m, 1, uninit);
+      const size_t inc = vec_inc(y.view());
+      for (size_t i = 0; i < m; ++i)
+        _r(i, 0) = y.view().data()[i * inc];
+      _R = Mat<T>(_kmax, n);
+      _c = Mat<T>(1, _kmax);
+      _perm = Mat<size_t>(1, n, uninit);
+      for (size_t j = 0; j < n; ++j)
+        _perm(0, j) = j;
+      _nrm = Mat<T>(1, n, uninit);
+      _base = Mat<T>(1, n, uninit);
+      _orig = Mat<T>(1, n, uninit);
+      _corr = Mat<T>(1, n, uninit);
+      sumabs2_col(_nrm, _q, 0);
+      blas::gemv(_corr, _q, _r);
+      for (size_t j = 0; j < n; ++j)
+        _base(0, j) = _orig(0, j) = _nrm(0, j);
+      _rr0 = simd::sumsq(m, _r.begincol(0));
+      _rr = _rr0;
+      _steps.reserve(_kmax);
+    }
+
+    // selects one more column; false when none is left which reduces the
+    // residual (all selected, max_cols reached, or the rest dependent)
+    bool step()
+    {
+      const auto t0 = std::chrono::steady_clock::now();
+      const size_t m = _q.rows(), n = _q.cols(), k = _k;
+      if (k == _kmax)
+        return false;
+      IGM_PROF("ForwardSelect::step", 4 * m * (n - k), sizeof(T) * 3 * m * (n - k), m, n);
+
+      // the candidate with the largest reduction of |r|^2
+      const T eps = std::numeric_limits<T>::epsilon();
+      size_t p = n;
+      T best{ 0 };
+      for (size_t j = k; j < n; ++j)
+      {
+        const T nj = _nrm(0, j);
+        if (!(nj > n * n * eps * eps * _orig(0, j)))
+          continue;
+        const T g = _corr(0, j) * _corr(0, j) / nj;
+        if (g > best) {
+          best = g;
+          p = j;
+        }
+      }
+      if (p == n)
+        return false;
+
+      // the selected column moves to position k
+      if (p != k) {
+        _q.swapcols(k, p);
+        _R.swapcols(k, p);
+        std::swap(_perm(0, k), _perm(0, p));
+        std::swap(_nrm(0, k), _nrm(0, p));
+        std::swap(_base(0, k), _base(0, p));
+        std::swap(_orig(0, k), _orig(0, p));
+        std::swap(_corr(0, k), _corr(0, p));
+      }
+
+      // r -= c*q_k, then the candidates are orthogonalized against q_k:
+      // R(k, j) = q_k'*q_j / |q_k|^2, q_j -= R(k, j)*q_k
+      const T nk = _nrm(0, k), ck = _corr(0, k), c = ck / nk;
+      _c(0, k) = c;
+      _R(k, k) = T{ 1 };
+      simd::axpy(m, -c, _q.begincol(k), _r.begincol(0));
+      if (k + 1 < n) {
+        const MatView<T> qv = _q.view(0, m - 1, k + 1, n - 1);
+        const MatView<T> rk = _R.view(k, k, k + 1, n - 1);
+        blas::gemv(rk, qv, T{ 1 } / nk);
+        blas::ger(qv, rk, T{ -1 });
+      }
+
+      // downdates, recomputed where more than half the digits cancel
+      const T tol = std::sqrt(eps);
+      for (size_t j = k + 1; j < n; ++j)
+      {
+        const T rkj = _R(k, j);
+        _nrm(0, j) -= rkj * rkj * nk;
+        _corr(0, j) -= rkj * ck;
+        if (_nrm(0, j) <= tol * _base(0, j)) {
+          _nrm(0, j) = simd::sumsq(m, _q.begincol(j));
+          _base(0, j) = _nrm(0, j);
+          _corr(0, j) = simd::dot(m, _q.begincol(j), _r.begincol(0));
+        }
+      }
+      _corr(0, k) = T{ 0 };
+
+      _k = k + 1;
+      _rr = simd::sumsq(m, _r.begincol(0));
+      _steps.push_back({ _perm(0, k), std::sqrt(_rr),
+        std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count() });
+      return true;
+    }
+
+    // steps until k columns are selected (0: max_cols) or |r| <= tol*|y|;
+    // returns the number of selected columns
+    size_t run(const size_t k = 0, const T tol = T{ 0 })
+    {
+      const size_t kk = k == 0 ? _kmax : std::min(k, _kmax);
+      while (_k < kk && _rr > tol * tol * _rr0 && step())
+        ;
+      return _k;
+    }
+
+    size_t size() const { return _k; }
+    size_t max_cols() const { return _kmax; }
+
+    // columns of A in the order of selection, the first size() are selected
+    const Mat<size_t>& perm() const { return _perm; }
+
+    const Mat<T>& residual() const { return _r; }
+    T residual_norm() const { return std::sqrt(_rr); }
+
+    // timings and residuals of the steps done so far
+    const std::vector<step_info>& steps() const { return _steps; }
+
+    // size() x 1 least squares coefficients of the selected columns, in
+    // the order of perm(): x = U \ c
+    Mat<T> coef() const
+    {
+      Mat<T> x(_k, 1, uninit);
+      for (size_t i = 0; i < _k; ++i)
+        x(i, 0) = _c(0, i);
+      if (_k > 0)
+        trsm(_R.view(0, _k - 1, 0, _k - 1), x.view(), uplo::upper, false, diag::unit);
+      return x;
+    }
+
+  private:
+    Mat<T> _q;          // working copy of A, columns permuted
+    Mat<T> _r;          // residual
+    Mat<T> _R;          // max_cols x n, row k holds the projections onto q_k
+    Mat<T> _c;          // coefficients of y on q_0 ... q_k
+    Mat<size_t> _perm;
+    Mat<T> _nrm;        // |q_j|^2, downdated
+    Mat<T> _base;       // |q_j|^2 at the last recomputation
+    Mat<T> _orig;       // |a_j|^2
+    Mat<T> _corr;       // q_j'*r, downdated
+    size_t _k = 0;
+    size_t _kmax = 0;
+    T _rr0{ 0 };        // |y|^2
+    T _rr{ 0 };         // |r|^2
+    std::vector<step_info> _steps;
+  };
+
+} // namespace igm
+
+#endif // _MATRIX_SELECT_H__
@@ -0,0 +1,397 @@
+#ifndef _MATRIX_SIMD_H__
+#define _MATRIX_SIMD_H__
+
+#include <cstddef>
+#include <cstdint>
+#include <numeric>
+#include <algorithm>
+
+// Vector kernels (dot, sum of squares, sum, axpy, scal, streaming copy)
+// for float and double in SSE2, AVX2/FMA and AVX-512 variants. The variant
+// is chosen at run time from CPUID, so the library itself is compiled for
+// the baseline target.
+// Other element types use the generic std algorithms.
+// IGM_NO_SIMD restricts everything to the portable scalar kernels.
+
+#if !defined(IGM_NO_SIMD) && (defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86))
+#define IGM_SIMD_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+// functions between BEGIN and END are compiled for the given instruction
+// set; MSVC emits any intrinsic without a switch
+#define IGM_PRAGMA(x) _Pragma(#x)
+#if defined(__clang__)
+#define IGM_SIMD_BEGIN(isa) IGM_PRAGMA(clang attribute push(__attribute__((target(isa))), apply_to = function))
+#define IGM_SIMD_END IGM_PRAGMA(clang attribute pop)
+#elif defined(__GNUC__)
+#define IGM_SIMD_BEGIN(isa) IGM_PRAGMA(GCC push_options) IGM_PRAGMA(GCC target(isa))
+#define IGM_SIMD_END IGM_PRAGMA(GCC pop_options)
+#else
+#define IGM_SIMD_BEGIN(isa)
+#define IGM_SIMD_END
+#endif
+
+namespace igm {
+  namespace simd {
+
+    enum class isa { scalar, sse2, avx2, avx512 };
+
+    inline const char* isa_name(const isa level)
+    {
+      switch (level) {
+      case isa::sse2: return "sse2";
+      case isa::avx2: return "avx2";
+      case isa::avx512: return "avx512";
+      default: return "scalar";
+      }
+    }
+
+    template<typename T>
+    struct kernels {
+      T(*dot)(size_t, const T*, const T*);
+      T(*sumsq)(size_t, const T*);
+      T(*sum)(size_t, const T*);
+      void(*axpy)(size_t, T, const T*, T*);
+      void(*scal)(size_t, T, T*);
+      void(*stream_copy)(size_t, const T*, T*);
+    };
+
+
+    namespace scalar {
+      template<typename E>
+      struct vec {
+        using T = E;
+        using R = E;
+        static constexpr size_t w = 1;
+        static R zero() { return T{ 0 }; }
+        static R set1(const T a) { return a; }
+        static R load(const T* p) { return *p; }
+        static void store(T* p, const R a) { *p = a; }
+        static void stream(T* p, const R a) { *p = a; }
+        static void fence() {}
+        static R add(const R a, const R b) { return a + b; }
+        static R mul(const R a, const R b) { return a * b; }
+        static R fmadd(const R a, const R b, const R c) { return a * b + c; }
+        static T hsum(const R a) { return a; }
+      };
+#include "matrix_simd_kernels.h"
+    } // namespace scalar
+
+
+#ifdef IGM_SIMD_X86
+    IGM_SIMD_BEGIN("sse2")
+    namespace sse2 {
+      template<typename E> struct vec;
+
+      template<>
+      struct vec<double> {
+        using T = double;
+        using R = __m128d;
+        static constexpr size_t w = 2;
+        static R zero() { return _mm_setzero_pd(); }
+        static R set1(const T a) { return _mm_set1_pd(a); }
+        static R load(const T* p) { return _mm_loadu_pd(p); }
+        static void store(T* p, const R a) { _mm_storeu_pd(p, a); }
+        static void stream(T* p, const R a) { _mm_stream_pd(p, a); }
+        static void fence() { _mm_sfence(); }
+        static R add(const R a, const R b) { return _mm_add_pd(a, b); }
+        static R mul(const R a, const R b) { return _mm_mul_pd(a, b); }
+        static R fmadd(const R a, const R b, const R c) { return _mm_add_pd(_mm_mul_pd(a, b), c); }
+        static T hsum(const R a) { return _mm_cvtsd_f64(_mm_add_sd(a, _mm_unpackhi_pd(a, a))); }
+      };
+
+      template<>
+      struct vec<float> {
+        using T = float;
+        using R = __m128;
+        static constexpr size_t w = 4;
+        static R zero() { return _mm_setzero_ps(); }
+        static R set1(const T a) { return _mm_set1_ps(a); }
+        static R load(const T* p) { return _mm_loadu_ps(p); }
+        static void store(T* p, const R a) { _mm_storeu_ps(p, a); }
+        static void stream(T* p, const R a) { _mm_stream_ps(p, a); }
+        static void fence() { _mm_sfence(); }
+        static R add(const R a, const R b) { return _mm_add_ps(a, b); }
+        static R mul(const R a, const R b) { return _mm_mul_ps(a, b); }
+        static R fmadd(const R a, const R b, const R c) { return _mm_add_ps(_mm_mul_ps(a, b), c); }
+        static T hsum(const R a)
+        {
+          const R s = _mm_add_ps(a, _mm_movehl_ps(a, a));
+          return _mm_cvtss_f32(_mm_add_ss(s, _mm_shuffle_ps(s, s, 1)));
+        }
+      };
+#include "matrix_simd_kernels.h"
+    } // namespace sse2
+    IGM_SIMD_END
+
+
+    IGM_SIMD_BEGIN("avx2,fma")
+    namespace avx2 {
+      template<typename E> struct vec;
+
+      template<>
+      struct vec<double> {
+        using T = double;
+        using R = __m256d;
+        static constexpr size_t w = 4;
+        static R zero() { return _mm256_setzero_pd(); }
+        static R set1(const T a) { return _mm256_set1_pd(a); }
+        static R load(const T* p) { return _mm256_loadu_pd(p); }
+        static void store(T* p, const R a) { _mm256_storeu_pd(p, a); }
+        static void stream(T* p, const R a) { _mm256_stream_pd(p, a); }
+        static void fence() { _mm_sfence(); }
+        static R add(const R a, const R b) { return _mm256_add_pd(a, b); }
+        static R mul(const R a, const R b) { return _mm256_mul_pd(a, b); }
+        static R fmadd(const R a, const R b, const R c) { return _mm256_fmadd_pd(a, b, c); }
+        static T hsum(const R a)
+        {
+          const __m128d s = _mm_add_pd(_mm256_castpd256_pd128(a), _mm256_extractf128_pd(a, 1));
+          return _mm_cvtsd_f64(_mm_add_sd(s, _mm_unpackhi_pd(s, s)));
+        }
+      };
+
+      template<>
+      struct vec<float> {
+        using T = float;
+        using R = __m256;
+        static constexpr size_t w = 8;
+        static R zero() { return _mm256_setzero_ps(); }
+        static R set1(const T a) { return _mm256_set1_ps(a); }
+        static R load(const T* p) { return _mm256_loadu_ps(p); }
+        static void store(T* p, const R a) { _mm256_storeu_ps(p, a); }
+        static void stream(T* p, const R a) { _mm256_stream_ps(p, a); }
+        static void fence() { _mm_sfence(); }
+        static R add(const R a, const R b) { return _mm256_add_ps(a, b); }
+        static R mul(const R a, const R b) { return _mm256_mul_ps(a, b); }
+        static R fmadd(const R a, const R b, const R c) { return _mm256_fmadd_ps(a, b, c); }
+        static T hsum(const R a)
+        {
+          __m128 s = _mm_add_ps(_mm256_castps256_ps128(a), _mm256_extractf128_ps(a, 1));
+          s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+          return _mm_cvtss_f32(_mm_add_ss(s, _mm_shuffle_ps(s, s, 1)));
+        }
+      };
+#include "matrix_simd_kernels.h"
+    } // namespace avx2
+    IGM_SIMD_END
+
+
+    IGM_SIMD_BEGIN("avx512f")
+    namespace avx512 {
+      template<typename E> struct vec;
+
+      template<>
+      struct vec<double> {
+        using T = double;
+        using R = __m512d;
+        static constexpr size_t w = 8;
+        static R zero() { return _mm512_setzero_pd(); }
+        static R set1(const T a) { return _mm512_set1_pd(a); }
+        static R load(const T* p) { return _mm512_loadu_pd(p); }
+        static void store(T* p, const R a) { _mm512_storeu_pd(p, a); }
+        static void stream(T* p, const R a) { _mm512_stream_pd(p, a); }
+        static void fence() { _mm_sfence(); }
+        static R add(const R a, const R b) { return _mm512_add_pd(a, b); }
+        static R mul(const R a, const R b) { return _mm512_mul_pd(a, b); }
+        static R fmadd(const R a, const R b, const R c) { return _mm512_fmadd_pd(a, b, c); }
+        // through memory, the 512 bit extracts trip -Wuninitialized in gcc 12
+        static T hsum(const R a)
+        {
+          alignas(64) T b[w];
+          _mm512_store_pd(b, a);
+          return ((b[0] + b[4]) + (b[1] + b[5])) + ((b[2] + b[6]) + (b[3] + b[7]));
+        }
+      };
+
+      template<>
+      struct vec<float> {
+        using T = float;
+        using R = __m512;
+        static constexpr size_t w = 16;
+        static R zero() { return _mm512_setzero_ps(); }
+        static R set1(const T a) { return _mm512_set1_ps(a); }
+        static R load(const T* p) { return _mm512_loadu_ps(p); }
+        static void store(T* p, const R a) { _mm512_storeu_ps(p, a); }
+        static void stream(T* p, const R a) { _mm512_stream_ps(p, a); }
+        static void fence() { _mm_sfence(); }
+        static R add(const R a, const R b) { return _mm512_add_ps(a, b); }
+        static R mul(const R a, const R b) { return _mm512_mul_ps(a, b); }
+        static R fmadd(const R a, const R b, const R c) { return _mm512_fmadd_ps(a, b, c); }
+        static T hsum(const R a)
+        {
+          alignas(64) T b[w];
+          _mm512_store_ps(b, a);
+          for (size_t k = w / 2; k > 0; k /= 2)
+            for (size_t i = 0; i < k; ++i)
+              b[i] += b[i + k];
+          return b[0];
+        }
+      };
+#include "matrix_simd_kernels.h"
+    } // namespace avx512
+    IGM_SIMD_END
+#endif // IGM_SIMD_X86
+
+
+    namespace detail {
+
+#ifdef IGM_SIMD_X86
+      inline void cpuid(int r[4], const int leaf, const int sub)
+      {
+#ifdef _MSC_VER
+        __cpuidex(r, leaf, sub);
+#else
+        unsigned a, b, c, d;
+        __cpuid_count(leaf, sub, a, b, c, d);
+        r[0] = static_cast<int>(a);
+        r[1] = static_cast<int>(b);
+        r[2] = static_cast<int>(c);
+        r[3] = static_cast<int>(d);
+#endif
+      }
+
+      // register state enabled by the OS
+      inline unsigned long long xcr0()
+      {
+#ifdef _MSC_VER
+        return _xgetbv(0);
+#else
+        unsigned lo, hi;
+        __asm__ volatile("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+        return static_cast<unsigned long long>(hi) << 32 | lo;
+#endif
+      }
+#endif
+
+      inline isa detect()
+      {
+#ifdef IGM_SIMD_X86
+        int r[4];
+        cpuid(r, 0, 0);
+        const int nleaf = r[0];
+        cpuid(r, 1, 0);
+        if (!(r[3] & (1 << 26)))
+          return isa::scalar;
+        const bool fma = (r[2] & (1 << 12)) != 0;
+        const bool osxsave = (r[2] & (1 << 27)) != 0;
+        const bool avx = (r[2] & (1 << 28)) != 0;
+        if (nleaf < 7 || !osxsave || !avx || (xcr0() & 0x6) != 0x6)
+          return isa::sse2;
+
+        cpuid(r, 7, 0);
+        const bool avx2 = (r[1] & (1 << 5)) != 0;
+        const bool avx512f = (r[1] & (1 << 16)) != 0;
+        if (!avx2 || !fma)
+          return isa::sse2;
+        if (avx512f && (xcr0() & 0xe0) == 0xe0)
+          return isa::avx512;
+        return isa::avx2;
+#else
+        return isa::scalar;
+#endif
+      }
+
+    } // namespace detail
+
+
+    // best instruction set of this cpu, detected once
+    inline isa cpu_isa()
+    {
+      static const isa level = detail::detect();
+      return level;
+    }
+
+    // kernels of one instruction set, level must not exceed cpu_isa()
+    template<typename T>
+    kernels<T> kernels_for(const isa level)
+    {
+#ifdef IGM_SIMD_X86
+      switch (level) {
+      case isa::sse2: return sse2::table<sse2::vec<T>>();
+      case isa::avx2: return avx2::table<avx2::vec<T>>();
+      case isa::avx512: return avx512::table<avx512::vec<T>>();
+      default: break;
+      }
+#endif
+      return scalar::table<scalar::vec<T>>();
+    }
+
+
+    namespace detail {
+      inline isa& active_isa()
+      {
+        static isa level = cpu_isa();
+        return level;
+      }
+
+      template<typename T>
+      kernels<T>& active()
+      {
+        static kernels<T> k = kernels_for<T>(active_isa());
+        return k;
+      }
+    } // namespace detail
+
+    inline isa current_isa() { return detail::active_isa(); }
+
+    // restricts the kernels to a lower instruction set, e.g. to compare them;
+    // not thread safe, call it while no kernel runs
+    inline void set_isa(const isa level)
+    {
+      detail::active_isa() = std::min(level, cpu_isa());
+      detail::active<float>() = kernels_for<float>(detail::active_isa());
+      detail::active<double>() = kernels_for<double>(detail::active_isa());
+    }
+
+
+    template<typename T>
+    T dot(const size_t n, const T* x, const T* y) { return std::inner_product(x, x + n, y, T{ 0 }); }
+    inline float dot(const size_t n, const float* x, const float* y) { return detail::active<float>().dot(n, x, y); }
+    inline double dot(const size_t n, const double* x, const double* y) { return detail::active<double>().dot(n, x, y); }
+
+    template<typename T>
+    T sumsq(const size_t n, const T* x) { return std::inner_product(x, x + n, x, T{ 0 }); }
+    inline float sumsq(const size_t n, const float* x) { return detail::active<float>().sumsq(n, x); }
+    inline double sumsq(const size_t n, const double* x) { return detail::active<double>().sumsq(n, x); }
+
+    template<typename T>
+    T sum(const size_t n, const T* x) { return std::accumulate(x, x + n, T{ 0 }); }
+    inline float sum(const size_t n, const float* x) { return detail::active<float>().sum(n, x); }
+    inline double sum(const size_t n, const double* x) { return detail::active<double>().sum(n, x); }
+
+    // y = a*x + y
+    template<typename T>
+    void axpy(const size_t n, const T a, const T* x, T* y)
+    {
+      for (size_t i = 0; i < n; ++i)
+        y[i] += a * x[i];
+    }
+    inline void axpy(const size_t n, const float a, const float* x, float* y) { detail::active<float>().axpy(n, a, x, y); }
+    inline void axpy(const size_t n, const double a, const double* x, double* y) { detail::active<double>().axpy(n, a, x, y); }
+
+    // x = a*x
+    template<typename T>
+    void scal(const size_t n, const T a, T* x)
+    {
+      for (size_t i = 0; i < n; ++i)
+        x[i] *= a;
+    }
+    inline void scal(const size_t n, const float a, float* x) { detail::active<float>().scal(n, a, x); }
+    inline void scal(const size_t n, const double a, double* x) { detail::active<double>().scal(n, a, x); }
+
+    // y = x, written with non-temporal stores which bypass the cache
+    template<typename T>
+    void stream_copy(const size_t n, const T* x, T* y) { std::copy(x, x + n, y); }
+    inline void stream_copy(const size_t n, const float* x, float* y) { detail::active<float>().stream_copy(n, x, y); }
+    inline void stream_copy(const size_t n, const double* x, double* y) { detail::active<double>().stream_copy(n, x, y); }
+
+  } // namespace simd
+} // namespace igm
+
+#endif // _MATRIX_SIMD_H__
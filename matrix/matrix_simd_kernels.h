@@ -0,0 +1,163 @@
+// Bodies of the kernels of matrix_simd.h, written once for any register
+// type. The file is included by matrix_simd.h inside the namespace and the
+// target region of each instruction set, so it has no include guard.
+// V provides for one element type T:
+//   R, w                    register type and its number of elements
+//   zero, set1, load, store unaligned access
+//   stream, fence           aligned non-temporal store, ordering of the stores
+//   add, mul, fmadd         fmadd(a, b, c) = a*b + c
+//   hsum                    sum of the elements of a register
+// The reductions keep four independent accumulators to hide the latency
+// of the add/fma chain; the tail is done in scalar code.
+
+template<typename V>
+typename V::T dot(const size_t n, const typename V::T* x, const typename V::T* y)
+{
+  using R = typename V::R;
+  const size_t w = V::w;
+  R s0 = V::zero(), s1 = V::zero(), s2 = V::zero(), s3 = V::zero();
+  size_t i = 0;
+  for (; i + 4 * w <= n; i += 4 * w)
+  {
+    s0 = V::fmadd(V::load(x + i), V::load(y + i), s0);
+    s1 = V::fmadd(V::load(x + i + w), V::load(y + i + w), s1);
+    s2 = V::fmadd(V::load(x + i + 2 * w), V::load(y + i + 2 * w), s2);
+    s3 = V::fmadd(V::load(x + i + 3 * w), V::load(y + i + 3 * w), s3);
+  }
+  for (; i + w <= n; i += w)
+    s0 = V::fmadd(V::load(x + i), V::load(y + i), s0);
+  typename V::T s = V::hsum(V::add(V::add(s0, s1), V::add(s2, s3)));
+  for (; i < n; ++i)
+    s += x[i] * y[i];
+  return s;
+}
+
+
+template<typename V>
+typename V::T sumsq(const size_t n, const typename V::T* x)
+{
+  using R = typename V::R;
+  const size_t w = V::w;
+  R s0 = V::zero(), s1 = V::zero(), s2 = V::zero(), s3 = V::zero();
+  size_t i = 0;
+  for (; i + 4 * w <= n; i += 4 * w)
+  {
+    const R a0 = V::load(x + i);
+    const R a1 = V::load(x + i + w);
+    const R a2 = V::load(x + i + 2 * w);
+    const R a3 = V::load(x + i + 3 * w);
+    s0 = V::fmadd(a0, a0, s0);
+    s1 = V::fmadd(a1, a1, s1);
+    s2 = V::fmadd(a2, a2, s2);
+    s3 = V::fmadd(a3, a3, s3);
+  }
+  for (; i + w <= n; i += w)
+  {
+    const R a = V::load(x + i);
+    s0 = V::fmadd(a, a, s0);
+  }
+  typename V::T s = V::hsum(V::add(V::add(s0, s1), V::add(s2, s3)));
+  for (; i < n; ++i)
+    s += x[i] * x[i];
+  return s;
+}
+
+
+template<typename V>
+typename V::T sum(const size_t n, const typename V::T* x)
+{
+  using R = typename V::R;
+  const size_t w = V::w;
+  R s0 = V::zero(), s1 = V::zero(), s2 = V::zero(), s3 = V::zero();
+  size_t i = 0;
+  for (; i + 4 * w <= n; i += 4 * w)
+  {
+    s0 = V::add(V::load(x + i), s0);
+    s1 = V::add(V::load(x + i + w), s1);
+    s2 = V::add(V::load(x + i + 2 * w), s2);
+    s3 = V::add(V::load(x + i + 3 * w), s3);
+  }
+  for (; i + w <= n; i += w)
+    s0 = V::add(V::load(x + i), s0);
+  typename V::T s = V::hsum(V::add(V::add(s0, s1), V::add(s2, s3)));
+  for (; i < n; ++i)
+    s += x[i];
+  return s;
+}
+
+
+// y = a*x + y
+template<typename V>
+void axpy(const size_t n, const typename V::T a, const typename V::T* x, typename V::T* y)
+{
+  using R = typename V::R;
+  const size_t w = V::w;
+  const R va = V::set1(a);
+  size_t i = 0;
+  for (; i + 4 * w <= n; i += 4 * w)
+  {
+    V::store(y + i, V::fmadd(va, V::load(x + i), V::load(y + i)));
+    V::store(y + i + w, V::fmadd(va, V::load(x + i + w), V::load(y + i + w)));
+    V::store(y + i + 2 * w, V::fmadd(va, V::load(x + i + 2 * w), V::load(y + i + 2 * w)));
+    V::store(y + i + 3 * w, V::fmadd(va, V::load(x + i + 3 * w), V::load(y + i + 3 * w)));
+  }
+  for (; i + w <= n; i += w)
+    V::store(y + i, V::fmadd(va, V::load(x + i), V::load(y + i)));
+  for (; i < n; ++i)
+    y[i] += a * x[i];
+}
+
+
+// x = a*x
+template<typename V>
+void scal(const size_t n, const typename V::T a, typename V::T* x)
+{
+  using R = typename V::R;
+  const size_t w = V::w;
+  const R va = V::set1(a);
+  size_t i = 0;
+  for (; i + 4 * w <= n; i += 4 * w)
+  {
+    V::store(x + i, V::mul(va, V::load(x + i)));
+    V::store(x + i + w, V::mul(va, V::load(x + i + w)));
+    V::store(x + i + 2 * w, V::mul(va, V::load(x + i + 2 * w)));
+    V::store(x + i + 3 * w, V::mul(va, V::load(x + i + 3 * w)));
+  }
+  for (; i + w <= n; i += w)
+    V::store(x + i, V::mul(va, V::load(x + i)));
+  for (; i < n; ++i)
+    x[i] *= a;
+}
+
+
+// y = x with non-temporal stores, for a destination larger than the cache
+// which is not read soon; the stores start at the first register aligned
+// element of y
+template<typename V>
+void stream_copy(const size_t n, const typename V::T* x, typename V::T* y)
+{
+  using T = typename V::T;
+  const size_t w = V::w;
+  size_t i = 0;
+  for (; i < n && reinterpret_cast<std::uintptr_t>(y + i) % (w * sizeof(T)) != 0; ++i)
+    y[i] = x[i];
+  for (; i + 4 * w <= n; i += 4 * w)
+  {
+    V::stream(y + i, V::load(x + i));
+    V::stream(y + i + w, V::load(x + i + w));
+    V::stream(y + i + 2 * w, V::load(x + i + 2 * w));
+    V::stream(y + i + 3 * w, V::load(x + i + 3 * w));
+  }
+  for (; i + w <= n; i += w)
+    V::stream(y + i, V::load(x + i));
+  V::fence();
+  for (; i < n; ++i)
+    y[i] = x[i];
+}
+
+
+template<typename V>
+kernels<typename V::T> table()
+{
+  return { &dot<V>, &sumsq<V>, &sum<V>, &axpy<V>, &scal<V>, &stream_copy<V> };
+}
@@ -0,0 +1,433 @@
+#ifndef _MATRIX_SPARSE_H__
+#define _MATRIX_SPARSE_H__
+
+#include <cstddef>
+#include <cmath>
+#include <vector>
+#include <algorithm>
+#include <stdexcept>
+#include <omp.h>
+#include "matrix_igm.hpp"
+#include "matrix_arena.h"
+
+// Compressed sparse column matrices. SparseMat stores for column j the row
+// indices (ascending) and values of its nonzeros in
+// rowidx/values[colptr[j] ... colptr[j+1]), so memory and the time of the
+// kernels grow with the nonzeros, not with rows x cols. It is built from
+// (row, col, value) triplets, duplicates summed, or from a dense matrix.
+// The kernels take dense operands as views like their dense counterparts:
+// spmv (y = a*A*x + b*y), spmv_t (y = a*A'*x + b*y, the mtv of a sparse
+// matrix), spmm and spmm_t (sparse times dense), sumabs2_col (column norms)
+// and col_into (a column into a dense column).
+// From sparse_par_min nonzeros the kernels run in parallel over parts of
+// the columns holding about the same number of nonzeros; spmv, whose
+// columns scatter into y, sums per thread copies of y from the thread
+// arenas, so after the first call it allocates nothing.
+
+namespace igm {
+
+  constexpr size_t sparse_par_min = size_t{ 1 } << 15;  // nonzeros, below runs serial
+
+  template<typename T>
+  struct Triplet {
+    size_t row;
+    size_t col;
+    T val;
+  };
+
+
+  template<typename T>
+  class SparseMat {
+  public:
+    using val_type = T;
+
+    SparseMat() : _colptr(1, 0) {}
+    // rows x cols of zeros
+    SparseMat(const size_t rows, const size_t cols) : _nr{ rows }, _nc{ cols }, _colptr(cols + 1, 0) {}
+
+    // sums the values of repeated (row, col) pairs
+    SparseMat(const size_t rows, const size_t cols, const std::vector<Triplet<T>>& t);
+
+    // the elements of A with |a| > drop
+    explicit SparseMat(Nondeduced<ConstMatView<T>> A, const T drop = T{ 0 });
+
+    size_t rows() const { return _nr; }
+    size_t cols() const { return _nc; }
+    size_t nnz() const { return _colptr[_nc]; }
+    bool empty() const { return _nr == 0 || _nc == 0; }
+    double density() const { return empty() ? 0.0 : static_cast<double>(nnz()) / _nr / _nc; }
+
+    const size_t* colptr() const { return _colptr.data(); }
+    const size_t* rowidx() const { return _rowidx.data(); }
+    const T* values() const { return _val.data(); }
+    T* values() { return _val.data(); }
+
+    // nonzeros of column j
+    size_t col_nnz(const size_t j) const { return _colptr[j + 1] - _colptr[j]; }
+
+    // element (r, c), zero when not stored; a binary search in column c
+    T operator()(const size_t r, const size_t c) const
+    {
+      const size_t* b = _rowidx.data() + _colptr[c];
+      const size_t* e = _rowidx.data() + _colptr[c + 1];
+      const size_t* p = std::lower_bound(b, e, r);
+      return p != e && *p == r ? _val[p - _rowidx.data()] : T{ 0 };
+    }
+
+    // the dense matrix
+    Mat<T> to_mat() const;
+
+  private:
+    size_t _nr = 0;
+    size_t _nc = 0;
+    std::vector<size_t> _colptr;
+    std::vector<size_t> _rowidx;
+    std::vector<T> _val;
+  };
+
+
+  template<typename T>
+  SparseMat<T>::SparseMat(const size_t rows, const size_t cols, const std::vector<Triplet<T>>& t)
+    : _nr{ rows }, _nc{ cols }, _colptr(cols + 1, 0)
+  {
+    for (const Triplet<T>& e : t)
+      if (e.row >= rows || e.col >= cols)
+        throw std::runtime_error("Invalid index in SparseMat");
+
+    // counting sort by row, then a stable one by column: the columns come
+    // out with ascending rows
+    std::vector<size_t> rowptr(rows + 1, 0), byrow(t.size());
+    for (const Triplet<T>& e : t)
+      ++rowptr[e.row + 1];
+    for (size_t i = 0; i < rows; ++i)
+      rowptr[i + 1] += rowptr[i];
+    for (size_t k = 0; k < t.size(); ++k)
+      byrow[rowptr[t[k].row]++] = k;
+
+    for (const Triplet<T>& e : t)
+      ++_colptr[e.col + 1];
+    for (size_t j = 0; j < cols; ++j)
+      _colptr[j + 1] += _colptr[j];
+    std::vector<size_t> next(_colptr.begin(), _colptr.end() - 1);
+    _rowidx.resize(t.size());
+    _val.resize(t.size());
+    for (const size_t k : byrow)
+    {
+      const size_t p = next[t[k].col]++;
+      _rowidx[p] = t[k].row;
+      _val[p] = t[k].val;
+    }
+
+    // duplicates are neighbours now, sum them in place
+    size_t q = 0;
+    for (size_t j = 0; j < cols; ++j)
+    {
+      const size_t b = _colptr[j];
+      const size_t e = _colptr[j + 1];
+      _colptr[j] = q;
+      for (size_t p = b; p < e; ++p)
+      {
+        if (q > _colptr[j] && _rowidx[q - 1] == _rowidx[p])
+          _val[q - 1] += _val[p];
+        else {
+          _rowidx[q] = _rowidx[p];
+          _val[q] = _val[p];
+          ++q;
+        }
+      }
+    }
+    _colptr[cols] = q;
+    _rowidx.resize(q);
+    _val.resize(q);
+  }
+
+
+  template<typename T>
+  SparseMat<T>::SparseMat(Nondeduced<ConstMatView<T>> A, const T drop)
+    : _nr{ A.rows() }, _nc{ A.cols() }, _colptr(A.cols() + 1, 0)
+  {
+    for (size_t j = 0; j < _nc; ++j)
+    {
+      const T* a = A.begincol(j);
+      for (size_t i = 0; i < _nr; ++i)
+      {
+        if (std::abs(a[i]) > drop) {
+          _rowidx.push_back(i);
+          _val.push_back(a[i]);
+        }
+      }
+      _colptr[j + 1] = _val.size();
+    }
+  }
+
+
+  // dst(:, 0) = A(:, j), dst is a column (or row) vector of A.rows() elements
+  template<typename T>
+  void col_into(MatView<T> dst, const SparseMat<T>& A, const size_t j)
+  {
+    if (j >= A.cols() || vec_len(dst) != A.rows())
+      throw std::runtime_error("Invalid dimensions in col_into");
+    const size_t inc = vec_inc(dst);
+    T* d = dst.data();
+    for (size_t i = 0; i < A.rows(); ++i)
+      d[i*inc] = T{ 0 };
+    for (size_t p = A.colptr()[j]; p < A.colptr()[j + 1]; ++p)
+      d[A.rowidx()[p] * inc] = A.values()[p];
+  }
+
+  template<typename T>
+  void col_into(Mat<T>& dst, const SparseMat<T>& A, const size_t j)
+  {
+    if ((dst.rows() != A.rows() || dst.cols() != 1) && !dst.issub())
+      dst.resize(A.rows(), 1, uninit);
+    col_into(dst.view(), A, j);
+  }
+
+  template<typename T>
+  Mat<T> SparseMat<T>::to_mat() const
+  {
+    Mat<T> A(_nr, _nc);
+    for (size_t j = 0; j < _nc; ++j)
+      for (size_t p = _colptr[j]; p < _colptr[j + 1]; ++p)
+        A(_rowidx[p], j) = _val[p];
+    return A;
+  }
+
+
+  namespace detail {
+
+    // first column of part t of nt, the parts hold about the same number
+    // of nonzeros
+    template<typename T>
+    size_t col_part(const SparseMat<T>& A, const size_t t, const size_t nt)
+    {
+      if (t >= nt)
+        return A.cols();
+      const size_t target = static_cast<size_t>(static_cast<double>(A.nnz()) * t / nt);
+      const size_t* c = A.colptr();
+      return static_cast<size_t>(std::lower_bound(c, c + A.cols() + 1, target) - c);
+    }
+
+    // threads for work on A, one below sparse_par_min nonzeros
+    template<typename T>
+    int sparse_threads(const SparseMat<T>& A)
+    {
+      return A.nnz() < sparse_par_min || omp_in_parallel() ? 1 : omp_get_max_threads();
+    }
+
+    // f(c0, c1) on parts of the columns, in parallel for large A
+    template<typename T, typename F>
+    void for_col_parts(const SparseMat<T>& A, F f)
+    {
+      const int threads = sparse_threads(A);
+      if (threads < 2) {
+        f(size_t{ 0 }, A.cols());
+        return;
+      }
+#pragma omp parallel num_threads(threads)
+      {
+        const size_t nt = static_cast<size_t>(omp_get_num_threads());
+        const size_t t = static_cast<size_t>(omp_get_thread_num());
+        f(col_part(A, t, nt), col_part(A, t + 1, nt));
+      }
+    }
+
+    // A(:, j)'*x
+    template<typename T>
+    T col_dot(const SparseMat<T>& A, const size_t j, const T* x, const size_t incx)
+    {
+      const size_t* ri = A.rowidx();
+      const T* v = A.values();
+      T s{ 0 };
+      for (size_t p = A.colptr()[j]; p < A.colptr()[j + 1]; ++p)
+        s += v[p] * x[ri[p] * incx];
+      return s;
+    }
+
+    // y += a*A(:, c0:c1-1)*x(c0:c1-1)
+    template<typename T>
+    void cols_axpy(const SparseMat<T>& A, const size_t c0, const size_t c1, const T a,
+      const T* x, const size_t incx, T* y, const size_t incy)
+    {
+      const size_t* ri = A.rowidx();
+      const T* v = A.values();
+      for (size_t j = c0; j < c1; ++j)
+      {
+        const T xj = a * x[j*incx];
+        if (xj == T{ 0 })
+          continue;
+        for (size_t p = A.colptr()[j]; p < A.colptr()[j + 1]; ++p)
+          y[ri[p] * incy] += v[p] * xj;
+      }
+    }
+
+  } // namespace detail
+
+
+  // y = a*A*x + b*y, x and y are row or column vectors; b = 0 overwrites y
+  template<typename T>
+  void spmv(MatView<T> y, const SparseMat<T>& A, Nondeduced<ConstMatView<T>> x,
+    const T a = T{ 1 }, const T b = T{ 0 })
+  {
+    if (vec_len(x) != A.cols() || vec_len(y) != A.rows())
+      throw std::runtime_error("Invalid dimensions in spmv");
+    IGM_PROF("spmv", 2 * A.nnz(), sizeof(T) * (2 * A.nnz() + A.cols() + 2 * A.rows()), A.rows(), A.cols());
+    const size_t m = A.rows();
+    const size_t incx = vec_inc(x);
+    const size_t incy = vec_inc(y);
+    T* yp = y.data();
+    const int threads = detail::sparse_threads(A);
+    if (threads < 2) {
+      for (size_t i = 0; i < m; ++i)
+        yp[i*incy] = b == T{ 0 } ? T{ 0 } : b * yp[i*incy];
+      detail::cols_axpy(A, 0, A.cols(), a, x.data(), incx, yp, incy);
+      return;
+    }
+
+    // every thread scatters its columns into its own copy of y, then the
+    // copies are summed by rows
+    Workspace ws;
+    T** part = ws.alloc<T*>(static_cast<size_t>(threads));
+#pragma omp parallel num_threads(threads)
+    {
+      const size_t nt = static_cast<size_t>(omp_get_num_threads());
+      const size_t t = static_cast<size_t>(omp_get_thread_num());
+      Workspace wt;
+      T* yt = wt.alloc<T>(m);
+      std::fill(yt, yt + m, T{ 0 });
+      part[t] = yt;
+      detail::cols_axpy(A, detail::col_part(A, t, nt), detail::col_part(A, t + 1, nt), a,
+        x.data(), incx, yt, size_t{ 1 });
+#pragma omp barrier
+      for (size_t i = m * t / nt; i < m * (t + 1) / nt; ++i)
+      {
+        T s = b == T{ 0 } ? T{ 0 } : b * yp[i*incy];
+        for (size_t k = 0; k < nt; ++k)
+          s += part[k][i];
+        yp[i*incy] = s;
+      }
+      // the copies live until every thread has read them
+#pragma omp barrier
+    }
+  }
+
+  template<typename T>
+  void spmv(Mat<T>& y, const SparseMat<T>& A, const Mat<T>& x, const T a = T{ 1 }, const T b = T{ 0 })
+  {
+    spmv(y.view(), A, x.view(), a, b);
+  }
+
+
+  // y = a*A'*x + b*y, a dot product per column
+  template<typename T>
+  void spmv_t(MatView<T> y, const SparseMat<T>& A, Nondeduced<ConstMatView<T>> x,
+    const T a = T{ 1 }, const T b = T{ 0 })
+  {
+    if (vec_len(x) != A.rows() || vec_len(y) != A.cols())
+      throw std::runtime_error("Invalid dimensions in spmv_t");
+    IGM_PROF("spmv_t", 2 * A.nnz(), sizeof(T) * (2 * A.nnz() + A.rows() + 2 * A.cols()), A.rows(), A.cols());
+    const size_t incx = vec_inc(x);
+    const size_t incy = vec_inc(y);
+    T* yp = y.data();
+    detail::for_col_parts(A, [&](const size_t c0, const size_t c1) {
+      for (size_t j = c0; j < c1; ++j)
+      {
+        const T s = a * detail::col_dot(A, j, x.data(), incx);
+        yp[j*incy] = b == T{ 0 } ? s : s + b * yp[j*incy];
+      }
+    });
+  }
+
+  template<typename T>
+  void spmv_t(Mat<T>& y, const SparseMat<T>& A, const Mat<T>& x, const T a = T{ 1 }, const T b = T{ 0 })
+  {
+    spmv_t(y.view(), A, x.view(), a, b);
+  }
+
+
+  // C = a*A*B + b*C with B and C dense; many columns of B run in parallel,
+  // few one after another on the parallel spmv
+  template<typename T>
+  void spmm(MatView<T> C, const SparseMat<T>& A, Nondeduced<ConstMatView<T>> B,
+    const T a = T{ 1 }, const T b = T{ 0 })
+  {
+    if (B.rows() != A.cols() || C.rows() != A.rows() || C.cols() != B.cols())
+      throw std::runtime_error("Invalid dimensions in spmm");
+    IGM_PROF("spmm", 2 * A.nnz() * B.cols(), sizeof(T) * (2 * A.nnz() + B.rows() * B.cols() + 2 * C.rows() * C.cols()),
+      A.rows(), B.cols());
+    const long long p = static_cast<long long>(B.cols());
+    const int threads = detail::sparse_threads(A);
+    if (threads > 1 && p >= 2 * threads) {
+#pragma omp parallel for schedule(static) num_threads(threads)
+      for (long long l = 0; l < p; ++l)
+        spmv(C.col(l), A, B.col(l), a, b);
+    }
+    else {
+      for (long long l = 0; l < p; ++l)
+        spmv(C.col(l), A, B.col(l), a, b);
+    }
+  }
+
+  template<typename T>
+  void spmm(Mat<T>& C, const SparseMat<T>& A, const Mat<T>& B, const T a = T{ 1 }, const T b = T{ 0 })
+  {
+    spmm(C.view(), A, B.view(), a, b);
+  }
+
+
+  // C = a*A'*B + b*C with B and C dense
+  template<typename T>
+  void spmm_t(MatView<T> C, const SparseMat<T>& A, Nondeduced<ConstMatView<T>> B,
+    const T a = T{ 1 }, const T b = T{ 0 })
+  {
+    if (B.rows() != A.rows() || C.rows() != A.cols() || C.cols() != B.cols())
+      throw std::runtime_error("Invalid dimensions in spmm_t");
+    IGM_PROF("spmm_t", 2 * A.nnz() * B.cols(), sizeof(T) * (2 * A.nnz() + B.rows() * B.cols() + 2 * C.rows() * C.cols()),
+      A.cols(), B.cols());
+    detail::for_col_parts(A, [&](const size_t c0, const size_t c1) {
+      for (size_t l = 0; l < B.cols(); ++l)
+      {
+        for (size_t j = c0; j < c1; ++j)
+        {
+          const T s = a * detail::col_dot(A, j, B.begincol(l), size_t{ 1 });
+          C(j, l) = b == T{ 0 } ? s : s + b * C(j, l);
+        }
+      }
+    });
+  }
+
+  template<typename T>
+  void spmm_t(Mat<T>& C, const SparseMat<T>& A, const Mat<T>& B, const T a = T{ 1 }, const T b = T{ 0 })
+  {
+    spmm_t(C.view(), A, B.view(), a, b);
+  }
+
+
+  // dst(0, i) = sum of squares of column i of A, for the columns i >= first
+  template<typename T>
+  void sumabs2_col(MatView<T> dst, const SparseMat<T>& A, const size_t first)
+  {
+    if (dst.cols() != A.cols())
+      throw std::runtime_error("Invalid dimensions in sumabs2_col");
+    IGM_PROF("sumabs2_col(sp)", 2 * A.nnz(), sizeof(T) * A.nnz(), A.rows(), A.cols());
+    detail::for_col_parts(A, [&](const size_t c0, const size_t c1) {
+      const T* v = A.values();
+      for (size_t j = std::max(c0, first); j < c1; ++j)
+      {
+        T s{ 0 };
+        for (size_t p = A.colptr()[j]; p < A.colptr()[j + 1]; ++p)
+          s += v[p] * v[p];
+        dst(0, j) = s;
+      }
+    });
+  }
+
+  template<typename T>
+  void sumabs2_col(Mat<T>& dst, const SparseMat<T>& A, const size_t first)
+  {
+    sumabs2_col(dst.view(), A, first);
+  }
+
+} // namespace igm
+
+#endif // _MATRIX_SPARSE_H__
@@ -0,0 +1,188 @@
+#ifndef _MATRIX_STORAGE_HPP__
+#define _MATRIX_STORAGE_HPP__
+
+#include <cstdlib>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <algorithm>
+#include <type_traits>
+#ifdef _MSC_VER
+#include <malloc.h>
+#endif
+
+namespace igm
+{
+  // tag for constructors and resize leaving the elements uninitialized,
+  // for outputs which are completely overwritten by the next step
+  struct uninit_t {};
+  constexpr uninit_t uninit{};
+
+  constexpr size_t mat_align = 64; // cache line, also covers AVX-512 loads
+
+
+  template<typename T, size_t Align = mat_align>
+  struct aligned_allocator {
+    using value_type = T;
+    template<typename U>
+    struct rebind { using other = aligned_allocator<U, Align>; };
+
+    aligned_allocator() = default;
+    template<typename U>
+    aligned_allocator(const aligned_allocator<U, Align>&) {}
+
+    T* allocate(const size_t n)
+    {
+      if (n == 0)
+        return nullptr;
+      const size_t bytes = (n * sizeof(T) + Align - 1) / Align * Align;
+#ifdef _MSC_VER
+      void* p = _aligned_malloc(bytes, Align);
+#else
+      void* p = nullptr;
+      if (posix_memalign(&p, Align, bytes) != 0)
+        p = nullptr;
+#endif
+      if (!p)
+        throw std::bad_alloc();
+#ifdef IGM_ALLOC_HOOK
+      IGM_ALLOC_HOOK(bytes); // e.g. the allocation counter of the unit tests
+#endif
+      return static_cast<T*>(p);
+    }
+
+    void deallocate(T* p, size_t)
+    {
+#ifdef _MSC_VER
+      _aligned_free(p);
+#else
+      std::free(p);
+#endif
+    }
+  };
+
+  template<typename T, typename U, size_t A>
+  bool operator==(const aligned_allocator<T, A>&, const aligned_allocator<U, A>&) { return true; }
+  template<typename T, typename U, size_t A>
+  bool operator!=(const aligned_allocator<T, A>&, const aligned_allocator<U, A>&) { return false; }
+
+  inline bool is_aligned(const void* p, const size_t align = mat_align)
+  {
+    return reinterpret_cast<std::uintptr_t>(p) % align == 0;
+  }
+
+
+  // owning contiguous buffer of Mat, the allocator decides alignment and
+  // origin of the memory; like valarray, resize discards the content
+  template<typename T, typename Alloc = aligned_allocator<T>>
+  class MatStorage {
+  public:
+    using traits = std::allocator_traits<Alloc>;
+
+    MatStorage() = default;
+    MatStorage(const size_t n, const T init, const Alloc& a = Alloc()) : _alloc(a) { create(n, &init); }
+    MatStorage(const size_t n, uninit_t, const Alloc& a = Alloc()) : _alloc(a) { create(n, nullptr); }
+    MatStorage(const MatStorage& o) : _alloc(traits::select_on_container_copy_construction(o._alloc))
+    {
+      create(o._size, nullptr, o._p);
+    }
+    MatStorage(MatStorage&& o) noexcept : _alloc(std::move(o._alloc)), _p(o._p), _size(o._size)
+    {
+      o._p = nullptr;
+      o._size = 0;
+    }
+    ~MatStorage() { destroy(); }
+
+    MatStorage& operator=(const MatStorage& o)
+    {
+      if (this != &o) {
+        if (_size == o._size)
+          std::copy(o._p, o._p + _size, _p);
+        else {
+          destroy();
+          create(o._size, nullptr, o._p);
+        }
+      }
+      return *this;
+    }
+    MatStorage& operator=(MatStorage&& o) noexcept
+    {
+      if (this != &o) {
+        destroy();
+        _alloc = std::move(o._alloc);
+        _p = o._p;
+        _size = o._size;
+        o._p = nullptr;
+        o._size = 0;
+      }
+      return *this;
+    }
+    MatStorage& operator=(const T val)
+    {
+      std::fill(_p, _p + _size, val);
+      return *this;
+    }
+
+    void resize(const size_t n, const T init = T())
+    {
+      if (n == _size) {
+        std::fill(_p, _p + _size, init);
+        return;
+      }
+      destroy();
+      create(n, &init);
+    }
+    // keeps the current buffer when the size does not change
+    void resize(const size_t n, uninit_t)
+    {
+      if (n == _size)
+        return;
+      destroy();
+      create(n, nullptr);
+    }
+
+    size_t size() const { return _size; }
+    T* data() { return _p; }
+    const T* data() const { return _p; }
+    T* begin() { return _p; }
+    const T* begin() const { return _p; }
+    T* end() { return _p + _size; }
+    const T* end() const { return _p + _size; }
+    T& operator[](const size_t i) { return _p[i]; }
+    const T& operator[](const size_t i) const { return _p[i]; }
+    Alloc get_allocator() const { return _alloc; }
+
+  protected:
+    // init == nullptr && src == nullptr leaves trivial types uninitialized
+    void create(const size_t n, const T* init, const T* src = nullptr)
+    {
+      _p = n ? traits::allocate(_alloc, n) : nullptr;
+      _size = n;
+      if (src)
+        std::uninitialized_copy(src, src + n, _p);
+      else if (init)
+        std::uninitialized_fill(_p, _p + n, *init);
+      else if (!std::is_trivially_default_constructible<T>::value)
+        std::uninitialized_fill(_p, _p + n, T());
+    }
+
+    void destroy()
+    {
+      if (!_p)
+        return;
+      if (!std::is_trivially_destructible<T>::value)
+        for (size_t i = 0; i < _size; ++i)
+          _p[i].~T();
+      traits::deallocate(_alloc, _p, _size);
+      _p = nullptr;
+      _size = 0;
+    }
+
+    Alloc _alloc;
+    T* _p = nullptr;
+    size_t _size = 0;
+  };
+
+}
+
+#endif //_MATRIX_STORAGE_HPP__
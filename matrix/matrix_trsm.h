@@ -0,0 +1,143 @@
+#ifndef _MATRIX_TRSM_H__
+#define _MATRIX_TRSM_H__
+
+#include <cstddef>
+#include <algorithm>
+#include <stdexcept>
+#include <omp.h>
+#include "matrix_igm.hpp"
+#include "matrix_simd.h"
+#include "matrix_lpack_blas.h"
+
+// Triangular solve with many right-hand sides (trsm in BLAS terms):
+// op(A)*X = B in place of B, A upper or lower, op(A) = A or A', unit or
+// non-unit diagonal. A is walked by columns: the diagonal blocks of
+// trsm_block columns are solved with axpy (or dot for the transposed
+// cases) on contiguous columns, the off-diagonal blocks update the
+// remaining rows of B in one gemm. The right-hand sides are split into
+// column blocks which run in parallel.
+
+namespace igm {
+
+  enum class uplo { upper, lower };
+  enum class diag { non_unit, unit };
+
+  constexpr size_t trsm_block = 64;                     // rows of A solved between two gemm updates
+  constexpr size_t trsm_par_min = size_t{ 1 } << 18;    // n*n*rhs below run on one thread
+
+  namespace detail {
+
+    // the unblocked solve of a diagonal block: n x n A, n x nrhs B
+    template<typename T>
+    void trsm_diag(const uplo ul, const bool trans, const diag dg, const size_t n,
+      const T* a, const size_t lda, const size_t nrhs, T* b, const size_t ldb)
+    {
+      const bool unit = dg == diag::unit;
+      for (size_t c = 0; c < nrhs; ++c)
+      {
+        T* x = b + c * ldb;
+        if (ul == uplo::upper && !trans) {
+          for (size_t j = n; j-- > 0;)
+          {
+            if (!unit)
+              x[j] /= a[j * lda + j];
+            simd::axpy(j, -x[j], a + j * lda, x);
+          }
+        }
+        else if (ul == uplo::lower && !trans) {
+          for (size_t j = 0; j < n; ++j)
+          {
+            if (!unit)
+              x[j] /= a[j * lda + j];
+            simd::axpy(n - j - 1, -x[j], a + j * lda + j + 1, x + j + 1);
+          }
+        }
+        else if (ul == uplo::upper) {
+          for (size_t j = 0; j < n; ++j)
+          {
+            x[j] -= simd::dot(j, a + j * lda, x);
+            if (!unit)
+              x[j] /= a[j * lda + j];
+          }
+        }
+        else {
+          for (size_t j = n; j-- > 0;)
+          {
+            x[j] -= simd::dot(n - j - 1, a + j * lda + j + 1, x + j + 1);
+            if (!unit)
+              x[j] /= a[j * lda + j];
+          }
+        }
+      }
+    }
+
+
+    // blocked solve of nrhs columns of B
+    template<typename T>
+    void trsm_blocked(const uplo ul, const bool trans, const diag dg, const size_t n,
+      const T* a, const size_t lda, const size_t nrhs, T* b, const size_t ldb)
+    {
+      // op(A) lower: the blocks run forward and update the rows below
+      const bool forward = (ul == uplo::lower) != trans;
+      const size_t nblk = (n + trsm_block - 1) / trsm_block;
+      for (size_t s = 0; s < nblk; ++s)
+      {
+        const size_t k = forward ? s : nblk - 1 - s;
+        const size_t k0 = k * trsm_block, kb = std::min(trsm_block, n - k0);
+        const T* akk = a + k0 * lda + k0;
+        T* bk = b + k0;
+        trsm_diag(ul, trans, dg, kb, akk, lda, nrhs, bk, ldb);
+
+        // B(r0:r0+nr) -= op(A)(r0:r0+nr, k0:k0+kb) * B(k0:k0+kb); the block
+        // of op(A) is the block A(r, k) or the transposed block A(k, r)
+        const size_t r0 = forward ? k0 + kb : 0, nr = forward ? n - k0 - kb : k0;
+        if (nr == 0)
+          continue;
+        const T* ark = trans ? a + r0 * lda + k0 : a + k0 * lda + r0;
+        blas::gemm(trans ? CblasTrans : CblasNoTrans, CblasNoTrans, nr, nrhs, kb,
+          T{ -1 }, ark, lda, bk, ldb, T{ 1 }, b + r0, ldb);
+      }
+    }
+
+  } // namespace detail
+
+
+  // solves op(A)*X = B, X overwrites B; A is n x n and only its ul
+  // triangle is read, with diag::unit not its diagonal either
+  template<typename T>
+  void trsm(Nondeduced<ConstMatView<T>> A, MatView<T> B, const uplo ul = uplo::upper,
+    const bool trans = false, const diag dg = diag::non_unit)
+  {
+    const size_t n = A.rows();
+    if (A.cols() != n || B.rows() != n)
+      throw std::runtime_error("Invalid dimensions in trsm");
+    const size_t nrhs = B.cols();
+    if (n == 0 || nrhs == 0)
+      return;
+    IGM_PROF("trsm", n * n * nrhs, sizeof(T) * (n * n / 2 + 2 * n * nrhs), n, nrhs);
+
+    const size_t threads = static_cast<size_t>(omp_get_max_threads());
+    const bool par = threads > 1 && nrhs > 1 && !omp_in_parallel()
+      && static_cast<double>(n) * n * nrhs >= static_cast<double>(trsm_par_min);
+    const size_t nt = par ? std::min(threads, nrhs) : 1;
+    const size_t chunk = (nrhs + nt - 1) / nt;
+#pragma omp parallel for if(par) num_threads(static_cast<int>(nt)) schedule(static)
+    for (long long t = 0; t < static_cast<long long>(nt); ++t)
+    {
+      const size_t c0 = static_cast<size_t>(t) * chunk;
+      if (c0 < nrhs)
+        detail::trsm_blocked(ul, trans, dg, n, A.data(), A.lda(), std::min(chunk, nrhs - c0),
+          B.begincol(c0), B.lda());
+    }
+  }
+
+  template<typename T>
+  void trsm(const Mat<T>& A, Mat<T>& B, const uplo ul = uplo::upper,
+    const bool trans = false, const diag dg = diag::non_unit)
+  {
+    trsm(A.view(), B.view(), ul, trans, dg);
+  }
+
+} // namespace igm
+
+#endif // _MATRIX_TRSM_H__
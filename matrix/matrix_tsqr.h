@@ -0,0 +1,453 @@
+#ifndef _MATRIX_TSQR_H__
+#define _MATRIX_TSQR_H__
+
+#include <cmath>
+#include <cstddef>
+#include <algorithm>
+#include <future>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+#include <omp.h>
+#include "matrix_igm.hpp"
+#include "matrix_qr.h"
+#include "matrix_arena.h"
+#include "matrix_trsm.h"
+#include "matrix_mmap.h"
+
+// TSQR: QR of a tall-skinny matrix from the QR of its row blocks. The
+// R factors of two blocks stacked on each other have the R of the two
+// blocks together as their R, so the R of the whole matrix follows from a
+// reduction tree over the R of the blocks.
+//
+// TsqrStream factors row blocks as they arrive and keeps one pending R per
+// level of a binary tree (as the bits of a counter), so the memory is two
+// blocks plus log2(blocks) small R no matter how many rows stream through.
+// Q is not formed: rhs extra columns of right-hand sides B appended to
+// the blocks ([A B]) come out as Q'*B and the residual norms, which is
+// what a least squares fit needs. tsqr_stream reads the next block on a
+// second thread while the current one is factored.
+//
+// tsqr is the in-memory, multicore variant: leaf blocks sized for the L2
+// cache are factored in parallel, each in one pass from memory, the tree
+// keeps the reflectors of its merges and Q is rebuilt top down in a
+// second parallel pass. Two passes over A in total, where mgs makes two
+// per column.
+
+namespace igm {
+
+  constexpr size_t tsqr_block_rows = size_t{ 1 } << 14; // rows per block of tsqr_stream
+  constexpr size_t tsqr_leaf_bytes = size_t{ 1 } << 20;  // leaf block of tsqr, about the L2 cache
+
+  template<typename T>
+  class TsqrStream {
+  public:
+    // blocks have cols + rhs columns, the last rhs are right-hand sides
+    explicit TsqrStream(const size_t cols, const size_t rhs = 0) : _n(cols), _k(rhs) {}
+
+    size_t cols() const { return _n; }
+    size_t rhs() const { return _k; }
+    size_t rows() const { return _rows; }
+    size_t blocks() const { return _blocks; }
+
+    // factors a block of rows x (cols + rhs) and merges its R into the tree
+    void add(Nondeduced<ConstMatView<T>> block)
+    {
+      if (block.cols() != _n + _k)
+        throw std::runtime_error("Invalid dimensions in TsqrStream::add");
+      if (block.rows() == 0)
+        return;
+      Mat<T> F(block);
+      add_factor(F);
+    }
+
+    // as add, factors the block in place
+    void add_inplace(Mat<T>& block)
+    {
+      if (block.cols() != _n + _k)
+        throw std::runtime_error("Invalid dimensions in TsqrStream::add");
+      if (block.rows() > 0)
+        add_factor(block);
+    }
+
+    // R of all rows added so far, (cols + rhs) x (cols + rhs)
+    Mat<T> R_full() const
+    {
+      const size_t N = _n + _k;
+      Mat<T> R(N, N);
+      bool first = true;
+      for (auto& r : _level)
+      {
+        if (r.rows() == 0)
+          continue;
+        if (first)
+          R = r;
+        else
+          R = merge(R, r);
+        first = false;
+      }
+      return R;
+    }
+
+    // R of A, cols x cols
+    Mat<T> R() const { return block_of(R_full(), 0, _n, 0, _n); }
+
+    // Q'*B, cols x rhs
+    Mat<T> qtb() const { return block_of(R_full(), 0, _n, _n, _k); }
+
+    // 1 x rhs norms of the least squares residuals B - A*X
+    Mat<T> residual() const
+    {
+      const Mat<T> R = R_full();
+      Mat<T> r(1, _k);
+      for (size_t j = 0; j < _k; ++j)
+      {
+        const T* c = R.begincol(_n + j);
+        T s{ 0 };
+        for (size_t i = _n; i <= _n + j; ++i)
+          s += c[i] * c[i];
+        r(0, j) = std::sqrt(s);
+      }
+      return r;
+    }
+
+    // cols x rhs least squares solution min |A*X - B|, A of full rank
+    Mat<T> solve() const
+    {
+      const Mat<T> R = R_full();
+      Mat<T> X = block_of(R, 0, _n, _n, _k);
+      trsm(ConstMatView<T>(R.begincol(0), _n, _n, R.lda()), X.view());
+      return X;
+    }
+
+  private:
+    static Mat<T> block_of(const Mat<T>& A, const size_t r0, const size_t nr, const size_t c0, const size_t nc)
+    {
+      Mat<T> B(nr, nc, uninit);
+      for (size_t j = 0; j < nc; ++j)
+        std::copy(A.begincol(c0 + j) + r0, A.begincol(c0 + j) + r0 + nr, B.begincol(j));
+      return B;
+    }
+
+    // R of [A; B] from the R of A and of B
+    static Mat<T> merge(const Mat<T>& A, const Mat<T>& B)
+    {
+      const size_t N = A.cols();
+      Mat<T> S(2 * N, N, uninit), tau(1, N), R(N, N, uninit);
+      for (size_t j = 0; j < N; ++j)
+      {
+        std::copy(A.begincol(j), A.endcol(j), S.begincol(j));
+        std::copy(B.begincol(j), B.endcol(j), S.begincol(j) + N);
+      }
+      geqrf(S, tau);
+      triu(R, S);
+      return R;
+    }
+
+    void add_factor(Mat<T>& F)
+    {
+      const size_t N = _n + _k;
+      Mat<T> tau(1, N), R(N, N, uninit);
+      geqrf(F, tau);
+      triu(R, F);
+      _rows += F.rows();
+      ++_blocks;
+
+      // carry R up the levels like the bits of a counter
+      for (size_t l = 0;; ++l)
+      {
+        if (l == _level.size())
+          _level.emplace_back();
+        if (_level[l].rows() == 0) {
+          _level[l] = std::move(R);
+          return;
+        }
+        R = merge(_level[l], R);
+        _level[l] = Mat<T>();
+      }
+    }
+
+    size_t _n;
+    size_t _k;
+    size_t _rows = 0;
+    size_t _blocks = 0;
+    std::vector<Mat<T>> _level; // R of 2^l blocks, or empty
+  };
+
+
+  // streams the blocks of next through a TsqrStream. next(MatView<T> buf)
+  // fills the first rows of the block_rows x (cols + rhs) buffer and
+  // returns their number, 0 at the end; it runs on a second thread and
+  // fills one buffer while the other one is factored
+  template<typename T, typename Source>
+  TsqrStream<T> tsqr_stream(Source next, const size_t cols, const size_t rhs = 0,
+    const size_t block_rows = tsqr_block_rows)
+  {
+    const size_t N = cols + rhs;
+    if (block_rows == 0)
+      throw std::runtime_error("Invalid dimensions in tsqr_stream");
+    TsqrStream<T> ts(cols, rhs);
+    Mat<T> buf[2] = { Mat<T>(block_rows, N, uninit), Mat<T>(block_rows, N, uninit) };
+    auto read = [&next](Mat<T>& b) { return static_cast<size_t>(next(b.view())); };
+
+    size_t cur = 0;
+    size_t got = read(buf[cur]);
+    while (got > 0)
+    {
+      if (got > block_rows)
+        throw std::runtime_error("Invalid block in tsqr_stream");
+      std::future<size_t> ahead = std::async(std::launch::async, read, std::ref(buf[1 - cur]));
+      buf[cur].sub(0, got - 1, 0, N - 1);
+      ts.add_inplace(buf[cur]);
+      buf[cur].subreset();
+      got = ahead.get();
+      cur = 1 - cur;
+    }
+    return ts;
+  }
+
+  // TSQR of a mapped matrix file in row blocks; its last rhs columns are
+  // the right-hand sides
+  template<typename T>
+  TsqrStream<T> tsqr_stream(const MatMap<T>& M, const size_t rhs = 0,
+    const size_t block_rows = tsqr_block_rows)
+  {
+    if (rhs > M.cols())
+      throw std::runtime_error("Invalid dimensions in tsqr_stream");
+    const ConstMatView<T> A = M.view();
+    size_t r0 = 0;
+    M.advise(map_advice::sequential);
+    return tsqr_stream<T>([&](MatView<T> buf) {
+      const size_t nr = std::min(buf.rows(), A.rows() - r0);
+      for (size_t j = 0; j < A.cols(); ++j)
+        std::copy(A.begincol(j) + r0, A.begincol(j) + r0 + nr, buf.begincol(j));
+      r0 += nr;
+      return nr;
+    }, M.cols() - rhs, rhs, block_rows);
+  }
+
+
+  namespace detail {
+
+    // rows of the leaf blocks of tsqr, at least 2*cols
+    template<typename T>
+    size_t tsqr_leaf_rows(const size_t n)
+    {
+      return std::max(2 * n, tsqr_leaf_bytes / (n * sizeof(T)));
+    }
+
+    // leaf blocks of tsqr on m rows, the last one takes the remainder
+    inline size_t tsqr_leaves(const size_t m, const size_t lr)
+    {
+      return std::max(size_t{ 1 }, m / lr);
+    }
+
+    // levels of the tsqr tree over nl leaves
+    inline size_t tsqr_levels(size_t nl)
+    {
+      size_t l = 0;
+      for (; nl > 1; nl = (nl + 1) / 2)
+        ++l;
+      return l;
+    }
+
+    // the merges of one level of the tsqr tree: node j of the next level
+    // is the R of [R(2j); R(2j + 1)], whose reflectors are kept in s (2n x n)
+    // and tau; a last odd node moves up unchanged. s and tau are arena
+    // memory of the calling tsqr
+    template<typename T>
+    struct tsqr_level {
+      size_t count; // nodes below this level
+      T* s;
+      T* tau;
+      bool merged(const size_t j) const { return 2 * j + 1 < count; }
+    };
+
+    // the upper triangle of the m x n block at a into the n x n r
+    template<typename T>
+    void copy_triu(const size_t m, const size_t n, const T* a, const size_t lda, T* r)
+    {
+      for (size_t j = 0; j < n; ++j)
+      {
+        const size_t d = std::min(j + 1, m);
+        std::copy(a + j * lda, a + j * lda + d, r + j * n);
+        std::fill(r + j * n + d, r + (j + 1) * n, T{ 0 });
+      }
+    }
+
+  } // namespace detail
+
+
+  // QR of the tall-skinny A (rows >= cols) in place, A may be a view of
+  // selected columns (subcols); R receives the cols x cols factor. With
+  // want_q A is overwritten by the thin Q, otherwise by the reflectors of
+  // the leaf blocks.
+  template<typename T>
+  void tsqr(MatView<T> A, MatView<T> R, const bool want_q = true)
+  {
+    const size_t m = A.rows(), n = A.cols();
+    if (m < n || R.rows() != n || R.cols() != n)
+      throw std::runtime_error("Invalid dimensions in tsqr");
+    if (n == 0)
+      return;
+    IGM_PROF("tsqr", (want_q ? 4 : 2) * m * n * n, sizeof(T) * (want_q ? 4 : 1) * m * n, m, n);
+
+    T* a = A.data();
+    const size_t lda = A.lda();
+    const size_t lr = detail::tsqr_leaf_rows<T>(n);
+    const size_t nl = detail::tsqr_leaves(m, lr);
+    const size_t nn = n * n;
+    auto leaf_rows = [&](const size_t c) { return c + 1 == nl ? m - c * lr : lr; };
+    const bool par = nl > 1 && omp_get_max_threads() > 1 && !omp_in_parallel();
+
+    // leaves, one pass over A; the scratch of the calling thread comes
+    // from its arena, the workers take theirs from their own arenas
+    Workspace ws;
+    T* tau = ws.alloc<T>(nl * n);
+    T* r = ws.alloc<T>(nl * nn);
+#pragma omp parallel for if(par) schedule(static)
+    for (long long i = 0; i < static_cast<long long>(nl); ++i)
+    {
+      const size_t c = static_cast<size_t>(i);
+      T* ac = a + c * lr;
+      detail::geqrf_at(leaf_rows(c), n, ac, lda, &tau[c * n], qr_block);
+      detail::copy_triu(leaf_rows(c), n, ac, lda, &r[c * nn]);
+    }
+
+    // binary tree over the leaf R, its levels and reflectors on the arena
+    const size_t levels = detail::tsqr_levels(nl);
+    detail::tsqr_level<T>* tree = ws.alloc<detail::tsqr_level<T>>(levels);
+    size_t count = nl;
+    for (size_t l = 0; l < levels; ++l, count = (count + 1) / 2)
+    {
+      const size_t next = (count + 1) / 2;
+      const detail::tsqr_level<T> lv{ count, ws.alloc<T>(next * 2 * nn), ws.alloc<T>(next * n) };
+      T* rn = ws.alloc<T>(next * nn);
+#pragma omp parallel for if(par && next > 1) schedule(static)
+      for (long long i = 0; i < static_cast<long long>(next); ++i)
+      {
+        const size_t j = static_cast<size_t>(i);
+        if (!lv.merged(j)) {
+          std::copy(&r[2 * j * nn], &r[2 * j * nn] + nn, &rn[j * nn]);
+          continue;
+        }
+        T* s = &lv.s[j * 2 * nn];
+        for (size_t c = 0; c < n; ++c)
+        {
+          std::copy(&r[2 * j * nn + c * n], &r[2 * j * nn + c * n] + n, s + c * 2 * n);
+          std::copy(&r[(2 * j + 1) * nn + c * n], &r[(2 * j + 1) * nn + c * n] + n, s + c * 2 * n + n);
+        }
+        detail::geqrf_at(2 * n, n, s, 2 * n, &lv.tau[j * n], qr_block);
+        detail::copy_triu(2 * n, n, s, 2 * n, &rn[j * nn]);
+      }
+      r = rn;
+      tree[l] = lv;
+    }
+    for (size_t c = 0; c < n; ++c)
+      std::copy(&r[c * n], &r[c * n] + n, R.begincol(c));
+    if (!want_q)
+      return;
+
+    // Q top down: the node Q applied to [C; 0] gives the C of its children,
+    // starting from C = I at the root
+    T* q = ws.alloc<T>(nn);
+    std::fill(q, q + nn, T{ 0 });
+    for (size_t i = 0; i < n; ++i)
+      q[i * n + i] = T{ 1 };
+    for (size_t l = levels; l-- > 0;)
+    {
+      const detail::tsqr_level<T>& lv = tree[l];
+      T* qc = ws.alloc<T>(lv.count * nn);
+      const size_t next = (lv.count + 1) / 2;
+#pragma omp parallel for if(par && next > 1) schedule(static)
+      for (long long i = 0; i < static_cast<long long>(next); ++i)
+      {
+        const size_t j = static_cast<size_t>(i);
+        if (!lv.merged(j)) {
+          std::copy(&q[j * nn], &q[j * nn] + nn, &qc[2 * j * nn]);
+          continue;
+        }
+        Workspace wn;
+        T* w = wn.alloc<T>(2 * nn);
+        std::fill(w, w + 2 * nn, T{ 0 });
+        for (size_t c = 0; c < n; ++c)
+          std::copy(&q[j * nn + c * n], &q[j * nn + c * n] + n, &w[c * 2 * n]);
+        detail::ormqr_at(false, 2 * n, n, &lv.s[j * 2 * nn], 2 * n, &lv.tau[j * n], n, w, 2 * n, qr_block);
+        for (size_t c = 0; c < n; ++c)
+        {
+          std::copy(&w[c * 2 * n], &w[c * 2 * n] + n, &qc[2 * j * nn + c * n]);
+          std::copy(&w[c * 2 * n + n], &w[c * 2 * n] + 2 * n, &qc[(2 * j + 1) * nn + c * n]);
+        }
+      }
+      q = qc;
+    }
+
+    // leaves, the second pass: the reflectors move to a cache resident
+    // copy and the block becomes H*[C; 0]
+#pragma omp parallel if(par)
+    {
+      Workspace wl;
+      T* v = wl.alloc<T>(std::max(lr, leaf_rows(nl - 1)) * n);
+#pragma omp for schedule(static)
+      for (long long i = 0; i < static_cast<long long>(nl); ++i)
+      {
+        const size_t c = static_cast<size_t>(i), mc = leaf_rows(c);
+        T* ac = a + c * lr;
+        for (size_t j = 0; j < n; ++j)
+        {
+          std::copy(ac + j * lda, ac + j * lda + mc, &v[j * mc]);
+          std::copy(&q[c * nn + j * n], &q[c * nn + j * n] + n, ac + j * lda);
+          std::fill(ac + j * lda + n, ac + j * lda + mc, T{ 0 });
+        }
+        detail::ormqr_at(false, mc, n, v, mc, &tau[c * n], n, ac, lda, qr_block);
+      }
+    }
+  }
+
+  // bytes of arena workspace the calling thread of tsqr takes on an m x n
+  // matrix, for Arena::reserve; the OpenMP workers take theirs from their
+  // own arenas
+  template<typename T>
+  size_t tsqr_workspace(const size_t m, const size_t n, const bool want_q = true)
+  {
+    if (n == 0 || m < n)
+      return 0;
+    const size_t lr = detail::tsqr_leaf_rows<T>(n);
+    const size_t nl = detail::tsqr_leaves(m, lr);
+    const size_t ml = std::max(lr, m - (nl - 1) * lr);  // rows of the largest leaf
+    const size_t nn = n * n;
+
+    // kept for the whole call
+    size_t b = Arena::bytes<T>(nl * n) + Arena::bytes<T>(nl * nn)
+      + Arena::bytes<detail::tsqr_level<T>>(detail::tsqr_levels(nl));
+    for (size_t count = nl; count > 1; count = (count + 1) / 2)
+    {
+      const size_t next = (count + 1) / 2;
+      b += Arena::bytes<T>(next * 2 * nn) + Arena::bytes<T>(next * n) + Arena::bytes<T>(next * nn);
+      if (want_q)
+        b += Arena::bytes<T>(count * nn);
+    }
+
+    // scratch of the factorizations and of the Q pass on top of it
+    size_t t = std::max(geqrf_workspace<T>(ml, n), geqrf_workspace<T>(2 * n, n));
+    if (want_q) {
+      b += Arena::bytes<T>(nn);
+      t = std::max(t, Arena::bytes<T>(2 * nn) + ormqr_workspace<T>(2 * n, n));
+      t = std::max(t, Arena::bytes<T>(ml * n) + ormqr_workspace<T>(ml, n));
+    }
+    return b + t;
+  }
+
+
+  // as qr: Q (rows >= cols) is factored in place, R is resized to cols x cols
+  template<typename T>
+  void tsqr(Mat<T>& Q, Mat<T>& R, const bool want_q = true)
+  {
+    if (R.rows() != Q.cols() || R.cols() != Q.cols())
+      R = Mat<T>(Q.cols(), Q.cols());
+    tsqr(Q.view(), R.view(), want_q);
+  }
+
+} // namespace igm
+
+#endif // _MATRIX_TSQR_H__
@@ -3,13 +3,14 @@
 
 #include <algorithm>
 #include <numeric>
+#include "matrix_simd.h"
 
 namespace tim {
 
   template<typename T>
   inline T dot(const std::valarray<T>& v, const std::valarray<T>& u)
   {
-    return std::inner_product(&v[0], &v[0] + v.size(), &u[0], T{ 0 });
+    return igm::simd::dot(v.size(), &v[0], &u[0]);
   }
 
   template<typename T>
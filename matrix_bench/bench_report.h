@@ -0,0 +1,247 @@
+#ifndef _BENCH_REPORT_H__
+#define _BENCH_REPORT_H__
+
+// Timing, roofline and the JSON result file of matrix_bench.
+// A result holds the best time of a kernel on one shape together with the
+// flops and bytes of its cost model and the footprint of its operands;
+// GFLOP/s, GB/s and the percentage of the roofline bound
+// min(peak GFLOP/s, flops/bytes * GB/s) follow from them. The bandwidth is
+// taken from a curve measured over working set sizes at the footprint of
+// the kernel, so cache resident shapes are rated against the cache and
+// large ones against the memory. Kernels without flops are rated against
+// the bandwidth alone.
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace bench {
+
+  using clk = std::chrono::steady_clock;
+
+
+  // measured (or given) limits of the machine
+  struct roofline {
+    double gflops = 0.0;
+    std::vector<std::pair<double, double>> bw; // working set [bytes], GB/s, ascending
+
+    // bandwidth of the smallest measured working set holding footprint
+    double gbs(const double footprint) const
+    {
+      for (auto& b : bw)
+        if (footprint <= b.first)
+          return b.second;
+      return bw.empty() ? 0.0 : bw.back().second;
+    }
+
+    double bound(const double flops, const double bytes, const double footprint) const
+    {
+      if (flops == 0.0)
+        return gbs(footprint);
+      return bytes == 0.0 ? gflops : std::min(gflops, flops / bytes * gbs(footprint));
+    }
+  };
+
+
+  struct result {
+    std::string kernel;
+    std::string shape;  // e.g. "4000x400" or "4000x400v" for a sub-view
+    size_t rows = 0, cols = 0;
+    bool view = false;
+    double time = 0.0;  // best of reps [s]
+    double flops = 0.0;
+    double bytes = 0.0;
+    double footprint = 0.0;
+    size_t reps = 0;
+
+    std::string key() const { return kernel + " " + shape; }
+    double gflops() const { return flops / time * 1e-9; }
+    double gbs() const { return bytes / time * 1e-9; }
+    double roof(const roofline& r) const
+    {
+      const double perf = flops == 0.0 ? gbs() : gflops();
+      return 100.0 * perf / r.bound(flops, bytes, footprint);
+    }
+  };
+
+
+  // best time of run(), prepare() restores the inputs before each run and
+  // is not timed; repeats until min_time is spent or max_reps are done
+  template<typename P, typename F>
+  double measure(P prepare, F run, size_t& reps, const double min_time = 0.1, const size_t max_reps = 50)
+  {
+    prepare();
+    run(); // warm up caches and workspaces
+    double best = 1e300, total = 0.0;
+    for (reps = 0; reps < max_reps && (reps < 3 || total < min_time); ++reps)
+    {
+      prepare();
+      const auto t0 = clk::now();
+      run();
+      const double t = std::chrono::duration<double>(clk::now() - t0).count();
+      best = std::min(best, t);
+      total += t;
+    }
+    return best;
+  }
+
+
+  inline void print_header()
+  {
+    std::cout << std::left << std::setw(14) << "kernel" << std::right << std::setw(14) << "shape"
+      << std::setw(12) << "time[s]" << std::setw(10) << "GFLOP/s" << std::setw(10) << "GB/s"
+      << std::setw(8) << "%roof" << "\n";
+  }
+
+  inline void print(const result& r, const roofline& roof)
+  {
+    std::cout << std::left << std::setw(14) << r.kernel << std::right << std::setw(14) << r.shape
+      << std::setw(12) << std::scientific << std::setprecision(3) << r.time << std::fixed
+      << std::setw(10) << std::setprecision(2) << r.gflops()
+      << std::setw(10) << r.gbs()
+      << std::setw(8) << std::setprecision(1) << r.roof(roof) << std::defaultfloat << "\n";
+  }
+
+
+  inline void write_json(const std::string& path, const roofline& roof, const std::string& backend,
+    const std::string& isa, const int threads, const std::vector<result>& results)
+  {
+    std::ofstream f(path);
+    if (!f)
+      throw std::runtime_error("Cannot write " + path);
+    f << std::setprecision(9);
+    f << "{\n  \"machine\": { \"peak_gflops\": " << roof.gflops << ", \"threads\": " << threads
+      << ", \"isa\": \"" << isa << "\", \"blas\": \"" << backend << "\" },\n  \"bandwidth\": [\n";
+    for (size_t i = 0; i < roof.bw.size(); ++i)
+      f << "    { \"bytes\": " << roof.bw[i].first << ", \"gbs\": " << roof.bw[i].second << " }"
+        << (i + 1 < roof.bw.size() ? ",\n" : "\n");
+    f << "  ],\n  \"results\": [\n";
+    for (size_t i = 0; i < results.size(); ++i)
+    {
+      const result& r = results[i];
+      f << "    { \"kernel\": \"" << r.kernel << "\", \"shape\": \"" << r.shape
+        << "\", \"rows\": " << r.rows << ", \"cols\": " << r.cols << ", \"view\": " << (r.view ? "true" : "false")
+        << ", \"time\": " << r.time << ", \"reps\": " << r.reps << ", \"flops\": " << r.flops
+        << ", \"bytes\": " << r.bytes << ", \"footprint\": " << r.footprint
+        << ", \"gflops\": " << r.gflops() << ", \"gbs\": " << r.gbs() << ", \"roofline\": " << r.roof(roof) << " }" << (i + 1 < results.size() ? ",\n" : "\n");
+    }
+    f << "  ]\n}\n";
+  }
+
+
+  namespace detail {
+
+    // "key": value pairs of one flat JSON object, values kept as text
+    inline std::map<std::string, std::string> parse_object(const std::string& s)
+    {
+      std::map<std::string, std::string> kv;
+      size_t i = 0;
+      while ((i = s.find('"', i)) != std::string::npos)
+      {
+        const size_t k1 = s.find('"', i + 1);
+        const size_t colon = s.find(':', k1);
+        if (k1 == std::string::npos || colon == std::string::npos)
+          break;
+        const std::string key = s.substr(i + 1, k1 - i - 1);
+        size_t v0 = s.find_first_not_of(" \t\r\n", colon + 1);
+        if (v0 == std::string::npos)
+          break;
+        size_t v1;
+        std::string value;
+        if (s[v0] == '"') {
+          v1 = s.find('"', v0 + 1);
+          value = s.substr(v0 + 1, v1 - v0 - 1);
+          ++v1;
+        }
+        else {
+          v1 = s.find_first_of(",}", v0);
+          value = s.substr(v0, v1 - v0);
+          value.erase(value.find_last_not_of(" \t\r\n") + 1);
+        }
+        kv[key] = value;
+        i = v1;
+      }
+      return kv;
+    }
+
+  } // namespace detail
+
+
+  // the results of a file written by write_json
+  inline std::vector<result> read_json(const std::string& path)
+  {
+    std::ifstream f(path);
+    if (!f)
+      throw std::runtime_error("Cannot read " + path);
+    std::stringstream ss;
+    ss << f.rdbuf();
+    const std::string s = ss.str();
+
+    std::vector<result> results;
+    size_t i = s.find("\"results\"");
+    if (i == std::string::npos)
+      throw std::runtime_error("No results in " + path);
+    while ((i = s.find('{', i)) != std::string::npos)
+    {
+      const size_t j = s.find('}', i);
+      auto kv = detail::parse_object(s.substr(i + 1, j - i - 1));
+      result r;
+      r.kernel = kv["kernel"];
+      r.shape = kv["shape"];
+      r.rows = std::stoull(kv["rows"]);
+      r.cols = std::stoull(kv["cols"]);
+      r.view = kv["view"] == "true";
+      r.time = std::stod(kv["time"]);
+      r.reps = std::stoull(kv["reps"]);
+      r.flops = std::stod(kv["flops"]);
+      r.bytes = std::stod(kv["bytes"]);
+      r.footprint = std::stod(kv["footprint"]);
+      results.push_back(r);
+      i = j;
+    }
+    return results;
+  }
+
+
+  // time of every kernel of cur against base; a ratio above 1 + tol is a
+  // regression. Returns the number of regressions.
+  inline size_t compare(const std::vector<result>& base, const std::vector<result>& cur, const double tol)
+  {
+    std::map<std::string, const result*> b;
+    for (auto& r : base)
+      b[r.key()] = &r;
+
+    std::cout << std::left << std::setw(14) << "kernel" << std::right << std::setw(14) << "shape"
+      << std::setw(12) << "base[s]" << std::setw(12) << "new[s]" << std::setw(9) << "ratio" << "\n";
+    size_t regressions = 0;
+    for (auto& r : cur)
+    {
+      auto it = b.find(r.key());
+      if (it == b.end())
+        continue;
+      const double ratio = r.time / it->second->time;
+      const bool slow = ratio > 1.0 + tol;
+      regressions += slow;
+      std::cout << std::left << std::setw(14) << r.kernel << std::right << std::setw(14) << r.shape
+        << std::setw(12) << std::scientific << std::setprecision(3) << it->second->time
+        << std::setw(12) << r.time << std::fixed << std::setw(9) << std::setprecision(3) << ratio
+        << std::defaultfloat << (slow ? "  REGRESSION" : ratio < 1.0 - tol ? "  faster" : "") << "\n";
+      b.erase(it);
+    }
+    if (!b.empty())
+      std::cout << b.size() << " result(s) of the base run missing in the new run\n";
+    std::cout << regressions << " regression(s) above " << 100.0 * tol << "%\n";
+    return regressions;
+  }
+
+} // namespace bench
+
+#endif // _BENCH_REPORT_H__
@@ -0,0 +1,650 @@
+﻿// matrix_bench.cpp : performance of the matrix kernels
+//
+// usage: matrix_bench [options] [rows cols]
+//   --json file          write the results to a JSON file
+//   --quick              small shapes only
+//   --filter name        run the kernels whose name contains name
+//   --peak gflops gbs    roofline limits instead of the measured ones
+//   --detail             comparison tables: qr and tsqr against mgs with the
+//                        narrow shapes of their crossover, copies against
+//                        fused expressions, per instruction set
+//   --compare base.json new.json [tol]
+//                        flag kernels more than tol (default 0.1) slower;
+//                        the exit code is the number of regressions
+// built with IGM_PROFILE the instrumented kernels are listed at the end,
+// by call site and shape (matrix_prof.h)
+
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <cmath>
+#include <vector>
+#include <array>
+#include <utility>
+#include <cstdlib>
+#include <string>
+#include "../matrix/matrix_igm.hpp"
+#include "../matrix/matrix_lpack.h"
+#include "../matrix/matrix_lpack_blas.h"
+#include "../matrix/matrix_qr.h"
+#include "../matrix/matrix_batch.h"
+#include "../matrix/matrix_mixed.h"
+#include "../matrix/matrix_trsm.h"
+#include "../matrix/matrix_tsqr.h"
+#include "../matrix/matrix_fixed.h"
+#include "../matrix/matrix_select.h"
+#include "../matrix/matrix_sparse.h"
+#include "../matrix/utilrnd.hpp"
+#include "bench_report.h"
+
+using MatD = igm::Mat<double>;
+using clk = bench::clk;
+
+
+// matrix buffers of the operator benchmark are counted by their allocator
+static size_t g_allocs = 0;
+static size_t g_bytes = 0;
+
+template<typename T>
+struct counting_allocator : igm::aligned_allocator<T> {
+  template<typename U>
+  struct rebind { using other = counting_allocator<U>; };
+  T* allocate(const size_t n)
+  {
+    ++g_allocs;
+    g_bytes += n * sizeof(T);
+    return igm::aligned_allocator<T>::allocate(n);
+  }
+};
+
+using MatC = igm::Mat<double, counting_allocator<double>>;
+
+
+template<typename F>
+double seconds(F f)
+{
+  auto t0 = clk::now();
+  f();
+  return std::chrono::duration<double>(clk::now() - t0).count();
+}
+
+
+template<typename M>
+void randomize(M& A)
+{
+  RandReal<double> rnd(-1.0, 1.0);
+  for (auto a = A.begin(); a != A.end(); ++a)
+    *a = rnd();
+}
+
+
+// max |Q'Q - D| where D is the diagonal of Q'Q (mgs leaves Q unnormalized)
+double orthogonality(const MatD& Q)
+{
+  double e = 0.0;
+  for (size_t i = 0; i < Q.cols(); ++i)
+  {
+    const double ni = std::sqrt(std::inner_product(Q.begincol(i), Q.endcol(i), Q.begincol(i), 0.0));
+    for (size_t j = i + 1; j < Q.cols(); ++j)
+    {
+      const double nj = std::sqrt(std::inner_product(Q.begincol(j), Q.endcol(j), Q.begincol(j), 0.0));
+      const double s = std::inner_product(Q.begincol(i), Q.endcol(i), Q.begincol(j), 0.0);
+      e = std::max(e, std::abs(s) / (ni*nj));
+    }
+  }
+  return e;
+}
+
+
+void report(const char* name, const size_t m, const size_t n, const double t,
+  const double flops, const double orth)
+{
+  std::cout << std::setw(10) << name << std::setw(9) << m << std::setw(7) << n
+    << std::setw(12) << std::fixed << std::setprecision(4) << t
+    << std::setw(10) << std::setprecision(2) << flops / t * 1e-9
+    << std::setw(12) << std::scientific << std::setprecision(2) << orth
+    << std::defaultfloat << "\n";
+}
+
+
+// thin QR with explicit Q and R: Householder qr and tsqr against dpr::mgs.
+// qr is not faster everywhere: on a few columns (up to about 16) and more
+// rows than the cache holds every kernel is bound by its passes over
+// memory, mgs ties or wins against qr there and tsqr, with two passes,
+// beats both from about 8 columns
+void bench_qr(const size_t m, const size_t n)
+{
+  MatD A(m, n);
+  randomize(A);
+  const double mn2 = 2.0 * m * n * n;
+
+  // best of three runs on a fresh copy of A, the first one warms the
+  // arena and the packing buffers
+  MatD Q(A), R(n, n);
+  auto best_of = [&](auto f) {
+    double t = 1e300;
+    for (int r = 0; r < 3; ++r)
+    {
+      Q = A;
+      t = std::min(t, seconds(f));
+    }
+    return t;
+  };
+
+  const double tm = best_of([&] { igm::dpr::mgs(Q, R); });
+  report("mgs", m, n, tm, mn2, orthogonality(Q));
+
+  const double tq = best_of([&] { igm::qr(Q, R); });
+  // geqrf + orgqr each cost 2mn^2 - 2n^3/3
+  report("qr", m, n, tq, 2.0 * (mn2 - 2.0 * n * n * n / 3.0), orthogonality(Q));
+
+  const double tt = best_of([&] { igm::tsqr(Q, R); });
+  report("tsqr", m, n, tt, 2.0 * (mn2 - 2.0 * n * n * n / 3.0), orthogonality(Q));
+
+  const char* best = tq <= tm && tq <= tt ? "qr" : (tm <= tt ? "mgs" : "tsqr");
+  std::cout << std::setw(10) << "qr/mgs" << std::setw(28) << std::fixed
+    << std::setprecision(2) << tm / tq << "x, fastest " << best << "\n" << std::defaultfloat;
+}
+
+
+// the former binary operators: copy one operand, then a compound assignment
+MatC add_copy(const MatC& x, const MatC& y)
+{
+  MatC t(y);
+  t += x;
+  return t;
+}
+
+MatC mul_copy(const MatC& x, const MatC& y)
+{
+  MatC t(y);
+  t *= x;
+  return t;
+}
+
+
+// D = A + B * C: temporaries of the former operators against the fused expression
+void bench_ops(const size_t m, const size_t n, const size_t reps = 10)
+{
+  MatC A(m, n), B(m, n), C(m, n), D(m, n);
+  randomize(A);
+  randomize(B);
+  randomize(C);
+  const double mn = static_cast<double>(m) * n;
+
+  size_t a0 = g_allocs, b0 = g_bytes;
+  const double tc = seconds([&] {
+    for (size_t r = 0; r < reps; ++r)
+    {
+      MatC BC = mul_copy(B, C);
+      D = add_copy(A, BC);
+    }
+  }) / reps;
+  const size_t ac = (g_allocs - a0) / reps;
+  const double mc = (g_bytes - b0) * 1e-6 / reps;
+  // copy C, B*C, copy BC, A+BC, D=: 11 passes of 8 bytes
+  const double bc = 11.0 * 8.0 * mn;
+
+  a0 = g_allocs;
+  b0 = g_bytes;
+  const double te = seconds([&] {
+    for (size_t r = 0; r < reps; ++r)
+      D = A + B * C;
+  }) / reps;
+  const size_t ae = (g_allocs - a0) / reps;
+  const double me = (g_bytes - b0) * 1e-6 / reps;
+  const double be = 4.0 * 8.0 * mn;
+
+  std::cout << std::setw(10) << "kernel" << std::setw(9) << "rows" << std::setw(7) << "cols"
+    << std::setw(12) << "time[s]" << std::setw(10) << "GB/s" << std::setw(8) << "allocs"
+    << std::setw(12) << "MB alloc" << std::setw(12) << "MB moved" << "\n";
+  for (int k = 0; k < 2; ++k)
+  {
+    const double t = k ? te : tc;
+    const double b = k ? be : bc;
+    std::cout << std::setw(10) << (k ? "fused" : "copy") << std::setw(9) << m << std::setw(7) << n
+      << std::setw(12) << std::fixed << std::setprecision(4) << t
+      << std::setw(10) << std::setprecision(2) << b / t * 1e-9
+      << std::setw(8) << (k ? ae : ac) << std::setw(12) << std::setprecision(1) << (k ? me : mc)
+      << std::setw(12) << b * 1e-6 << std::defaultfloat << "\n";
+  }
+}
+
+
+// column sums of squares: std::inner_product against the simd kernels
+void bench_norms(const size_t m, const size_t n, const size_t reps = 20)
+{
+  MatD A(m, n), s(1, n);
+  randomize(A);
+  const double bytes = 8.0 * m * n;
+  volatile double sink = 0.0;
+
+  const double ts = seconds([&] {
+    for (size_t r = 0; r < reps; ++r)
+      for (size_t j = 0; j < n; ++j)
+        s(0, j) = std::inner_product(A.begincol(j), A.endcol(j), A.begincol(j), 0.0);
+  }) / reps;
+  sink = sink + s(0, 0);
+  std::cout << std::setw(10) << "std" << std::setw(9) << m << std::setw(7) << n
+    << std::setw(12) << std::fixed << std::setprecision(5) << ts
+    << std::setw(10) << std::setprecision(2) << bytes / ts * 1e-9 << std::defaultfloat << "\n";
+
+  for (int l = 0; l <= static_cast<int>(igm::simd::cpu_isa()); ++l)
+  {
+    const auto level = static_cast<igm::simd::isa>(l);
+    igm::simd::set_isa(level);
+    const double t = seconds([&] {
+      for (size_t r = 0; r < reps; ++r)
+        igm::sumabs2_col(s, A, 0);
+    }) / reps;
+    sink = sink + s(0, 0);
+    std::cout << std::setw(10) << igm::simd::isa_name(level) << std::setw(9) << m << std::setw(7) << n
+      << std::setw(12) << std::fixed << std::setprecision(5) << t
+      << std::setw(10) << std::setprecision(2) << bytes / t * 1e-9 << std::defaultfloat << "\n";
+  }
+  igm::simd::set_isa(igm::simd::cpu_isa());
+}
+
+
+// C = A*B with A m x n and B n x n on every instruction set of the native gemm
+template<typename T>
+void bench_gemm(const size_t m, const size_t n, const char* type)
+{
+  RandReal<double> rnd(-1.0, 1.0);
+  std::vector<T> A(m * n), B(n * n), C(m * n);
+  for (auto& a : A) a = static_cast<T>(rnd());
+  for (auto& b : B) b = static_cast<T>(rnd());
+  const double flops = 2.0 * m * n * n;
+
+  for (int l = 0; l <= static_cast<int>(igm::simd::cpu_isa()); ++l)
+  {
+    const auto level = static_cast<igm::simd::isa>(l);
+    igm::simd::set_isa(level);
+    igm::blas::native::gemm<T>(false, false, m, n, n, T(1), A.data(), m, B.data(), n, T(0), C.data(), m);
+    const double t = seconds([&] {
+      igm::blas::native::gemm<T>(false, false, m, n, n, T(1), A.data(), m, B.data(), n, T(0), C.data(), m);
+    });
+    std::cout << std::setw(10) << igm::simd::isa_name(level) << std::setw(4) << type
+      << std::setw(9) << m << std::setw(7) << n
+      << std::setw(12) << std::fixed << std::setprecision(5) << t
+      << std::setw(10) << std::setprecision(2) << flops / t * 1e-9 << std::defaultfloat << "\n";
+  }
+  igm::simd::set_isa(igm::simd::cpu_isa());
+}
+
+
+// roofline of the machine: STREAM triads over working sets from 48 KB to
+// 192 MB for the bandwidth and a large gemm of the configured BLAS for the
+// attainable GFLOP/s
+bench::roofline measure_roofline()
+{
+  bench::roofline r;
+  size_t reps;
+  for (size_t n = 2048; n <= (size_t{ 1 } << 23); n *= 4)
+  {
+    std::vector<double> a(n), b(n, 1.0), c(n, 2.0);
+    const double t = bench::measure([] {}, [&] {
+#pragma omp parallel for schedule(static)
+      for (long long i = 0; i < static_cast<long long>(n); ++i)
+        a[i] = b[i] + 3.0 * c[i];
+    }, reps, 0.05, 1000);
+    r.bw.push_back({ 24.0 * n, 24.0 * n / t * 1e-9 });
+  }
+
+  const size_t k = 1024;
+  std::vector<double> A(k * k, 0.5), B(k * k, 0.25), C(k * k);
+  const double tg = bench::measure([] {}, [&] {
+    igm::blas::gemm(CblasNoTrans, CblasNoTrans, k, k, k, 1.0, A.data(), k, B.data(), k, 0.0, C.data(), k);
+  }, reps, 0.2, 5);
+  r.gflops = 2.0 * k * k * k / tg * 1e-9;
+  return r;
+}
+
+
+// m x n random matrix, a sub-view of an (m+2) x (n+2) matrix when view is set
+MatD make(const size_t m, const size_t n, const bool view)
+{
+  MatD A(view ? m + 2 : m, view ? n + 2 : n);
+  randomize(A);
+  if (view)
+    A.sub(1, m, 1, n);
+  return A;
+}
+
+
+struct suite {
+  std::string filter;
+  bench::roofline roof;
+  std::vector<bench::result> results;
+
+  template<typename P, typename F>
+  void run(const char* kernel, const size_t m, const size_t n, const bool view,
+    const double flops, const double bytes, const double footprint, P prepare, F f)
+  {
+    run(kernel, std::to_string(m) + "x" + std::to_string(n) + (view ? "v" : ""), m, n, view,
+      flops, bytes, footprint, prepare, f);
+  }
+
+  template<typename P, typename F>
+  void run(const char* kernel, const std::string& shape, const size_t m, const size_t n, const bool view,
+    const double flops, const double bytes, const double footprint, P prepare, F f)
+  {
+    if (std::string(kernel).find(filter) == std::string::npos)
+      return;
+    bench::result r;
+    r.kernel = kernel;
+    r.shape = shape;
+    r.rows = m;
+    r.cols = n;
+    r.view = view;
+    r.flops = flops;
+    r.bytes = bytes;
+    r.footprint = footprint;
+    r.time = bench::measure(prepare, f, r.reps);
+    bench::print(r, roof);
+    results.push_back(r);
+  }
+};
+
+
+// every kernel on one shape; flops and bytes are the cost models, bytes
+// count the traffic of 8 byte elements, the footprint the operands
+void run_shape(suite& s, const size_t m, const size_t n, const bool view)
+{
+  const double mn = static_cast<double>(m) * n;
+  const double fa = 8.0 * mn;
+  const auto none = [] {};
+  MatD A = make(m, n, view);
+  MatD Q(A), R(n, n);
+
+  if (n <= 400) {
+    s.run("mgs", m, n, view, 2.0 * mn * n, 12.0 * mn * n, fa,
+      [&] { Q = A; }, [&] { igm::dpr::mgs(Q, R); });
+    s.run("qr", m, n, view, 2.0 * (2.0 * mn * n - 2.0 * n * n * n / 3.0), 16.0 * mn, fa,
+      [&] { Q = A; }, [&] { igm::qr(Q, R); });
+    // the F update of geqp3 reads the trailing matrix once per column
+    igm::Mat<size_t> perm;
+    s.run("qrcp", m, n, view, 2.0 * (2.0 * mn * n - 2.0 * n * n * n / 3.0), 8.0 * mn * n / 3.0 + 16.0 * mn, fa,
+      [&] { Q = A; }, [&] { igm::qrcp(Q, R, perm); });
+    s.run("tsqr", m, n, view, 2.0 * (2.0 * mn * n - 2.0 * n * n * n / 3.0), 32.0 * mn, fa,
+      [&] { Q = A; }, [&] { igm::tsqr(Q, R); });
+    // least squares by a double QR against the float QR with refinement
+    MatD b = make(m, 1, view), xs(n, 1);
+    const double fls = 2.0 * mn * n - 2.0 * n * n * n / 3.0 + 4.0 * mn;
+    s.run("lstsq", m, n, view, fls, 16.0 * mn, fa, none,
+      [&] { igm::detail::solve_qr(xs, A, b); });
+    s.run("lstsq_mixed", m, n, view, fls, 12.0 * mn, fa, none,
+      [&] { igm::solve_mixed(xs, A, b); });
+    // forward selection of up to 16 columns, gemv + ger per step; y is the
+    // sum of all columns (b repeats the first one, the generator is seeded
+    // the same), so every step is taken
+    const double ks = static_cast<double>(std::min<size_t>(n, 16));
+    MatD w(n, 1), y(m, 1);
+    w.fill(1.0);
+    igm::blas::gemm(y, A, w);
+    s.run("fwd_select", m, n, view, 4.0 * mn * ks, 24.0 * mn * ks, fa, none,
+      [&] { igm::ForwardSelect<double>(A, y, 16).run(); });
+  }
+  s.run("mgs_k", m, n, view, 4.0 * mn, 24.0 * mn, fa,
+    [&] { Q = A; }, [&] { igm::dpr::mgs_k(Q, R, 0); });
+
+  MatD x = make(m, 1, view), y = make(1, n, view), d(1, n), d1(1, n - 1);
+  s.run("mtv", m, n, view, 2.0 * mn, 8.0 * (mn + m + n), fa, none,
+    [&] { igm::dpr::mtv(d, A, x); });
+  s.run("mtv_s", m, n, view, 2.0 * mn, fa, fa, none,
+    [&] { igm::dpr::mtv_s(d1, A, 0.5); });
+  s.run("blas::gemv", m, n, view, 2.0 * mn, 8.0 * (mn + m + n), fa, none,
+    [&] { igm::blas::gemv(d, A, x); });
+  s.run("sumabs2_col", m, n, view, 2.0 * mn, fa, fa, none,
+    [&] { igm::sumabs2_col(d, A, 0); });
+
+  // the rank-1 updates grow Q, restore it now and then
+  Q = A;
+  s.run("ger_s", m, n, view, 3.0 * mn, 2.0 * fa, fa, none,
+    [&] { igm::dpr::ger_s(Q, y, 1e-3); });
+  Q = A;
+  s.run("blas::ger", m, n, view, 2.0 * mn, 2.0 * fa, fa, none,
+    [&] { igm::blas::ger(Q, x, y, 1e-3); });
+
+  MatD B = make(m, n, view), C = make(m, n, view), D = make(m, n, view);
+  s.run("add", m, n, view, mn, 3.0 * fa, 3.0 * fa, none, [&] { D = A + B; });
+  s.run("fma", m, n, view, 2.0 * mn, 4.0 * fa, 4.0 * fa, none, [&] { D = A + B * C; });
+  s.run("scale", m, n, view, mn, 2.0 * fa, fa, none, [&] { D *= 1.0; });
+
+  // every other column
+  igm::Mat<size_t> idx(1, (n + 1) / 2);
+  for (size_t j = 0; j < idx.cols(); ++j)
+    idx(0, j) = 2 * j;
+  MatD G(m, idx.cols());
+  const double fg = 16.0 * m * idx.cols();
+  s.run("sub(idx)", m, n, view, 0.0, fg, fa + fg / 2.0, none,
+    [&] { igm::sub_into(G, A, idx); });
+  s.run("gather_stream", m, n, view, 0.0, fg, fa + fg / 2.0, none,
+    [&] { igm::gather_cols(G, A, idx, igm::copy_mode::stream); });
+  // a rotation of the columns by one, a single cycle
+  igm::Mat<size_t> perm(1, n);
+  for (size_t j = 0; j < n; ++j)
+    perm(0, j) = (j + 1) % n;
+  Q = A;
+  s.run("permute_cols", m, n, view, 0.0, 2.0 * fa, fa, none,
+    [&] { igm::permute_cols(Q, perm); });
+
+  if (n <= 1000) {
+    MatD S = make(n, n, view), P(m, n);
+    const double fm = 8.0 * (2.0 * mn + static_cast<double>(n) * n);
+    s.run("blas::gemm", m, n, view, 2.0 * mn * n, fm, fm, none,
+      [&] { igm::blas::gemm(P, A, S); });
+
+    // the upper triangle of S against m right-hand sides
+    for (size_t i = 0; i < n; ++i)
+      S(i, i) += static_cast<double>(n);
+    MatD X0 = make(n, m, view), X(X0);
+    const double ft = 8.0 * (0.5 * n * n + 2.0 * mn);
+    s.run("trsm", m, n, view, mn * n, ft, ft,
+      [&] { X = X0; }, [&] { igm::trsm(S, X); });
+  }
+}
+
+
+// count problems of m x n: the interleaved batch kernels against a loop
+// over one Mat per problem; the shape is "m x n * count"
+void run_batch(suite& s, const size_t count, const size_t m, const size_t n)
+{
+  const std::string shape = std::to_string(m) + "x" + std::to_string(n) + "*" + std::to_string(count);
+  const double c = static_cast<double>(count), mn = static_cast<double>(m) * n;
+  const double fqr = c * 2.0 * n * n * (m - n / 3.0);
+  const double fls = fqr + c * (4.0 * mn + static_cast<double>(n) * n);
+  const double fa = 8.0 * c * mn;
+  const auto none = [] {};
+  RandReal<double> rnd(-1.0, 1.0);
+
+  igm::MatBatch<double> A(count, m, n), W(count, m, n), tau(count, n, 1), b(count, m, 1), x(count, n, 1),
+    y(count, m, 1), bw(count, m, 1);
+  std::vector<MatD> As(count), Ws(count), Rs(count, MatD(n, n)), xs(count, MatD(n, 1)), ys(count, MatD(m, 1));
+  for (size_t k = 0; k < count; ++k)
+  {
+    As[k] = MatD(m, n);
+    randomize(As[k]);
+    A.set(k, As[k]);
+    for (size_t i = 0; i < m; ++i)
+      b(k, i, 0) = rnd();
+    for (size_t i = 0; i < n; ++i)
+      x(k, i, 0) = xs[k](i, 0) = rnd();
+  }
+
+  s.run("batch::gemv", shape, m, n, false, 2.0 * c * mn, fa, fa, none,
+    [&] { igm::batch::gemv(y, A, x); });
+  s.run("loop::gemv", shape, m, n, false, 2.0 * c * mn, fa, fa, none, [&] {
+    for (size_t k = 0; k < count; ++k)
+      igm::blas::gemv(ys[k], As[k], xs[k], 1.0, 0.0, CblasNoTrans);
+  });
+  s.run("batch::qr", shape, m, n, false, fqr, 2.0 * fa, fa,
+    [&] { W = A; }, [&] { igm::batch::qr(W, tau); });
+  s.run("loop::qr", shape, m, n, false, fqr, 2.0 * fa, fa, [&] { Ws = As; }, [&] {
+    for (size_t k = 0; k < count; ++k)
+      igm::qr(Ws[k], Rs[k]);
+  });
+  s.run("batch::lstsq", shape, m, n, false, fls, 2.0 * fa, fa,
+    [&] { W = A; bw = b; }, [&] { igm::batch::lstsq(W, tau, bw); });
+}
+
+
+// count small N x N products and solves, FixedMat against Mat and gemm
+template<size_t N>
+void run_fixed(suite& s, const size_t count)
+{
+  const std::string shape = std::to_string(N) + "x" + std::to_string(N) + "*" + std::to_string(count);
+  const double c = static_cast<double>(count), n = static_cast<double>(N);
+  const double fa = 16.0 * c * n * n;
+  const auto none = [] {};
+  std::vector<igm::FixedMat<double, N, N>> A(count), P(count);
+  std::vector<MatD> Am(count, MatD(N, N)), Pm(count, MatD(N, N));
+  for (size_t k = 0; k < count; ++k)
+  {
+    randomize(Am[k]);
+    for (size_t i = 0; i < N; ++i)
+      Am[k](i, i) += n;
+    std::copy(Am[k].begin(), Am[k].end(), A[k].begin());
+  }
+
+  s.run("fixed::mul", shape, N, N, false, 2.0 * c * n * n * n, 24.0 * c * n * n, fa, none, [&] {
+    for (size_t k = 0; k < count; ++k)
+      P[k] = igm::mul(A[k], A[k]);
+  });
+  s.run("loop::gemm", shape, N, N, false, 2.0 * c * n * n * n, 24.0 * c * n * n, fa, none, [&] {
+    for (size_t k = 0; k < count; ++k)
+      igm::blas::gemm(Pm[k], Am[k], Am[k]);
+  });
+  s.run("fixed::solve", shape, N, N, false, c * (2.0 * n * n * n / 3.0 + 2.0 * n * n * n), 24.0 * c * n * n, fa,
+    none, [&] {
+    for (size_t k = 0; k < count; ++k)
+      P[k] = igm::solve(A[k], P[k]);
+  });
+}
+
+
+// m x n with density 2%, the sparse kernels; the dense gemv of the same
+// shape is blas::gemv of run_shape. Bytes count a value and a row index
+// per nonzero; the shape is "m x n @2%"
+void run_sparse(suite& s, const size_t m, const size_t n)
+{
+  const std::string shape = std::to_string(m) + "x" + std::to_string(n) + "@2%";
+  RandReal<double> rnd(0.0, 1.0);
+  std::vector<igm::Triplet<double>> t;
+  for (size_t k = 0; k < m * n / 50; ++k)
+    t.push_back({ static_cast<size_t>(rnd() * (m - 1)), static_cast<size_t>(rnd() * (n - 1)), rnd() });
+  const igm::SparseMat<double> S(m, n, t);
+  const double nz = static_cast<double>(S.nnz());
+  const double fa = 16.0 * nz;
+  const auto none = [] {};
+  MatD x = make(n, 1, false), xt = make(m, 1, false), y(m, 1), yt(n, 1), d(1, n);
+
+  s.run("spmv", shape, m, n, false, 2.0 * nz, fa + 8.0 * (n + 2.0 * m), fa, none,
+    [&] { igm::spmv(y, S, x); });
+  s.run("spmv_t", shape, m, n, false, 2.0 * nz, fa + 8.0 * (m + n), fa, none,
+    [&] { igm::spmv_t(yt, S, xt); });
+  s.run("sp_sumabs2", shape, m, n, false, 2.0 * nz, 8.0 * nz, fa, none,
+    [&] { igm::sumabs2_col(d, S, 0); });
+}
+
+
+int main(int argc, char* argv[])
+{
+  std::vector<std::pair<size_t, size_t>> shapes{ { 1000, 100 },{ 4000, 400 },{ 20000, 200 },
+    { 200000, 16 },{ 1000, 1000 } };
+  // narrow shapes from in cache to far beyond it, the qr/mgs crossover
+  std::vector<std::pair<size_t, size_t>> narrow{ { 20000, 4 },{ 20000, 8 },{ 200000, 4 },
+    { 200000, 8 },{ 200000, 16 },{ 1000000, 8 } };
+  std::vector<std::array<size_t, 3>> batches{ { 20000, 8, 8 },{ 20000, 32, 16 },{ 2000, 64, 64 } };
+  size_t fixed_count = 20000;
+  std::string json;
+  suite s;
+  bool detail = false, peak = false;
+  std::vector<size_t> dims;
+  for (int i = 1; i < argc; ++i)
+  {
+    const std::string a = argv[i];
+    if (a == "--compare" && i + 2 < argc) {
+      const double tol = i + 3 < argc ? std::strtod(argv[i + 3], nullptr) : 0.1;
+      const size_t r = bench::compare(bench::read_json(argv[i + 1]), bench::read_json(argv[i + 2]), tol);
+      return static_cast<int>(std::min<size_t>(r, 125));
+    }
+    else if (a == "--json" && i + 1 < argc)
+      json = argv[++i];
+    else if (a == "--filter" && i + 1 < argc)
+      s.filter = argv[++i];
+    else if (a == "--peak" && i + 2 < argc) {
+      s.roof.gflops = std::strtod(argv[++i], nullptr);
+      s.roof.bw = { { 1e300, std::strtod(argv[++i], nullptr) } };
+      peak = true;
+    }
+    else if (a == "--quick") {
+      shapes = { { 500, 50 },{ 20000, 8 } };
+      narrow = { { 20000, 4 },{ 200000, 8 } };
+      batches = { { 1000, 16, 8 } };
+      fixed_count = 1000;
+    }
+    else if (a == "--detail")
+      detail = true;
+    else
+      dims.push_back(std::strtoull(argv[i], nullptr, 10));
+  }
+  if (dims.size() == 2)
+    shapes = { { dims[0], dims[1] } };
+
+  if (detail) {
+    std::cout << std::setw(10) << "kernel" << std::setw(9) << "rows" << std::setw(7) << "cols"
+      << std::setw(12) << "time[s]" << std::setw(10) << "GFLOP/s" << std::setw(12) << "orth" << "\n";
+    for (auto& sh : shapes)
+      bench_qr(sh.first, sh.second);
+    std::cout << "\nnarrow, the qr/mgs crossover\n";
+    for (auto& sh : narrow)
+      bench_qr(sh.first, sh.second);
+
+    std::cout << "\nD = A + B * C\n";
+    for (auto& sh : shapes)
+      bench_ops(sh.first, sh.second);
+
+    std::cout << "\ncolumn sums of squares\n" << std::setw(10) << "kernel" << std::setw(9) << "rows"
+      << std::setw(7) << "cols" << std::setw(12) << "time[s]" << std::setw(10) << "GB/s" << "\n";
+    for (auto& sh : shapes)
+      bench_norms(sh.first, sh.second);
+
+    std::cout << "\nnative gemm C = A * B\n" << std::setw(10) << "kernel" << std::setw(4) << "T"
+      << std::setw(9) << "rows" << std::setw(7) << "cols" << std::setw(12) << "time[s]"
+      << std::setw(10) << "GFLOP/s" << "\n";
+    for (auto& sh : shapes)
+    {
+      bench_gemm<double>(sh.first, sh.second, "d");
+      bench_gemm<float>(sh.first, sh.second, "s");
+    }
+    return 0;
+  }
+
+  if (!peak)
+    s.roof = measure_roofline();
+  const std::string isa = igm::simd::isa_name(igm::simd::current_isa());
+  std::cout << "blas " << igm::blas::backend::name() << ", " << isa << ", "
+    << omp_get_max_threads() << " threads, roofline " << s.roof.gflops << " GFLOP/s, "
+    << s.roof.gbs(1e300) << " GB/s from memory\n";
+  igm::prof::reset();
+  bench::print_header();
+  for (auto& sh : shapes)
+    for (bool view : { false, true })
+      run_shape(s, sh.first, sh.second, view);
+  for (auto& b : batches)
+    run_batch(s, b[0], b[1], b[2]);
+  for (auto& sh : shapes)
+    run_sparse(s, sh.first, sh.second);
+  run_fixed<3>(s, fixed_count);
+  run_fixed<4>(s, fixed_count);
+  run_fixed<6>(s, fixed_count);
+
+  if (!json.empty())
+    bench::write_json(json, s.roof, igm::blas::backend::name(), isa, omp_get_max_threads(), s.results);
+#ifdef IGM_PROFILE
+  std::cout << "\n";
+  igm::prof::print(std::cout);
+#endif
+  return 0;
+}
@@ -3,11 +3,39 @@
 
 #include <iostream>
 #include <numeric>
+#include <vector>
+#include <sstream>
+#include <atomic>
+#include <cstdlib>
+#include <cstdio>
+#include <new>
+#include <limits>
+#include <complex>
+#include <cstdint>
+#include <algorithm>
 #include "gtest.h"
 
+// heap allocations of the process, Mat buffers are counted by the hook of
+// aligned_allocator and everything else by the global operator new below
+static std::atomic<size_t> g_heap_allocs{ 0 };
+#define IGM_ALLOC_HOOK(bytes) ++g_heap_allocs
+
 #include "../matrix/matrix_igm.hpp"
 #include "../matrix/matrix_lpack.h"
 #include "../matrix/matrix_lpack_blas.h"
+#include "../matrix/matrix_qr.h"
+#include "../matrix/matrix_qr_update.h"
+#include "../matrix/matrix_batch.h"
+#include "../matrix/matrix_mixed.h"
+#include "../matrix/matrix_trsm.h"
+#include "../matrix/matrix_mmap.h"
+#include "../matrix/matrix_tsqr.h"
+#include "../matrix/matrix_select.h"
+#include "../matrix/matrix_prof.h"
+#include "../matrix/matrix_arena.h"
+#include "../matrix/matrix_fixed.h"
+#include "../matrix/matrix_sparse.h"
+#include "../matrix/utilrnd.hpp"
 
 
 #define SHOW_RESULTS
@@ -16,10 +44,61 @@ using MatI = igm::Mat<int>;
 using MatD = igm::Mat<double>;
 using std::cout;
 
-template<typename T>
-void Iota(std::valarray<T>& v, const T init=1)
+// every form of the global operators is replaced, so that new and delete
+// always pair; malloc and free sit behind functions which are not inlined,
+// otherwise gcc sees free() on the result of a new-expression and warns
+// (-Wmismatched-new-delete)
+#if defined(_MSC_VER)
+#define TEST_NOINLINE __declspec(noinline)
+#else
+#define TEST_NOINLINE __attribute__((noinline))
+#endif
+
+TEST_NOINLINE void* counted_malloc(const size_t n) noexcept
+{
+  ++g_heap_allocs;
+  return std::malloc(n ? n : 1);
+}
+TEST_NOINLINE void counted_free(void* p) noexcept { std::free(p); }
+
+void* operator new(size_t n)
+{
+  if (void* p = counted_malloc(n))
+    return p;
+  throw std::bad_alloc();
+}
+void* operator new[](size_t n) { return operator new(n); }
+void* operator new(size_t n, const std::nothrow_t&) noexcept { return counted_malloc(n); }
+void* operator new[](size_t n, const std::nothrow_t&) noexcept { return counted_malloc(n); }
+void operator delete(void* p) noexcept { counted_free(p); }
+void operator delete[](void* p) noexcept { counted_free(p); }
+void operator delete(void* p, size_t) noexcept { counted_free(p); }
+void operator delete[](void* p, size_t) noexcept { counted_free(p); }
+void operator delete(void* p, const std::nothrow_t&) noexcept { counted_free(p); }
+void operator delete[](void* p, const std::nothrow_t&) noexcept { counted_free(p); }
+
+#ifdef __cpp_aligned_new
+// over-aligned types: the block is padded and the pointer malloc returned
+// is kept in front of the aligned address
+void* operator new(size_t n, std::align_val_t al)
+{
+  const size_t a = std::max(static_cast<size_t>(al), sizeof(void*));
+  void* q = operator new(n + a);
+  void* p = reinterpret_cast<void*>((reinterpret_cast<uintptr_t>(q) + a) / a * a);
+  static_cast<void**>(p)[-1] = q;
+  return p;
+}
+void* operator new[](size_t n, std::align_val_t al) { return operator new(n, al); }
+void operator delete(void* p, std::align_val_t) noexcept { if (p) counted_free(static_cast<void**>(p)[-1]); }
+void operator delete[](void* p, std::align_val_t al) noexcept { operator delete(p, al); }
+void operator delete(void* p, size_t, std::align_val_t al) noexcept { operator delete(p, al); }
+void operator delete[](void* p, size_t, std::align_val_t al) noexcept { operator delete(p, al); }
+#endif
+
+template<typename V>
+void Iota(V& v, const int init=1)
 {
-  std::iota<T*, T>(std::begin(v), std::end(v), init);
+  std::iota(std::begin(v), std::end(v), init);
 }
 
 // column order matrix
@@ -52,7 +131,7 @@ TEST(matrix_initializer_list_constuctor, matrix_initializer_list_constuctor_inde
   MatI::val_type* pData = A.M();
   for (size_t i = 0; i < A.size(); ++i)
   {
-    ASSERT_EQ(pData[i], i + 1);
+    ASSERT_EQ(pData[i], static_cast<int>(i + 1));
   }
 }
 
@@ -478,3 +557,1876 @@ TEST(gemv_blas, gemv_blas_2_special_case)
 
 }
 
+
+TEST(qr_householder, qr_householder_orthonormal)
+{
+  RandReal<double> rnd(-1.0, 1.0);
+  MatD A(57, 23);
+  for (auto a = A.begin(); a != A.end(); ++a)
+    *a = rnd();
+  MatD Q(A);
+  MatD R(A.cols(), A.cols());
+
+  igm::qr(Q, R, 8);
+
+  for (size_t i = 0; i < Q.cols(); ++i)
+  {
+    for (size_t j = 0; j < Q.cols(); ++j)
+    {
+      double s = std::inner_product(Q.begincol(i), Q.endcol(i), Q.begincol(j), 0.0);
+      ASSERT_NEAR(s, i == j ? 1.0 : 0.0, 1e-12);
+    }
+  }
+  for (size_t i = 0; i < A.rows(); ++i)
+  {
+    for (size_t j = 0; j < A.cols(); ++j)
+    {
+      double s = 0.0;
+      for (size_t l = 0; l <= j; ++l)
+        s += Q(i, l) * R(l, j);
+      ASSERT_NEAR(s, A(i, j), 1e-12);
+      if (i > j && i < R.rows()) {
+        ASSERT_EQ(R(i, j), 0.0);
+      }
+    }
+  }
+}
+
+
+TEST(qr_householder, qr_householder_subview)
+{
+  RandReal<double> rnd(-1.0, 1.0);
+  MatD A(40, 30);
+  for (auto a = A.begin(); a != A.end(); ++a)
+    *a = rnd();
+  MatD B(A);
+  MatD tau(1, 15);
+
+  A.sub(2, 37, 5, 19);
+  B.sub(A.slc());
+  igm::geqrf(A, tau, 4);
+  igm::ormqr(B, A, tau);
+
+  // Q'*B reproduces R and annihilates everything below it
+  for (size_t j = 0; j < A.cols(); ++j)
+  {
+    for (size_t i = 0; i < A.rows(); ++i)
+      ASSERT_NEAR(B(i, j), i <= j ? A(i, j) : 0.0, 1e-12);
+  }
+
+  // the factorization stays inside the view
+  A.subreset();
+  B.subreset();
+  for (size_t i = 0; i < A.rows(); ++i)
+  {
+    ASSERT_EQ(A(i, 4), B(i, 4));
+    ASSERT_EQ(A(i, 20), B(i, 20));
+  }
+  ASSERT_EQ(A(1, 10), B(1, 10));
+  ASSERT_EQ(A(38, 10), B(38, 10));
+}
+
+
+TEST(qr_pivoted, qr_pivoted_rank)
+{
+  RandReal<double> rnd(-1.0, 1.0);
+  // 70 x 29 of rank 11 with widely scaled columns; a block of 4 runs many
+  // panels and the norm downdates cancel once the rank is exhausted
+  MatD B(70, 11), C(11, 29), A(70, 29);
+  for (auto a = B.begin(); a != B.end(); ++a)
+    *a = rnd();
+  for (auto a = C.begin(); a != C.end(); ++a)
+    *a = rnd();
+  igm::blas::gemm(A, B, C);
+  for (size_t j = 0; j < A.cols(); ++j)
+    std::transform(A.begincol(j), A.endcol(j), A.begincol(j), [j](const double a) { return a * std::pow(2.0, double(j % 7) - 3.0); });
+
+  MatD Q(A), R(A.cols(), A.cols());
+  igm::Mat<size_t> perm;
+  igm::qrcp(Q, R, perm, 4);
+  ASSERT_EQ(igm::qr_rank(R), 11u);
+
+  // A(:, perm) = Q*R, the pivots dominate the rest of their rows
+  MatD AP = A.sub(perm);
+  for (size_t i = 0; i < A.rows(); ++i)
+  {
+    for (size_t j = 0; j < A.cols(); ++j)
+    {
+      double s = 0.0;
+      for (size_t l = 0; l <= j; ++l)
+        s += Q(i, l) * R(l, j);
+      ASSERT_NEAR(s, AP(i, j), 1e-12);
+    }
+  }
+  for (size_t i = 0; i < 11; ++i)
+  {
+    for (size_t j = i + 1; j < A.cols(); ++j)
+    {
+      double s = 0.0;
+      for (size_t l = i; l <= j; ++l)
+        s += R(l, j) * R(l, j);
+      ASSERT_LE(std::sqrt(s), std::abs(R(i, i)) * (1.0 + 1e-12));
+    }
+  }
+
+  // full rank: the permutation is a permutation, the R of geqp3 matches
+  MatD F(40, 17), G;
+  for (auto a = F.begin(); a != F.end(); ++a)
+    *a = rnd();
+  G = F;
+  MatD tau(1, 17);
+  igm::geqp3(G, tau, perm);
+  ASSERT_EQ(igm::qr_rank(G), 17u);
+  std::vector<size_t> p(perm.begin(), perm.end());
+  std::sort(p.begin(), p.end());
+  for (size_t j = 0; j < p.size(); ++j)
+    ASSERT_EQ(p[j], j);
+  MatD FP = F.sub(perm);
+  igm::ormqr(FP, G, tau);
+  for (size_t j = 0; j < F.cols(); ++j)
+  {
+    for (size_t i = 0; i < F.rows(); ++i)
+      ASSERT_NEAR(FP(i, j), i <= j ? G(i, j) : 0.0, 1e-12);
+  }
+}
+
+
+// Q*R reproduces the active columns of A, Q is orthonormal and R upper triangular
+void check_qr_update(const igm::QRUpdate<double>& qr, const MatD& A)
+{
+  const MatD& Q = qr.Q();
+  const MatD& R = qr.R();
+  for (size_t j = 0; j < qr.cols(); ++j)
+  {
+    const size_t c = qr.idx()(0, j);
+    for (size_t i = 0; i < qr.rows(); ++i)
+    {
+      double s = 0.0;
+      for (size_t l = 0; l <= j; ++l)
+        s += Q(i, l) * R(l, j);
+      ASSERT_NEAR(s, A(i, c), 1e-12);
+    }
+    for (size_t l = 0; l < qr.cols(); ++l)
+    {
+      double s = std::inner_product(Q.begincol(j), Q.endcol(j), Q.begincol(l), 0.0);
+      ASSERT_NEAR(s, j == l ? 1.0 : 0.0, 1e-12);
+      if (l > j) {
+        ASSERT_EQ(R(l, j), 0.0);
+      }
+    }
+  }
+}
+
+
+TEST(qr_update, qr_update_append_remove)
+{
+  RandReal<double> rnd(-1.0, 1.0);
+  MatD A(30, 8);
+  for (auto a = A.begin(); a != A.end(); ++a)
+    *a = rnd();
+
+  igm::QRUpdate<double> qr(A.rows(), 6);
+  for (size_t c : { 4, 1, 7, 0, 5 })
+    ASSERT_TRUE(qr.append(A, c));
+  check_qr_update(qr, A);
+
+  qr.remove(1);
+  ASSERT_EQ(qr.cols(), 4u);
+  ASSERT_EQ(qr.idx()(0, 1), 7u);
+  check_qr_update(qr, A);
+
+  qr.remove(3);
+  qr.remove(0);
+  check_qr_update(qr, A);
+
+  // a dependent column is rejected
+  std::copy(A.begincol(7), A.endcol(7), A.begincol(6));
+  ASSERT_FALSE(qr.append(A, 6));
+  ASSERT_EQ(qr.cols(), 2u);
+}
+
+
+TEST(qr_update, qr_update_swap)
+{
+  RandReal<double> rnd(-1.0, 1.0);
+  MatD A(20, 6);
+  for (auto a = A.begin(); a != A.end(); ++a)
+    *a = rnd();
+
+  igm::QRUpdate<double> qr(A.rows(), A.cols());
+  for (size_t c = 0; c < A.cols(); ++c)
+    qr.append(A, c);
+
+  qr.swap(4, 1);
+  ASSERT_EQ(qr.idx()(0, 1), 4u);
+  ASSERT_EQ(qr.idx()(0, 4), 1u);
+  ASSERT_EQ(qr.idx()(0, 2), 2u);
+  check_qr_update(qr, A);
+
+  qr.swap(0, 5);
+  check_qr_update(qr, A);
+}
+
+
+TEST(matrix_expression, matrix_expression_fused)
+{
+  MatI A{ { 1, 2, 3 },{ 4, 5, 6 } };
+  MatI B{ { 6, 5, 4 },{ 3, 2, 1 } };
+  MatI C{ { 2, 2, 2 },{ 3, 3, 3 } };
+
+  MatI D = A - B * C + 1;
+  MatI R{ { -10, -7, -4 },{ -4, 0, 4 } };
+  for (size_t i = 0; i < R.size(); ++i)
+  {
+    ASSERT_EQ(D.at(i), R.at(i));
+  }
+
+  D += A % C;
+  ASSERT_EQ(D(0, 0), -9);
+  ASSERT_EQ(D(2, 1), 4);
+
+  MatI E;
+  E = (A + B) / C;
+  ASSERT_EQ(E.rows(), 3u);
+  ASSERT_EQ(E.cols(), 2u);
+  ASSERT_EQ(E(0, 0), 3);
+  ASSERT_EQ(E(2, 1), 2);
+}
+
+
+TEST(matrix_expression, matrix_expression_views)
+{
+  MatI A{ { 1,   2,  3,  4,  5 },
+  { 6,   7,  8,  9, 10 },
+  { 11, 12, 13, 14, 15 },
+  { 16, 17, 18, 19, 20 } };
+  MatI B(A);
+  MatI D(5, 4);
+
+  A.sub(1, 2, 1, 3);
+  B.sub(2, 3, 0, 2);
+  D.sub(0, 1, 2, 3);
+  MatI C = A * 2 - B;
+  ASSERT_EQ(C.rows(), 2u);
+  ASSERT_EQ(C.cols(), 3u);
+  ASSERT_EQ(C(0, 0), 11);
+  ASSERT_EQ(C(1, 2), 22);
+
+  // the expression is written into the view only
+  ASSERT_THROW(D = A + B, std::exception);
+  D.sub(0, 1, 1, 3);
+  D = A + B;
+  D.subreset();
+  ASSERT_EQ(D(0, 0), 0);
+  ASSERT_EQ(D(0, 1), 10);
+  ASSERT_EQ(D(1, 3), 32);
+  ASSERT_EQ(D(2, 3), 0);
+}
+
+
+TEST(matrix_storage, matrix_storage_aligned)
+{
+  MatD A(37, 5);
+  ASSERT_TRUE(igm::is_aligned(A.begin()));
+  ASSERT_EQ(A(36, 4), 0.0);
+
+  MatD B(64, 3, igm::uninit);
+  ASSERT_TRUE(igm::is_aligned(B.begin()));
+  ASSERT_TRUE(igm::is_aligned(B.begincol(2)));
+  const double* p = B.begin();
+  B.resize(3, 64, igm::uninit);
+  ASSERT_EQ(p, B.begin());
+  ASSERT_EQ(B.rows(), 3u);
+
+  MatD C(B);
+  ASSERT_NE(C.begin(), B.begin());
+  ASSERT_TRUE(igm::is_aligned(C.begin()));
+}
+
+
+TEST(matrix_storage, matrix_storage_scalar_view)
+{
+  MatI A(4, 3, 1);
+  A.sub(1, 2, 1, 2);
+  A += 5;
+  A *= 2;
+  A.subreset();
+  ASSERT_EQ(A(0, 0), 1);
+  ASSERT_EQ(A(1, 1), 12);
+  ASSERT_EQ(A(2, 2), 12);
+  ASSERT_EQ(A(3, 2), 1);
+
+  A.subcols(2);
+  A.fill(7);
+  A.subreset();
+  ASSERT_EQ(A(3, 2), 7);
+  ASSERT_EQ(A(3, 1), 1);
+}
+
+
+TEST(matrix_view, matrix_view_concurrent_blocks)
+{
+  RandReal<double> rnd(-1.0, 1.0);
+  MatD A(200, 12);
+  for (auto a = A.begin(); a != A.end(); ++a)
+    *a = rnd();
+  MatD n(1, A.cols()), nb(1, A.cols());
+  igm::sumabs2_col(n, A, 0);
+
+  // disjoint column blocks of one matrix processed by several threads
+#pragma omp parallel for
+  for (int b = 0; b < 4; ++b)
+  {
+    igm::MatView<double> Ab = A.view(0, A.rows() - 1, 3 * b, 3 * b + 2);
+    igm::sumabs2_col(nb.view(0, 0, 3 * b, 3 * b + 2), Ab, 0);
+    Ab.assign(Ab * 2.0);
+  }
+  for (size_t i = 0; i < A.cols(); ++i)
+  {
+    ASSERT_DOUBLE_EQ(n(0, i), nb(0, i));
+    ASSERT_DOUBLE_EQ(igm::sumabs2_col1(A, i), 4.0 * n(0, i));
+  }
+}
+
+
+TEST(matrix_view, matrix_view_kernels)
+{
+  MatD A(6, 5);
+  for (size_t j = 0; j < A.cols(); ++j)
+    for (size_t i = 0; i < A.rows(); ++i)
+      A(i, j) = static_cast<double>(i + 2 * j + (i == j ? 5 : 0));
+  igm::ConstMatView<double> Av = A.view(1, 4, 1, 3);
+
+  // gemv and mtv with a strided row of A as x
+  igm::ConstMatView<double> x = A.view(5, 5, 1, 4);
+  MatD y(1, 3), z(1, 3);
+  igm::blas::gemv(y.view(), A.view(1, 4, 1, 3), x);
+  igm::dpr::mtv(z.view(), Av, x);
+  for (size_t j = 0; j < 3; ++j)
+  {
+    double s = 0.0;
+    for (size_t i = 0; i < 4; ++i)
+      s += Av(i, j) * x(0, i);
+    ASSERT_DOUBLE_EQ(y(0, j), s);
+    ASSERT_DOUBLE_EQ(z(0, j), s);
+  }
+
+  // upper triangular solve on a 3 x 3 sub-block
+  igm::ConstMatView<double> U = A.view(1, 3, 1, 3);
+  MatD b(1, 3), r(1, 3);
+  b(0, 0) = 1.0; b(0, 1) = 2.0; b(0, 2) = 3.0;
+  igm::solve(r.view(), U, b);
+  for (size_t i = 0; i < 3; ++i)
+  {
+    double s = 0.0;
+    for (size_t j = i; j < 3; ++j)
+      s += U(i, j) * r(0, j);
+    ASSERT_NEAR(s, b(0, i), 1e-12);
+  }
+}
+
+
+TEST(matrix_move, matrix_move_steals_buffer)
+{
+  MatD A(5, 4, 2.0);
+  const double* p = A.begin();
+  MatD B(std::move(A));
+  ASSERT_EQ(B.begin(), p);
+  ASSERT_EQ(B.rows(), 5u);
+  ASSERT_EQ(B(4, 3), 2.0);
+  ASSERT_TRUE(A.empty());
+  ASSERT_EQ(A.rows(), 0u);
+
+  MatD C(2, 2);
+  C = std::move(B);
+  ASSERT_EQ(C.begin(), p);
+  ASSERT_EQ(C.cols(), 4u);
+  ASSERT_TRUE(B.empty());
+
+  // a moved-from matrix is usable again
+  B = C * 2.0;
+  ASSERT_EQ(B(0, 0), 4.0);
+  ASSERT_EQ(igm::sumabs2_col(C, 0)(0, 3), 20.0);
+}
+
+
+TEST(matrix_move, matrix_into)
+{
+  MatI A(3, 4), B(3, 4, 2);
+  Iota(A.v());
+  MatI D(3, 4);
+  const int* p = D.begin();
+  igm::add_into(D, A, B);
+  igm::mul_into(D.view(0, 2, 1, 2), A.view(0, 2, 1, 2), B.view(0, 2, 1, 2));
+  ASSERT_EQ(D.begin(), p);
+  ASSERT_EQ(D(0, 0), 3);
+  ASSERT_EQ(D(0, 1), 8);
+  ASSERT_EQ(D(2, 3), 14);
+  igm::subtract_into(D, D, B);
+  ASSERT_EQ(D(2, 3), 12);
+  ASSERT_THROW(igm::add_into(D.view(0, 1, 0, 1), A, B), std::exception);
+
+  igm::Mat<size_t> idx(1, 2);
+  idx(0, 0) = 3;
+  idx(0, 1) = 1;
+  MatI S;
+  igm::sub_into(S, A, idx);
+  ASSERT_EQ(S.rows(), 3u);
+  ASSERT_EQ(S.cols(), 2u);
+  ASSERT_EQ(S(0, 0), 10);
+  ASSERT_EQ(S(2, 1), 6);
+
+  MatD E(4, 4, 3.0);
+  igm::eye_into(E.view(1, 3, 1, 3));
+  ASSERT_EQ(E(0, 0), 3.0);
+  ASSERT_EQ(E(1, 1), 1.0);
+  ASSERT_EQ(E(2, 1), 0.0);
+}
+
+
+// greedy column selection (mgs with pivoting on the residual norm), all
+// steps work on views of preallocated matrices
+TEST(allocation, allocation_selection_loop)
+{
+  RandReal<double> rnd(-1.0, 1.0);
+  const size_t m = 300, n = 40, k = 10;
+  MatD A(m, n);
+  for (auto a = A.begin(); a != A.end(); ++a)
+    *a = rnd();
+  MatD Q(m, n, igm::uninit), R(k, n), nrm(1, n), S(m, k, igm::uninit);
+  igm::Mat<size_t> idx(1, n);
+
+  auto reset = [&] {
+    igm::eval_into(Q, A);
+    R.zeros();
+    std::iota(idx.begin(), idx.end(), size_t{ 0 });
+  };
+  auto step = [&](const size_t l) {
+    igm::sumabs2_col(nrm.view(0, 0, l, n - 1), Q.view(0, m - 1, l, n - 1), 0);
+    size_t p = l;
+    for (size_t j = l + 1; j < n; ++j)
+      if (nrm(0, j - l) > nrm(0, p - l))
+        p = j;
+    const double a = 1.0 / nrm(0, p - l);
+    Q.swapcols(l, p);
+    R.swapcols(l, p);
+    std::swap(idx(0, l), idx(0, p));
+    igm::blas::gemv(R.view(l, l, l + 1, n - 1), Q.view(0, m - 1, l + 1, n - 1), a);
+    igm::blas::ger(Q.view(0, m - 1, l + 1, n - 1), R.view(l, l, l + 1, n - 1), -1.0);
+    igm::sub_into(S.view(0, m - 1, 0, l), A.view(), idx.view(0, 0, 0, l));
+  };
+
+  // the first pass warms up e.g. the OpenMP thread pool
+  reset();
+  for (size_t l = 0; l < k; ++l)
+    step(l);
+  reset();
+  const size_t a0 = g_heap_allocs;
+  for (size_t l = 0; l < k; ++l)
+    step(l);
+  ASSERT_EQ(g_heap_allocs - a0, 0u);
+
+  // A(:, idx(j)) = Q(:, j) + sum R(i, j)*Q(:, i), i < j, and S gathers A(:, idx)
+  for (size_t j = 0; j < k; ++j)
+  {
+    for (size_t r = 0; r < m; ++r)
+    {
+      double a = Q(r, j);
+      for (size_t i = 0; i < j; ++i)
+        a += R(i, j) * Q(r, i);
+      ASSERT_NEAR(a, A(r, idx(0, j)), 1e-12);
+      ASSERT_EQ(S(r, j), A(r, idx(0, j)));
+    }
+  }
+}
+
+
+// every kernel of one instruction set against a double precision loop,
+// x and y start off the alignment boundary and n covers the tails
+template<typename T>
+void check_simd(const igm::simd::isa level, const double tol)
+{
+  const igm::simd::kernels<T> k = igm::simd::kernels_for<T>(level);
+  RandReal<double> rnd(-1.0, 1.0);
+  for (size_t n : { 0, 1, 3, 7, 8, 17, 31, 64, 100, 257 })
+  {
+    std::vector<T> xv(n + 1), yv(n + 1);
+    for (size_t i = 0; i <= n; ++i)
+    {
+      xv[i] = static_cast<T>(rnd());
+      yv[i] = static_cast<T>(rnd());
+    }
+    const T* x = xv.data() + 1;
+    T* y = yv.data() + 1;
+
+    double d = 0.0, s2 = 0.0, s = 0.0;
+    for (size_t i = 0; i < n; ++i)
+    {
+      d += double(x[i]) * y[i];
+      s2 += double(x[i]) * x[i];
+      s += x[i];
+    }
+    ASSERT_NEAR(k.dot(n, x, y), d, tol * (n + 1));
+    ASSERT_NEAR(k.sumsq(n, x), s2, tol * (n + 1));
+    ASSERT_NEAR(k.sum(n, x), s, tol * (n + 1));
+
+    std::vector<T> z(y, y + n);
+    k.axpy(n, T(0.5), x, z.data());
+    for (size_t i = 0; i < n; ++i)
+      ASSERT_NEAR(z[i], y[i] + 0.5 * x[i], tol);
+    k.scal(n, T(-2), z.data());
+    for (size_t i = 0; i < n; ++i)
+      ASSERT_NEAR(z[i], -2.0 * (y[i] + 0.5 * x[i]), tol);
+    k.stream_copy(n, x, z.data());
+    for (size_t i = 0; i < n; ++i)
+      ASSERT_EQ(z[i], x[i]);
+  }
+}
+
+
+TEST(simd, simd_kernels)
+{
+  for (int l = 0; l <= static_cast<int>(igm::simd::cpu_isa()); ++l)
+  {
+    const igm::simd::isa level = static_cast<igm::simd::isa>(l);
+    cout << "simd " << igm::simd::isa_name(level) << "\n";
+    check_simd<double>(level, 1e-13);
+    check_simd<float>(level, 1e-5);
+  }
+}
+
+
+TEST(simd, simd_dispatch)
+{
+  MatD A(101, 3);
+  Iota(A.v());
+  const double s = igm::sumabs2_col1(A, 1);
+  const double t = igm::sum(A);
+
+  igm::simd::set_isa(igm::simd::isa::scalar);
+  ASSERT_EQ(igm::simd::current_isa(), igm::simd::isa::scalar);
+  ASSERT_DOUBLE_EQ(igm::sumabs2_col1(A, 1), s);
+  ASSERT_DOUBLE_EQ(igm::sum(A), t);
+
+  igm::simd::set_isa(igm::simd::isa::avx512);
+  ASSERT_EQ(igm::simd::current_isa(), igm::simd::cpu_isa());
+  ASSERT_EQ(t, 303.0 * 304.0 / 2.0);
+}
+
+
+TEST(column_norms, column_norms_strategy)
+{
+  using igm::norm_split;
+  ASSERT_EQ(igm::norm_strategy(100000, 100, 1), norm_split::serial);
+  ASSERT_EQ(igm::norm_strategy(100, 100, 8), norm_split::serial);
+  ASSERT_EQ(igm::norm_strategy(1000, 400, 8), norm_split::columns);
+  ASSERT_EQ(igm::norm_strategy(100000, 3, 8), norm_split::rows);
+  ASSERT_EQ(igm::norm_strategy(5000, 10, 8), norm_split::columns);
+}
+
+
+// every split on a sub-view against the serial loop, with more threads
+// than columns and a row count which is not a multiple of the blocks
+TEST(column_norms, column_norms_splits)
+{
+  RandReal<double> rnd(-1.0, 1.0);
+  MatD A(20003, 7);
+  for (auto a = A.begin(); a != A.end(); ++a)
+    *a = rnd();
+  igm::ConstMatView<double> S = A.view(1, 20001, 1, 6);
+  MatD v(1, 6), r(1, 6), d(1, 6);
+  Iota(v.v());
+  for (size_t j = 0; j < 6; ++j)
+  {
+    r(0, j) = v(0, j);
+    for (size_t i = 0; i < S.rows(); ++i)
+      r(0, j) += S(i, j) * S(i, j);
+  }
+
+  const int nt = omp_get_max_threads();
+  omp_set_num_threads(4);
+  for (auto split : { igm::norm_split::serial, igm::norm_split::columns, igm::norm_split::rows })
+  {
+    d.zeros();
+    igm::detail::sumsq_cols(d.view(), S, 1, v.begin(), 1, split);
+    ASSERT_EQ(d(0, 0), 0.0);
+    for (size_t j = 1; j < 6; ++j)
+      ASSERT_NEAR(d(0, j), r(0, j), 1e-9 * r(0, j));
+  }
+
+  igm::sumabs2_col(d.view(), S, 0, v);
+  ASSERT_NEAR(d(0, 3), r(0, 3), 1e-9 * r(0, 3));
+  ASSERT_NEAR(igm::sumabs2_col1(S, 2), r(0, 2) - v(0, 2), 1e-9 * r(0, 2));
+  omp_set_num_threads(nt);
+}
+
+
+// reference C = alpha*op(A)*op(B) + beta*C with op(A) m x k and op(B) k x n
+template<typename T>
+void ref_gemm(bool ta, bool tb, size_t m, size_t n, size_t k, T alpha,
+  const std::vector<T>& A, size_t lda, const std::vector<T>& B, size_t ldb,
+  T beta, std::vector<T>& C, size_t ldc)
+{
+  for (size_t j = 0; j < n; ++j)
+    for (size_t i = 0; i < m; ++i)
+    {
+      double s = 0.0;
+      for (size_t p = 0; p < k; ++p)
+        s += double(ta ? A[i * lda + p] : A[p * lda + i]) * (tb ? B[p * ldb + j] : B[j * ldb + p]);
+      C[j * ldc + i] = static_cast<T>(alpha * s + (beta == T(0) ? 0.0 : double(beta) * C[j * ldc + i]));
+    }
+}
+
+
+// every transposition on padded storage, with edge tiles, several kc and
+// nc blocks, the strips of thin products and beta == 0 on a C full of NaN,
+// which must not be read
+template<typename T>
+void check_gemm(igm::simd::isa level, double tol)
+{
+  RandReal<double> rnd(-1.0, 1.0);
+  igm::simd::set_isa(level);
+  const size_t dims[][3] = { { 1, 1, 1 }, { 5, 3, 7 }, { 33, 35, 37 }, { 97, 61, 300 }, { 300, 5000, 3 },
+    { 8, 8, 3001 }, { 3001, 12, 10 } };
+  for (auto d : dims)
+    for (int t = 0; t < 4; ++t)
+    {
+      const bool ta = (t & 1) != 0, tb = (t & 2) != 0;
+      const size_t m = d[0], n = d[1], k = d[2];
+      const size_t lda = (ta ? k : m) + 3, ldb = (tb ? n : k) + 1, ldc = m + 2;
+      std::vector<T> A(lda * (ta ? m : k)), B(ldb * (tb ? k : n)), C(ldc * n), R;
+      for (auto& a : A) a = static_cast<T>(rnd());
+      for (auto& b : B) b = static_cast<T>(rnd());
+      for (auto& c : C) c = static_cast<T>(rnd());
+
+      R = C;
+      ref_gemm<T>(ta, tb, m, n, k, T(0.5), A, lda, B, ldb, T(-2), R, ldc);
+      igm::blas::native::gemm<T>(ta, tb, m, n, k, T(0.5), A.data(), lda, B.data(), ldb, T(-2), C.data(), ldc);
+      for (size_t j = 0; j < n; ++j)
+        for (size_t i = 0; i < ldc; ++i)
+          ASSERT_NEAR(C[j * ldc + i], R[j * ldc + i], tol * k);
+
+      std::fill(C.begin(), C.end(), std::numeric_limits<T>::quiet_NaN());
+      ref_gemm<T>(ta, tb, m, n, k, T(1), A, lda, B, ldb, T(0), R, ldc);
+      igm::blas::native::gemm<T>(ta, tb, m, n, k, T(1), A.data(), lda, B.data(), ldb, T(0), C.data(), ldc);
+      for (size_t j = 0; j < n; ++j)
+        for (size_t i = 0; i < m; ++i)
+          ASSERT_NEAR(C[j * ldc + i], R[j * ldc + i], tol * k);
+    }
+  igm::simd::set_isa(igm::simd::isa::avx512);
+}
+
+
+TEST(native_blas, native_gemm)
+{
+  const int nt = omp_get_max_threads();
+  omp_set_num_threads(3);
+  for (int l = 0; l <= static_cast<int>(igm::simd::cpu_isa()); ++l)
+  {
+    const igm::simd::isa level = static_cast<igm::simd::isa>(l);
+    cout << "gemm " << igm::simd::isa_name(level) << "\n";
+    check_gemm<double>(level, 1e-14);
+    check_gemm<float>(level, 1e-6);
+  }
+  omp_set_num_threads(nt);
+}
+
+
+TEST(native_blas, native_gemv_ger)
+{
+  RandReal<double> rnd(-1.0, 1.0);
+  const size_t m = 301, n = 257, lda = 305;
+  std::vector<double> A(lda * n), x(2 * m), y(3 * m), G;
+  for (auto& a : A) a = rnd();
+  for (auto& v : x) v = rnd();
+  for (auto& v : y) v = rnd();
+
+  // y = 2*A'*x - y with strided x and y, then y = A*x
+  for (int t = 0; t < 2; ++t)
+  {
+    const bool ta = t == 0;
+    const size_t ny = ta ? n : m, nx = ta ? m : n;
+    std::vector<double> r(ny);
+    for (size_t i = 0; i < ny; ++i)
+    {
+      double s = 0.0;
+      for (size_t p = 0; p < nx; ++p)
+        s += (ta ? A[i * lda + p] : A[p * lda + i]) * x[2 * p];
+      r[i] = (ta ? 2.0 : 1.0) * s - (ta ? y[3 * i] : 0.0);
+    }
+    igm::blas::native::gemv(ta, m, n, ta ? 2.0 : 1.0, A.data(), lda, x.data(), 2,
+      ta ? -1.0 : 0.0, y.data(), 3);
+    for (size_t i = 0; i < ny; ++i)
+      ASSERT_NEAR(y[3 * i], r[i], 1e-12);
+  }
+
+  G = A;
+  igm::blas::native::ger(m, n, -0.5, x.data(), 2, y.data(), 3, A.data(), lda);
+  for (size_t j = 0; j < n; ++j)
+  {
+    for (size_t i = 0; i < m; ++i)
+      ASSERT_NEAR(A[j * lda + i], G[j * lda + i] - 0.5 * x[2 * i] * y[3 * j], 1e-14);
+    for (size_t i = m; i < lda; ++i)
+      ASSERT_EQ(A[j * lda + i], G[j * lda + i]);
+  }
+}
+
+
+template<typename T>
+T rnd_value(RandReal<double>& rnd, std::false_type) { return static_cast<T>(rnd()); }
+
+template<typename T>
+T rnd_value(RandReal<double>& rnd, std::true_type)
+{
+  const double re = rnd();
+  return T(static_cast<typename T::value_type>(re), static_cast<typename T::value_type>(rnd()));
+}
+
+
+// gemm, gemv (also conjugate transposed) and ger of the Mat wrappers on
+// sub-views against plain loops, for one element type of the backend
+template<typename T>
+void check_blas_backend(double tol)
+{
+  using M = igm::Mat<T>;
+  using cplx = igm::blas::backend::is_complex<T>;
+  RandReal<double> rnd(-1.0, 1.0);
+  const size_t m = 45, n = 23, k = 31;
+  M A(m + 2, k), B(k, n + 1), C(m, n), x(m, 1), y(1, n), R(m, n);
+  for (M* P : { &A, &B, &C, &x, &y })
+    for (auto p = P->begin(); p != P->end(); ++p)
+      *p = rnd_value<T>(rnd, cplx());
+  A.sub(1, m, 0, k - 1);
+  B.subcols(1, n);
+  const T a = rnd_value<T>(rnd, cplx()), b = rnd_value<T>(rnd, cplx());
+
+  for (size_t j = 0; j < n; ++j)
+    for (size_t i = 0; i < m; ++i)
+    {
+      T s{ 0 };
+      for (size_t p = 0; p < k; ++p)
+        s += A(i, p) * B(p, j);
+      R(i, j) = a * s + b * C(i, j);
+    }
+  igm::blas::gemm(C, A, B, a, b);
+  for (size_t j = 0; j < n; ++j)
+    for (size_t i = 0; i < m; ++i)
+      ASSERT_NEAR(std::abs(C(i, j) - R(i, j)), 0.0, tol);
+
+  // y = A(:, 0:n)^H * x for complex, A(:, 0:n)' * x for real types
+  M An(A);
+  An.sub(1, m, 0, n - 1);
+  igm::blas::gemv(y, An, x, a, T{ 0 }, CblasConjTrans);
+  for (size_t j = 0; j < n; ++j)
+  {
+    T s{ 0 };
+    for (size_t i = 0; i < m; ++i)
+      s += igm::blas::backend::reference::conj_if(An(i, j), cplx()) * x(i, 0);
+    ASSERT_NEAR(std::abs(y(0, j) - a * s), 0.0, tol);
+  }
+
+  R = C;
+  igm::blas::ger(C, x, y, a);
+  for (size_t j = 0; j < n; ++j)
+    for (size_t i = 0; i < m; ++i)
+      ASSERT_NEAR(std::abs(C(i, j) - (R(i, j) + a * x(i, 0) * y(0, j))), 0.0, tol);
+}
+
+
+TEST(blas_backend, blas_backend_types)
+{
+  cout << "blas backend " << igm::blas::backend::name() << "\n";
+  check_blas_backend<float>(1e-4);
+  check_blas_backend<double>(1e-12);
+  check_blas_backend<std::complex<float>>(1e-4);
+  check_blas_backend<std::complex<double>>(1e-12);
+}
+
+
+TEST(blas_backend, blas_backend_integer_range)
+{
+  using igm::blas::backend::to_blasint;
+  ASSERT_EQ(to_blasint(12345), igm::blasint(12345));
+  if (sizeof(igm::blasint) < sizeof(size_t))
+    ASSERT_THROW(to_blasint(size_t{ 1 } << 40), std::runtime_error);
+  else
+    ASSERT_EQ(static_cast<size_t>(to_blasint(size_t{ 1 } << 40)), size_t{ 1 } << 40);
+}
+
+
+// slots set and read back, and batched gemv against blas::gemv per matrix
+// with a count which leaves padding lanes in the last group
+TEST(matrix_batch, matrix_batch_gemv)
+{
+  RandReal<double> rnd(-1.0, 1.0);
+  const size_t count = 37, m = 13, n = 9;
+  igm::MatBatch<double> A(count, m, n), x(count, n, 1), xt(count, m, 1), y(count, m, 1), yt(count, n, 1);
+  ASSERT_EQ(A.groups(), (count + igm::MatBatch<double>::lanes - 1) / igm::MatBatch<double>::lanes);
+  ASSERT_TRUE(igm::is_aligned(A.group(1)));
+  std::vector<MatD> As;
+  for (size_t b = 0; b < count; ++b)
+  {
+    MatD M(m, n);
+    for (auto a = M.begin(); a != M.end(); ++a)
+      *a = rnd();
+    A.set(b, M);
+    As.push_back(M);
+    for (size_t i = 0; i < n; ++i)
+      x(b, i, 0) = rnd();
+    for (size_t i = 0; i < m; ++i)
+    {
+      xt(b, i, 0) = rnd();
+      y(b, i, 0) = rnd();
+    }
+  }
+  MatD G(m, n);
+  A.get(5, G);
+  ASSERT_EQ(G(3, 4), As[5](3, 4));
+  ASSERT_THROW(A.set(count, G), std::runtime_error);
+
+  for (int l = 0; l <= static_cast<int>(igm::simd::cpu_isa()); ++l)
+  {
+    igm::simd::set_isa(static_cast<igm::simd::isa>(l));
+    igm::MatBatch<double> yb(y);
+    igm::batch::gemv(yb, A, x, 2.0, -1.0);
+    igm::batch::gemv(yt, A, xt, 1.0, 0.0, true);
+    for (size_t b = 0; b < count; ++b)
+    {
+      MatD xv(n, 1), r(m, 1), xtv(m, 1), rt(1, n);
+      for (size_t i = 0; i < n; ++i)
+        xv(i, 0) = x(b, i, 0);
+      for (size_t i = 0; i < m; ++i)
+      {
+        r(i, 0) = y(b, i, 0);
+        xtv(i, 0) = xt(b, i, 0);
+      }
+      igm::blas::gemv(r, As[b], xv, 2.0, -1.0, CblasNoTrans);
+      igm::blas::gemv(rt, As[b], xtv);
+      for (size_t i = 0; i < m; ++i)
+        ASSERT_NEAR(yb(b, i, 0), r(i, 0), 1e-13);
+      for (size_t i = 0; i < n; ++i)
+        ASSERT_NEAR(yt(b, i, 0), rt(0, i), 1e-13);
+    }
+  }
+  igm::simd::set_isa(igm::simd::isa::avx512);
+}
+
+
+// batched QR against igm::qr, and least squares solutions with residuals
+// orthogonal to the columns (A'*(A*x - b) = 0)
+TEST(matrix_batch, matrix_batch_qr_lstsq)
+{
+  RandReal<double> rnd(-1.0, 1.0);
+  const size_t count = 21, m = 20, n = 8;
+  igm::MatBatch<double> A(count, m, n), tau(count, n, 1), B(count, m, 2);
+  for (size_t b = 0; b < count; ++b)
+    for (size_t j = 0; j < n; ++j)
+      for (size_t i = 0; i < m; ++i)
+      {
+        A(b, i, j) = rnd();
+        if (j < 2)
+          B(b, i, j) = rnd();
+      }
+  const igm::MatBatch<double> A0(A), B0(B);
+
+  igm::MatBatch<double> QR(A);
+  igm::batch::qr(QR, tau);
+  igm::batch::lstsq(A, tau, B);
+  for (size_t b = 0; b < count; ++b)
+  {
+    MatD Q(m, n), R(n, n);
+    A0.get(b, Q);
+    igm::qr(Q, R);
+    for (size_t j = 0; j < n; ++j)
+      for (size_t i = 0; i <= j; ++i)
+        ASSERT_NEAR(std::abs(QR(b, i, j)), std::abs(R(i, j)), 1e-12);
+
+    for (size_t r = 0; r < 2; ++r)
+    {
+      std::vector<double> res(m);
+      for (size_t i = 0; i < m; ++i)
+      {
+        res[i] = -B0(b, i, r);
+        for (size_t j = 0; j < n; ++j)
+          res[i] += A0(b, i, j) * B(b, j, r);
+      }
+      for (size_t j = 0; j < n; ++j)
+      {
+        double s = 0.0;
+        for (size_t i = 0; i < m; ++i)
+          s += A0(b, i, j) * res[i];
+        ASSERT_NEAR(s, 0.0, 1e-12);
+      }
+    }
+  }
+
+  // Y = R'*(R*X) solved back to X with the transposed and the plain trsv
+  igm::MatBatch<double> X(count, n, 1), Y(count, n, 1);
+  for (size_t b = 0; b < count; ++b)
+  {
+    std::vector<double> rx(n, 0.0);
+    for (size_t i = 0; i < n; ++i)
+      X(b, i, 0) = rnd();
+    for (size_t i = 0; i < n; ++i)
+      for (size_t j = i; j < n; ++j)
+        rx[i] += QR(b, i, j) * X(b, j, 0);
+    for (size_t j = 0; j < n; ++j)
+      for (size_t i = 0; i <= j; ++i)
+        Y(b, j, 0) += QR(b, i, j) * rx[i];
+  }
+  igm::batch::trsv(QR, Y, true);
+  igm::batch::trsv(QR, Y);
+  for (size_t b = 0; b < count; ++b)
+    for (size_t i = 0; i < n; ++i)
+      ASSERT_NEAR(Y(b, i, 0), X(b, i, 0), 1e-12);
+}
+
+
+// largest difference of X and Y relative to the largest element of Y
+static double rel_diff(const MatD& X, const MatD& Y)
+{
+  double d = 0.0, y = 0.0;
+  for (size_t j = 0; j < Y.cols(); ++j)
+    for (size_t i = 0; i < Y.rows(); ++i)
+    {
+      d = std::max(d, std::abs(X(i, j) - Y(i, j)));
+      y = std::max(y, std::abs(Y(i, j)));
+    }
+  return d / y;
+}
+
+
+TEST(solve_mixed, solve_mixed_refines)
+{
+  RandReal<double> rnd(-1.0, 1.0);
+  const size_t sizes[][2] = { { 300, 40 }, { 60, 60 } };
+  for (auto& s : sizes)
+  {
+    const size_t m = s[0], n = s[1];
+    MatD A(m, n), B(m, 3), X, Xd(n, 3);
+    for (auto a = A.begin(); a != A.end(); ++a)
+      *a = rnd();
+    for (auto b = B.begin(); b != B.end(); ++b)
+      *b = rnd();
+    igm::detail::solve_qr(Xd, A, B);
+
+    const igm::refine_info info = igm::solve_mixed(X, A, B);
+    ASSERT_TRUE(info.converged);
+    ASSERT_FALSE(info.fallback);
+    ASSERT_GE(info.iterations, 1u);
+    ASSERT_LE(info.iterations, 6u);
+    ASSERT_EQ(X.rows(), n);
+    ASSERT_EQ(X.cols(), 3u);
+    ASSERT_LT(rel_diff(X, Xd), 1e-12);
+  }
+
+  MatD A(10, 12), B(10, 1), X;
+  ASSERT_THROW(igm::solve_mixed(X, A, B), std::runtime_error);
+}
+
+
+// m x n A = U*S*V' with singular values from 1 down to 10^-decades
+static MatD ill_conditioned(const size_t m, const size_t n, const double decades)
+{
+  RandReal<double> rnd(-1.0, 1.0);
+  MatD U(m, n), V(n, n), Ru(n, n), Rv(n, n), A(m, n);
+  for (auto u = U.begin(); u != U.end(); ++u)
+    *u = rnd();
+  for (auto v = V.begin(); v != V.end(); ++v)
+    *v = rnd();
+  igm::qr(U, Ru);
+  igm::qr(V, Rv);
+  for (size_t j = 0; j < n; ++j)
+  {
+    const double sv = std::pow(10.0, -decades * j / (n - 1));
+    for (size_t i = 0; i < m; ++i)
+      U(i, j) *= sv;
+  }
+  igm::blas::gemm(A, U, V, 1.0, 0.0, CblasNoTrans, CblasTrans);
+  return A;
+}
+
+
+TEST(solve_mixed, solve_mixed_fallback)
+{
+  // cond(A) = 1e10 is above 1/eps(float), the refinement cannot contract
+  // and falls back to double
+  RandReal<double> rnd(-1.0, 1.0);
+  const size_t m = 200, n = 30;
+  const MatD A = ill_conditioned(m, n, 10.0);
+  MatD B(m, 1), X, Xd(n, 1);
+  for (size_t i = 0; i < m; ++i)
+    B(i, 0) = rnd();
+  igm::detail::solve_qr(Xd, A, B);
+
+  const igm::refine_info info = igm::solve_mixed(X, A, B);
+  ASSERT_TRUE(info.fallback);
+  ASSERT_FALSE(info.converged);
+  ASSERT_LT(rel_diff(X, Xd), 1e-9);
+
+  // no refinement steps at all
+  const igm::refine_info none = igm::solve_mixed(X, A, B, 0);
+  ASSERT_TRUE(none.fallback);
+  ASSERT_EQ(none.iterations, 0u);
+
+  // cond(A) from 1e5 up to about 1/eps(float): the refinement crawls and
+  // stalls far below eps(float) but above the rounding level of double;
+  // such a stall is no success, it falls back unless the last correction
+  // is within a few roundings of double
+  const double tol = std::sqrt(static_cast<double>(n)) * std::numeric_limits<double>::epsilon();
+  for (const double decades : { 5.0, 5.5, 6.0, 6.5, 7.0 })
+  {
+    const MatD Ac = ill_conditioned(m, n, decades);
+    igm::detail::solve_qr(Xd, Ac, B);
+    const igm::refine_info ic = igm::solve_mixed(X, Ac, B);
+    ASSERT_TRUE(ic.fallback != ic.converged);
+    if (ic.converged) {
+      ASSERT_LE(ic.correction, 16.0 * tol);
+    }
+    ASSERT_LT(rel_diff(X, Xd), 1e-9);
+  }
+}
+
+
+TEST(trsm, trsm_cases)
+{
+  // n spans several blocks, B is a sub-view with lda > rows
+  RandReal<double> rnd(-1.0, 1.0);
+  const size_t n = 2 * igm::trsm_block + 23, nrhs = 37;
+  MatD A(n, n), B0(n + 5, nrhs);
+  // small off-diagonal elements keep the unit triangles well conditioned
+  for (auto a = A.begin(); a != A.end(); ++a)
+    *a = 4.0 * rnd() / n;
+  for (size_t i = 0; i < n; ++i)
+    A(i, i) = 2.0 + rnd();
+  for (auto b = B0.begin(); b != B0.end(); ++b)
+    *b = rnd();
+
+  const int nt = omp_get_max_threads();
+  for (int ul = 0; ul < 2; ++ul)
+    for (int tr = 0; tr < 2; ++tr)
+      for (int dg = 0; dg < 2; ++dg)
+      {
+        const igm::uplo u = ul ? igm::uplo::lower : igm::uplo::upper;
+        const igm::diag d = dg ? igm::diag::unit : igm::diag::non_unit;
+        MatD B(B0), Bp(B0);
+        omp_set_num_threads(1);
+        igm::trsm(A.view(), B.view(2, n + 1, 0, nrhs - 1), u, tr != 0, d);
+        omp_set_num_threads(3);
+        igm::trsm(A.view(), Bp.view(2, n + 1, 0, nrhs - 1), u, tr != 0, d);
+        for (size_t c = 0; c < nrhs; ++c)
+        {
+          ASSERT_EQ(B(0, c), B0(0, c));
+          ASSERT_EQ(B(n + 2, c), B0(n + 2, c));
+          for (size_t i = 0; i < n; ++i)
+          {
+            // row i of op(A) times column c of X
+            double s = 0.0;
+            for (size_t j = 0; j < n; ++j)
+            {
+              const double aij = tr ? A(j, i) : A(i, j);
+              const bool in = ul ? (tr ? j >= i : j <= i) : (tr ? j <= i : j >= i);
+              if (in)
+                s += (j == i && dg) ? B(j + 2, c) : aij * B(j + 2, c);
+            }
+            ASSERT_NEAR(s, B0(i + 2, c), 1e-12);
+            ASSERT_NEAR(Bp(i + 2, c), B(i + 2, c), 1e-13);
+          }
+        }
+      }
+  omp_set_num_threads(nt);
+
+  MatD C(n, 2);
+  ASSERT_THROW(igm::trsm(A.view(), C.view(0, n - 2, 0, 1)), std::runtime_error);
+}
+
+
+TEST(matrix_mmap, matrix_mmap_modes)
+{
+  RandReal<double> rnd(-1.0, 1.0);
+  const char* path = "matrix_mmap_test.bin";
+  const size_t m = 1003, n = 17;
+  MatD A(m, n);
+  for (auto a = A.begin(); a != A.end(); ++a)
+    *a = rnd();
+  igm::write_mat(path, A);
+
+  {
+    igm::MatMap<double> M(path);
+    ASSERT_EQ(M.rows(), m);
+    ASSERT_EQ(M.cols(), n);
+    ASSERT_EQ(M.lda() % (igm::mat_align / sizeof(double)), 0u);
+    ASSERT_TRUE(igm::is_aligned(M.data() + M.lda()));
+    ASSERT_THROW(M.writable_view(), std::runtime_error);
+    M.advise(igm::map_advice::sequential);
+    M.advise(igm::map_advice::willneed, 3, 5);
+    ASSERT_THROW(M.advise(igm::map_advice::normal, 2, n), std::runtime_error);
+
+    // kernels run on the mapped view as on the Mat
+    MatD s(1, n), sm(1, n), x(m, 1), d(1, n), dm(1, n);
+    for (size_t i = 0; i < m; ++i)
+      x(i, 0) = rnd();
+    igm::sumabs2_col(s, A, 0);
+    igm::sumabs2_col(sm.view(), M.view(), 0);
+    igm::dpr::mtv(d, A, x);
+    igm::dpr::mtv(dm.view(), M.view(), x.view());
+    for (size_t j = 0; j < n; ++j)
+    {
+      ASSERT_EQ(s(j), sm(j));
+      ASSERT_EQ(d(j), dm(j));
+      for (size_t i = 0; i < m; ++i)
+        ASSERT_EQ(M.view()(i, j), A(i, j));
+    }
+  }
+
+  {
+    // private writes, the file keeps the original
+    igm::MatMap<double> W(path, igm::map_mode::copy_on_write);
+    W.writable_view()(4, 2) = 42.0;
+    ASSERT_EQ(W.view()(4, 2), 42.0);
+    igm::MatMap<double> R(path);
+    ASSERT_EQ(R.view()(4, 2), A(4, 2));
+    W.advise(igm::map_advice::dontneed);
+    ASSERT_EQ(W.view()(4, 2), 42.0);
+  }
+
+  {
+    igm::MatMap<double> Z = igm::MatMap<double>::create(path, 70, 3);
+    ASSERT_EQ(Z.mode(), igm::map_mode::read_write);
+    ASSERT_EQ(Z.view()(69, 2), 0.0);
+    Z.writable_view()(69, 2) = 7.0;
+  }
+  {
+    igm::MatMap<double> R(path);
+    ASSERT_EQ(R.rows(), 70u);
+    ASSERT_EQ(R.view()(69, 2), 7.0);
+    ASSERT_THROW(igm::MatMap<float> f(path), std::runtime_error);
+    igm::MatMap<double> moved(std::move(R));
+    ASSERT_FALSE(R.is_open());
+    ASSERT_EQ(moved.view()(69, 2), 7.0);
+  }
+  std::remove(path);
+  ASSERT_THROW(igm::MatMap<double> gone(path), std::runtime_error);
+}
+
+
+TEST(tsqr, tsqr_stream)
+{
+  // [A b1 b2] streamed in uneven blocks, the first one shorter than the width
+  RandReal<double> rnd(-1.0, 1.0);
+  const size_t m = 5000, n = 12, k = 2, rows = 777;
+  MatD AB(m, n + k);
+  for (auto a = AB.begin(); a != AB.end(); ++a)
+    *a = rnd();
+  MatD A(AB), B(m, k), Xd(n, k);
+  A.subcols(0, n - 1);
+  for (size_t j = 0; j < k; ++j)
+    for (size_t i = 0; i < m; ++i)
+      B(i, j) = AB(i, n + j);
+  igm::detail::solve_qr(Xd, A, B);
+
+  size_t r0 = 0;
+  const igm::TsqrStream<double> ts = igm::tsqr_stream<double>([&](igm::MatView<double> buf) {
+    const size_t nr = std::min(r0 == 0 ? size_t{ 5 } : buf.rows(), m - r0);
+    for (size_t j = 0; j < n + k; ++j)
+      for (size_t i = 0; i < nr; ++i)
+        buf(i, j) = AB(r0 + i, j);
+    r0 += nr;
+    return nr;
+  }, n, k, rows);
+  ASSERT_EQ(ts.rows(), m);
+  ASSERT_EQ(ts.blocks(), 1 + (m - 5 + rows - 1) / rows);
+
+  // R'R = A'A, R unique up to the signs of its rows
+  const MatD R = ts.R();
+  for (size_t i = 0; i < n; ++i)
+    for (size_t j = 0; j < n; ++j)
+    {
+      double rr = 0.0, aa = 0.0;
+      for (size_t l = 0; l < n; ++l)
+        rr += R(l, i) * R(l, j);
+      for (size_t l = 0; l < m; ++l)
+        aa += A(l, i) * A(l, j);
+      ASSERT_NEAR(rr, aa, 1e-10 * m);
+      if (i > j) {
+        ASSERT_EQ(R(i, j), 0.0);
+      }
+    }
+
+  const MatD X = ts.solve(), res = ts.residual();
+  for (size_t j = 0; j < k; ++j)
+  {
+    double s = 0.0;
+    for (size_t i = 0; i < m; ++i)
+    {
+      double r = B(i, j);
+      for (size_t l = 0; l < n; ++l)
+        r -= A(i, l) * X(l, j);
+      s += r * r;
+    }
+    ASSERT_NEAR(res(0, j), std::sqrt(s), 1e-10);
+    for (size_t l = 0; l < n; ++l)
+      ASSERT_NEAR(X(l, j), Xd(l, j), 1e-12);
+  }
+
+  // the same from a mapped file, in blocks of 1000 rows
+  const char* path = "tsqr_stream_test.bin";
+  igm::write_mat(path, AB);
+  {
+    igm::MatMap<double> M(path);
+    const igm::TsqrStream<double> tf = igm::tsqr_stream(M, k, 1000);
+    ASSERT_EQ(tf.blocks(), 5u);
+    const MatD Xf = tf.solve();
+    for (size_t j = 0; j < k; ++j)
+      for (size_t l = 0; l < n; ++l)
+        ASSERT_NEAR(Xf(l, j), Xd(l, j), 1e-12);
+  }
+  std::remove(path);
+
+  igm::TsqrStream<double> bad(n, k);
+  ASSERT_THROW(bad.add(A.view()), std::runtime_error);
+}
+
+
+TEST(tsqr, tsqr_parallel)
+{
+  // 7 leaves (an odd tree level) on a view of selected columns, a single
+  // leaf and R only
+  RandReal<double> rnd(-1.0, 1.0);
+  const int nt = omp_get_max_threads();
+  omp_set_num_threads(3);
+  const size_t n = 10, shapes[][2] = { { 7 * igm::detail::tsqr_leaf_rows<double>(n) + 5, 0 }, { 300, 1 } };
+  for (auto& sh : shapes)
+  {
+    const size_t m = sh[0];
+    MatD W(m, n + 3), R(n, n), Rq(n, n), Rr(n, n);
+    for (auto w = W.begin(); w != W.end(); ++w)
+      *w = rnd();
+    MatD A(W), Q(W), Qr(W);
+    A.subcols(2, n + 1);
+    Q.subcols(2, n + 1);
+    Qr.subcols(2, n + 1);
+    igm::tsqr(Q.view(), R.view());
+    igm::tsqr(Qr.view(), Rr.view(), false);
+    MatD Qs(A);
+    igm::qr(Qs, Rq);
+
+    for (size_t j = 0; j < n; ++j)
+    {
+      for (size_t i = 0; i < n; ++i)
+      {
+        ASSERT_NEAR(std::abs(R(i, j)), std::abs(Rq(i, j)), 1e-10);
+        ASSERT_EQ(R(i, j), Rr(i, j));
+        double qq = 0.0;
+        for (size_t l = 0; l < m; ++l)
+          qq += Q(l, i) * Q(l, j);
+        ASSERT_NEAR(qq, i == j ? 1.0 : 0.0, 1e-12);
+      }
+      for (size_t l = 0; l < m; l += 7)
+      {
+        double qr = 0.0;
+        for (size_t i = 0; i <= j; ++i)
+          qr += Q(l, i) * R(i, j);
+        ASSERT_NEAR(qr, A(l, j), 1e-12);
+      }
+    }
+    // the columns outside the view are untouched
+    Q.subreset();
+    for (size_t l = 0; l < m; ++l)
+    {
+      ASSERT_EQ(Q(l, 1), W(l, 1));
+      ASSERT_EQ(Q(l, n + 2), W(l, n + 2));
+    }
+  }
+  omp_set_num_threads(nt);
+
+  MatD S(5, 8), Rs(8, 8);
+  ASSERT_THROW(igm::tsqr(S.view(), Rs.view()), std::runtime_error);
+}
+
+
+TEST(forward_select, forward_select_recovers)
+{
+  // y from 3 columns plus small noise: the 3 come first, then |r| drops
+  // below the tolerance
+  RandReal<double> rnd(-1.0, 1.0);
+  const size_t m = 200, n = 50, cols[] = { 3, 17, 41 };
+  const double coefs[] = { 2.0, -1.0, 0.5 };
+  MatD A(m, n), y(m, 1);
+  for (auto a = A.begin(); a != A.end(); ++a)
+    *a = rnd();
+  for (size_t i = 0; i < m; ++i)
+  {
+    y(i, 0) = 1e-9 * rnd();
+    for (size_t l = 0; l < 3; ++l)
+      y(i, 0) += coefs[l] * A(i, cols[l]);
+  }
+
+  igm::ForwardSelect<double> fs(A, y, 20);
+  ASSERT_EQ(fs.run(0, 1e-6), 3u);
+  const MatD x = fs.coef();
+  for (size_t s = 0; s < 3; ++s)
+  {
+    const size_t c = fs.perm()(0, s);
+    const size_t l = std::find(cols, cols + 3, c) - cols;
+    ASSERT_LT(l, 3u);
+    ASSERT_NEAR(x(s, 0), coefs[l], 1e-8);
+  }
+  ASSERT_EQ(fs.steps().size(), 3u);
+  ASSERT_LE(fs.steps()[2].residual, 1e-6 * std::sqrt(igm::sumabs2_col1(y, 0)));
+
+  // further steps allocate nothing; the residual is the one of the least
+  // squares fit on the selected columns
+  const size_t a0 = g_heap_allocs;
+  ASSERT_TRUE(fs.step());
+  ASSERT_TRUE(fs.step());
+  ASSERT_EQ(g_heap_allocs, a0);
+  ASSERT_EQ(fs.run(7), 7u);
+  ASSERT_FALSE(fs.steps().back().time < 0.0);
+
+  MatD As(m, 7), xs(7, 1);
+  for (size_t s = 0; s < 7; ++s)
+    for (size_t i = 0; i < m; ++i)
+      As(i, s) = A(i, fs.perm()(0, s));
+  igm::detail::solve_qr(xs, As, y);
+  const MatD x7 = fs.coef();
+  double rr = 0.0;
+  for (size_t i = 0; i < m; ++i)
+  {
+    double r = y(i, 0);
+    for (size_t s = 0; s < 7; ++s)
+      r -= As(i, s) * x7(s, 0);
+    rr += r * r;
+    ASSERT_NEAR(r, fs.residual()(i, 0), 1e-12);
+  }
+  ASSERT_NEAR(std::sqrt(rr), fs.residual_norm(), 1e-12);
+  for (size_t s = 0; s < 7; ++s)
+    ASSERT_NEAR(x7(s, 0), xs(s, 0), 1e-10);
+
+  // dependent columns are never selected, max_cols ends the run
+  MatD D(m, 4);
+  for (size_t i = 0; i < m; ++i)
+  {
+    D(i, 0) = A(i, 0);
+    D(i, 1) = 2.0 * A(i, 0);
+    D(i, 2) = A(i, 1);
+    D(i, 3) = A(i, 0) - A(i, 1);
+  }
+  igm::ForwardSelect<double> fd(D, A.view(0, m - 1, 5, 5), 3);
+  ASSERT_EQ(fd.run(), 2u);
+  ASSERT_FALSE(fd.step());
+  ASSERT_THROW(igm::ForwardSelect<double>(A, MatD(m + 1, 1)), std::runtime_error);
+}
+
+
+TEST(prof, prof_counters)
+{
+  RandReal<double> rnd(-1.0, 1.0);
+  MatD A(30, 20), x(30, 1), y(1, 20);
+  for (auto a = A.begin(); a != A.end(); ++a)
+    *a = rnd();
+  for (auto a = x.begin(); a != x.end(); ++a)
+    *a = rnd();
+
+  // the calls of the worker threads are merged with the calling one
+  igm::prof::reset();
+  const int nt = omp_get_max_threads();
+  omp_set_num_threads(3);
+#pragma omp parallel for
+  for (int i = 0; i < 6; ++i)
+  {
+    MatD z(20, 1);
+    igm::blas::gemv(z, A, x, 1.0, 0.0, CblasTrans);
+  }
+  omp_set_num_threads(nt);
+  igm::dpr::mtv(y, A, x);
+
+  const std::vector<igm::prof::record> rs = igm::prof::report();
+#ifdef IGM_PROFILE
+  size_t found = 0;
+  for (const auto& r : rs)
+  {
+    if (r.name == "blas::gemv" && r.rows == 30 && r.cols == 20) {
+      ASSERT_EQ(r.calls, 6u);
+      ASSERT_EQ(r.flops, 6.0 * 2 * 30 * 20);
+      ASSERT_GE(r.seconds, 0.0);
+      ++found;
+    }
+    if (r.name == "dpr::mtv") {
+      ASSERT_EQ(r.calls, 1u);
+      ++found;
+    }
+  }
+  ASSERT_EQ(found, 2u);
+  std::ostringstream table, json;
+  igm::prof::print(table);
+  igm::prof::json(json);
+  ASSERT_NE(table.str().find("dpr::mtv"), std::string::npos);
+  ASSERT_NE(json.str().find("\"kernel\": \"blas::gemv\""), std::string::npos);
+
+  igm::prof::reset();
+  ASSERT_TRUE(igm::prof::report().empty());
+#else
+  // compiled out: nothing is recorded
+  ASSERT_TRUE(rs.empty());
+#endif
+}
+
+
+TEST(arena, arena_workspace)
+{
+  // bump allocation, aligned, released to the mark
+  igm::Arena a;
+  const igm::Arena::marker m0 = a.mark();
+  double* p = a.allocate<double>(3);
+  float* q = a.allocate<float>(1000);
+  ASSERT_TRUE(igm::is_aligned(p) && igm::is_aligned(q));
+  ASSERT_EQ(a.used(), igm::Arena::bytes<double>(3) + igm::Arena::bytes<float>(1000));
+  {
+    igm::Workspace ws(a);
+    // larger than the first chunk: a second chunk, released with the scope
+    double* big = ws.alloc<double>(igm::arena_chunk / sizeof(double) + 1);
+    big[0] = 1.0;
+    ASSERT_GT(a.used(), igm::arena_chunk);
+  }
+  ASSERT_EQ(a.used(), igm::Arena::bytes<double>(3) + igm::Arena::bytes<float>(1000));
+  a.deallocate(q, 1000 * sizeof(float));
+  ASSERT_EQ(a.used(), igm::Arena::bytes<double>(3));
+  a.release(m0);
+  ASSERT_EQ(a.used(), 0u);
+  ASSERT_GT(a.high_water(), igm::arena_chunk);
+
+  // a reserved arena serves the request without the heap
+  igm::Arena b;
+  const size_t need = igm::geqrf_workspace<double>(5000, 40);
+  b.reserve(need);
+  const size_t cap = b.capacity(), a0 = g_heap_allocs;
+  {
+    igm::Workspace ws(b);
+    ws.alloc<char>(need);
+  }
+  ASSERT_EQ(g_heap_allocs, a0);
+  ASSERT_EQ(b.capacity(), cap);
+
+  // ArenaMat: a Mat on arena memory, usable in expressions and by the view kernels
+  RandReal<double> rnd(-1.0, 1.0);
+  MatD A(50, 20), X(50, 20);
+  for (auto x = A.begin(); x != A.end(); ++x)
+    *x = rnd();
+  {
+    igm::Workspace ws;
+    const size_t u0 = igm::thread_arena().used();
+    igm::ArenaMat<double> T(50, 20), s(1, 20);
+    ASSERT_GT(igm::thread_arena().used(), u0);
+    T = A + A;
+    igm::sumabs2_col(s.view(), T.view(), 0);
+    for (size_t j = 0; j < 20; ++j)
+      ASSERT_NEAR(s(0, j), 4.0 * igm::sumabs2_col1(A, j), 1e-12);
+  }
+
+  // the factorizations take their scratch from the thread arena, a
+  // repeated call allocates nothing
+  MatD tau(1, 20);
+  igm::Mat<size_t> perm(1, 20);
+  X = A;
+  igm::geqrf(X, tau);
+  X = A;
+  igm::geqp3(X, tau, perm);
+  const size_t a1 = g_heap_allocs;
+  X = A;
+  igm::geqrf(X, tau);
+  igm::orgqr(X, tau);
+  X = A;
+  igm::geqp3(X, tau, perm);
+  ASSERT_EQ(g_heap_allocs, a1);
+
+  // tsqr over several leaves: the tree levels and their reflectors come
+  // from the arena as well, with and without Q
+  MatD B(30000, 20), Q(30000, 20), R(20, 20);
+  for (auto x = B.begin(); x != B.end(); ++x)
+    *x = rnd();
+  for (const bool want_q : { true, false })
+  {
+    Q = B;
+    igm::tsqr(Q, R, want_q);
+    Q = B;
+    const size_t a2 = g_heap_allocs;
+    igm::tsqr(Q, R, want_q);
+    ASSERT_EQ(g_heap_allocs, a2);
+  }
+  ASSERT_GT(igm::tsqr_workspace<double>(30000, 20), igm::tsqr_workspace<double>(30000, 20, false));
+}
+
+
+// generic code on the matrix type: the trace of A'*A
+template<typename M>
+double sum_squares(const M& A)
+{
+  double s = 0.0;
+  for (size_t j = 0; j < A.cols(); ++j)
+    for (size_t i = 0; i < A.rows(); ++i)
+      s += A(i, j) * A(i, j);
+  return s;
+}
+
+
+TEST(fixed_mat, fixed_mat_ops)
+{
+  using F3 = igm::FixedMat<double, 3, 3>;
+  using V3 = igm::FixedMat<double, 3, 1>;
+
+  // compile time: product, transpose, solve and determinant
+  constexpr F3 A{ { 4.0, 1.0, 2.0 },{ 1.0, 5.0, 0.0 },{ 2.0, 0.0, 6.0 } };
+  constexpr V3 x{ { 1.0, -2.0, 3.0 } };
+  constexpr V3 b = igm::mul(A, x);
+  static_assert(b(0, 0) == 4.0 - 2.0 + 6.0 && b(1, 0) == 1.0 - 10.0 && b(2, 0) == 2.0 + 18.0, "mul");
+  constexpr V3 y = igm::solve(A, b);
+  static_assert(y(0, 0) - 1.0 < 1e-14 && 1.0 - y(0, 0) < 1e-14, "solve");
+  static_assert(igm::transpose(x)(0, 2) == 3.0 && igm::transpose(x).rows() == 1, "transpose");
+  constexpr double d = igm::det(A);
+  static_assert(d - 94.0 < 1e-12 && 94.0 - d < 1e-12, "det");
+  static_assert((A + A - A * 2.0)(1, 1) == 0.0, "element-wise");
+  static_assert(sizeof(igm::FixedMat<float, 6, 6>) == 36 * sizeof(float), "inline storage");
+
+  // runtime against the Mat kernels, nothing allocates
+  RandReal<double> rnd(-1.0, 1.0);
+  igm::FixedMat<double, 6, 6> S;
+  igm::FixedMat<double, 6, 2> B;
+  for (auto a = S.begin(); a != S.end(); ++a)
+    *a = rnd();
+  for (auto a = B.begin(); a != B.end(); ++a)
+    *a = rnd();
+  MatD Sm(6, 6), Bm(6, 2), Pm(6, 2);
+  std::copy(S.begin(), S.end(), Sm.begin());
+  std::copy(B.begin(), B.end(), Bm.begin());
+  igm::blas::gemm(Pm, Sm, Bm);
+
+  const size_t a0 = g_heap_allocs;
+  const igm::FixedMat<double, 6, 2> P = igm::mul(S, B);
+  const igm::FixedMat<double, 6, 2> X = igm::solve(S, B);
+  const igm::FixedMat<double, 6, 6> I = igm::mul(S, igm::inv(S));
+  igm::FixedMat<double, 6, 2> C = P;
+  C += B;
+  C *= 0.5;
+  ASSERT_EQ(g_heap_allocs, a0);
+  for (size_t j = 0; j < 2; ++j)
+    for (size_t i = 0; i < 6; ++i)
+    {
+      ASSERT_NEAR(P(i, j), Pm(i, j), 1e-13);
+      ASSERT_NEAR(C(i, j), 0.5 * (P(i, j) + B(i, j)), 1e-15);
+    }
+  const igm::FixedMat<double, 6, 2> SX = igm::mul(S, X);
+  for (size_t j = 0; j < 2; ++j)
+    for (size_t i = 0; i < 6; ++i)
+      ASSERT_NEAR(SX(i, j), B(i, j), 1e-10);
+  for (size_t j = 0; j < 6; ++j)
+    for (size_t i = 0; i < 6; ++i)
+      ASSERT_NEAR(I(i, j), i == j ? 1.0 : 0.0, 1e-10);
+
+  // the shared interface: generic code, views for the kernels, and the
+  // Mat expressions in both directions
+  ASSERT_NEAR(sum_squares(S), sum_squares(Sm), 1e-13);
+  MatD n2(1, 6);
+  igm::sumabs2_col(n2.view(), S.view(), 0);
+  for (size_t j = 0; j < 6; ++j)
+    ASSERT_NEAR(n2(0, j), igm::sumabs2_col1(Sm, j), 1e-14);
+  MatD D = Sm + S;
+  igm::FixedMat<double, 6, 6> E = Sm - S.view();
+  for (size_t j = 0; j < 6; ++j)
+    for (size_t i = 0; i < 6; ++i)
+    {
+      ASSERT_EQ(D(i, j), 2.0 * S(i, j));
+      ASSERT_EQ(E(i, j), 0.0);
+    }
+  igm::FixedMat<double, 3, 3> G;
+  ASSERT_THROW(G = Sm + Sm, std::runtime_error);
+  ASSERT_THROW(igm::solve(F3(), F3()), std::runtime_error);
+}
+
+
+TEST(matrix_sub, matrix_sub_strided)
+{
+  RandReal<double> rnd(-1.0, 1.0);
+  MatD A(17, 12), B(17, 12);
+  for (auto a = A.begin(); a != A.end(); ++a)
+    *a = rnd();
+  for (auto b = B.begin(); b != B.end(); ++b)
+    *b = rnd();
+  const MatD A0(A), B0(B);
+
+  // an inner block (strided) and whole columns (one contiguous run);
+  // taking a view and operating on it allocates nothing (the gslice of
+  // slc() does)
+  const size_t blocks[2][4] = { { 2, 13, 3, 9 },{ 0, 16, 4, 10 } };
+  for (const auto& k : blocks)
+  {
+    A = A0;
+    B.sub(k[0], k[1], k[2], k[3]);
+    A.sub(B.slc());
+    const size_t a0 = g_heap_allocs;
+    A.subreset();
+    A.sub(k[0], k[1], k[2], k[3]);
+    A *= 2.0;
+    A += B;
+    A -= 0.5;
+    A += B * B;
+    ASSERT_EQ(g_heap_allocs, a0);
+    ASSERT_EQ(A.rows(), k[1] - k[0] + 1);
+    ASSERT_EQ(A.cols(), k[3] - k[2] + 1);
+    A.subreset();
+    B.subreset();
+    for (size_t j = 0; j < A.cols(); ++j)
+    {
+      for (size_t i = 0; i < A.rows(); ++i)
+      {
+        const bool in = i >= k[0] && i <= k[1] && j >= k[2] && j <= k[3];
+        const double b = B0(i, j);
+        ASSERT_DOUBLE_EQ(A(i, j), in ? 2.0 * A0(i, j) + b - 0.5 + b * b : A0(i, j));
+      }
+    }
+  }
+
+  // fill, zeros and eye stay inside the view, also on MatView
+  A = A0;
+  A.sub(1, 4, 2, 5);
+  A.eye();
+  A.subreset();
+  A.view(10, 12, 0, 11).fill(3.0);
+  A.view(0, 16, 11, 11).zeros();
+  for (size_t j = 0; j < A.cols(); ++j)
+  {
+    for (size_t i = 0; i < A.rows(); ++i)
+    {
+      double e = A0(i, j);
+      if (i >= 1 && i <= 4 && j >= 2 && j <= 5)
+        e = i - 1 == j - 2 ? 1.0 : 0.0;
+      if (i >= 10 && i <= 12)
+        e = 3.0;
+      if (j == 11)
+        e = 0.0;
+      ASSERT_EQ(A(i, j), e);
+    }
+  }
+
+  // a copy between strided views and contiguous ones
+  MatD C(4, 6);
+  C.view().assign(A0.view(5, 8, 6, 11));
+  igm::copy_block(B.begincol(0), B.lda(), C.begin(), C.lda(), 4, 6);
+  for (size_t j = 0; j < 6; ++j)
+  {
+    for (size_t i = 0; i < 4; ++i)
+    {
+      ASSERT_EQ(C(i, j), A0(5 + i, 6 + j));
+      ASSERT_EQ(B(i, j), A0(5 + i, 6 + j));
+    }
+  }
+
+  // a gslice which is not a block of the matrix is refused
+  ASSERT_THROW(A.sub(std::gslice(0, { 4, 3 }, { 2, 17 })), std::runtime_error);
+}
+
+
+TEST(gather, gather_scatter)
+{
+  const int nt = omp_get_max_threads();
+  omp_set_num_threads(3);
+  RandReal<double> rnd(-1.0, 1.0);
+  const size_t m = 9000, n = 40;
+  MatD A(m, n);
+  for (auto a = A.begin(); a != A.end(); ++a)
+    *a = rnd();
+
+  // every third column backwards, and a random permutation of the columns
+  igm::Mat<size_t> idx(1, 14), perm(1, n), rperm(m, 1);
+  for (size_t j = 0; j < idx.cols(); ++j)
+    idx(0, j) = n - 1 - 3 * j;
+  std::iota(perm.begin(), perm.end(), size_t{ 0 });
+  std::iota(rperm.begin(), rperm.end(), size_t{ 0 });
+  for (size_t j = n - 1; j > 0; --j)
+    std::swap(perm(0, j), perm(0, static_cast<size_t>((rnd() + 1.0) * 0.5 * j)));
+  for (size_t i = m - 1; i > 0; --i)
+    std::swap(rperm(i, 0), rperm(static_cast<size_t>((rnd() + 1.0) * 0.5 * i), 0));
+
+  // into preallocated destinations nothing is allocated (after a warm up
+  // of the thread pool), the streaming stores give the same copy
+  MatD G(m, idx.cols()), Gs(m, idx.cols());
+  igm::gather_cols(G.view(), A.view(), idx.view());
+  const size_t a0 = g_heap_allocs;
+  igm::gather_cols(G.view(), A.view(), idx.view());
+  igm::gather_cols(Gs.view(), A.view(), idx.view(), igm::copy_mode::stream);
+  ASSERT_EQ(g_heap_allocs, a0);
+  for (size_t j = 0; j < idx.cols(); ++j)
+  {
+    for (size_t i = 0; i < m; ++i)
+    {
+      ASSERT_EQ(G(i, j), A(i, idx(0, j)));
+      ASSERT_EQ(Gs(i, j), A(i, idx(0, j)));
+    }
+  }
+  MatD S = A.sub(idx);
+  ASSERT_TRUE(std::equal(S.begin(), S.end(), G.begin()));
+
+  // the scatter puts the columns back and keeps the others
+  MatD Z(m, n);
+  igm::scatter_cols(Z, G, idx.view());
+  for (size_t j = 0; j < n; ++j)
+  {
+    const bool in = j % 3 == (n - 1) % 3;
+    for (size_t i = 0; i < m; ++i)
+      ASSERT_EQ(Z(i, j), in ? A(i, j) : 0.0);
+  }
+
+  // rows: a permutation and its inverse scatter
+  MatD P, B(m, n);
+  igm::gather_rows(P, A, rperm.view());
+  igm::scatter_rows(B, P, rperm.view());
+  for (size_t j = 0; j < n; ++j)
+  {
+    for (size_t i = 0; i < m; ++i)
+    {
+      ASSERT_EQ(P(i, j), A(rperm(i, 0), j));
+      ASSERT_EQ(B(i, j), A(i, j));
+    }
+  }
+
+  // the column permutation in place matches the gather, the inverse undoes it
+  MatD C(A), Cg;
+  igm::gather_cols(Cg, A, perm.view());
+  igm::permute_cols(C, perm.view());
+  ASSERT_TRUE(std::equal(C.begin(), C.end(), Cg.begin()));
+  igm::permute_cols(C, perm.view(), true);
+  ASSERT_TRUE(std::equal(C.begin(), C.end(), A.begin()));
+
+  // one cycle through all columns, the rotation p(j) = j + 1; a repeated
+  // call takes its marks from the warm arena
+  igm::Mat<size_t> rot(1, n);
+  for (size_t j = 0; j < n; ++j)
+    rot(0, j) = (j + 1) % n;
+  igm::gather_cols(Cg, A, rot.view());
+  igm::permute_cols(C, rot.view());
+  ASSERT_TRUE(std::equal(C.begin(), C.end(), Cg.begin()));
+  const size_t a1 = g_heap_allocs;
+  igm::permute_cols(C, rot.view(), true);
+  ASSERT_EQ(g_heap_allocs, a1);
+  ASSERT_TRUE(std::equal(C.begin(), C.end(), A.begin()));
+
+  // out of range indices and non permutations are refused
+  perm(0, 1) = perm(0, 0);
+  ASSERT_THROW(igm::permute_cols(C, perm.view()), std::runtime_error);
+  idx(0, 0) = n;
+  ASSERT_THROW(igm::gather_cols(G.view(), A.view(), idx.view()), std::runtime_error);
+  omp_set_num_threads(nt);
+}
+
+
+TEST(sparse, sparse_kernels)
+{
+  const int nt = omp_get_max_threads();
+  RandReal<double> rnd(-1.0, 1.0);
+  const size_t m = 2000, n = 600;
+
+  // about 3% nonzeros, every tenth one repeated (the duplicates add up)
+  std::vector<igm::Triplet<double>> t;
+  MatD D(m, n);
+  for (size_t k = 0; k < m * n * 3 / 100; ++k)
+  {
+    const size_t i = static_cast<size_t>((rnd() + 1.0) * 0.5 * (m - 1));
+    const size_t j = static_cast<size_t>((rnd() + 1.0) * 0.5 * (n - 1));
+    const double v = rnd();
+    t.push_back({ i, j, v });
+    D(i, j) += v;
+    if (k % 10 == 0) {
+      t.push_back({ i, j, 0.5 });
+      D(i, j) += 0.5;
+    }
+  }
+  const igm::SparseMat<double> S(m, n, t);
+  ASSERT_LE(S.nnz(), t.size());
+  ASSERT_GE(S.nnz(), igm::sparse_par_min);
+  for (size_t j = 0; j < n; ++j)
+  {
+    for (size_t p = S.colptr()[j] + 1; p < S.colptr()[j + 1]; ++p)
+      ASSERT_LT(S.rowidx()[p - 1], S.rowidx()[p]);
+  }
+  const MatD F = S.to_mat();
+  for (size_t j = 0; j < n; ++j)
+  {
+    for (size_t i = 0; i < m; ++i)
+    {
+      ASSERT_NEAR(F(i, j), D(i, j), 1e-14);
+      ASSERT_EQ(S(i, j), F(i, j));
+    }
+  }
+
+  MatD x(n, 1), xt(1, m), B(n, 5), Bt(m, 5);
+  for (auto a = x.begin(); a != x.end(); ++a)
+    *a = rnd();
+  for (auto a = xt.begin(); a != xt.end(); ++a)
+    *a = rnd();
+  for (auto a = B.begin(); a != B.end(); ++a)
+    *a = rnd();
+  for (auto a = Bt.begin(); a != Bt.end(); ++a)
+    *a = rnd();
+
+  // serial and parallel against dense loops
+  for (const int threads : { 1, 3 })
+  {
+    omp_set_num_threads(threads);
+    MatD y(m, 1, 1.0), yt(n, 1, 1.0), C(m, 5), Ct(n, 5), nrm(1, n);
+    igm::spmv(y, S, x, 2.0, 0.5);
+    const size_t a0 = g_heap_allocs;
+    igm::spmv(y, S, x, 2.0, 0.5);
+    igm::spmv_t(yt, S, xt, 1.0, 1.0);
+    ASSERT_EQ(g_heap_allocs, a0);
+    igm::spmm(C, S, B);
+    igm::spmm_t(Ct, S, Bt);
+    igm::sumabs2_col(nrm, S, 1);
+
+    for (size_t i = 0; i < m; ++i)
+    {
+      double s = 0.0;
+      for (size_t j = 0; j < n; ++j)
+        s += D(i, j) * x(j, 0);
+      ASSERT_NEAR(y(i, 0), 2.0 * s + 0.5 * (2.0 * s + 0.5), 1e-12);
+      for (size_t l = 0; l < 5; ++l)
+      {
+        double c = 0.0;
+        for (size_t j = 0; j < n; ++j)
+          c += D(i, j) * B(j, l);
+        ASSERT_NEAR(C(i, l), c, 1e-12);
+      }
+    }
+    for (size_t j = 0; j < n; ++j)
+    {
+      double s = 0.0, q = 0.0;
+      for (size_t i = 0; i < m; ++i)
+      {
+        s += D(i, j) * xt(0, i);
+        q += D(i, j) * D(i, j);
+      }
+      ASSERT_NEAR(yt(j, 0), s + 1.0, 1e-12);
+      ASSERT_NEAR(nrm(0, j), j ? q : 0.0, 1e-12);
+      for (size_t l = 0; l < 5; ++l)
+      {
+        double c = 0.0;
+        for (size_t i = 0; i < m; ++i)
+          c += D(i, j) * Bt(i, l);
+        ASSERT_NEAR(Ct(j, l), c, 1e-12);
+      }
+    }
+  }
+  omp_set_num_threads(nt);
+
+  // a column into a dense column, and back from dense
+  MatD c;
+  igm::col_into(c, S, 7);
+  for (size_t i = 0; i < m; ++i)
+    ASSERT_EQ(c(i, 0), F(i, 7));
+  const igm::SparseMat<double> S2(F);
+  ASSERT_EQ(S2.nnz(), S.nnz());
+  ASSERT_TRUE(std::equal(S2.values(), S2.values() + S2.nnz(), S.values()));
+  ASSERT_TRUE(std::equal(S2.rowidx(), S2.rowidx() + S2.nnz(), S.rowidx()));
+
+  ASSERT_THROW(igm::SparseMat<double>(2, 2, { { 2, 0, 1.0 } }), std::runtime_error);
+  ASSERT_THROW(igm::spmv(c, S, c), std::runtime_error);
+}